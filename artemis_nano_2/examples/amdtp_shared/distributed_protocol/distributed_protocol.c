@@ -1,9 +1,12 @@
 #include "distributed_protocol.h"
+#include "dp_wire.h"
+#include "dp_codec.h"
 #include <stdbool.h>
 #include <string.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
+#include "queue.h"
 
 // #define DP_MASTER 1
 // #define DP_SLAVE 0
@@ -19,419 +22,3496 @@
 
 #include "am_util_stdio.h"
 #include "am_util_debug.h"
+#include "am_mcu_apollo.h"
 
 TaskHandle_t distributionProtocolTaskHandle;
-uint8_t dpBuf[DP_BUF_SIZE];                                        // Buffer to store the distributed protocol packet
+const DpKernel *kernels[DP_MAX_KERNELS];                            // Registered job types
+int numKernels = 0;
 
 
 #if DP_SLAVE
-Task task;
+Task slaveTasks[DP_MAX_TASKS_PER_CLIENT];                           // Local task slots, a free slot has status UNKNOWN
+Task* slaveTaskQueue[DP_MAX_TASKS_PER_CLIENT];                      // Tasks waiting to be executed, most urgent first, then in order of arrival
+int numQueuedSlaveTasks = 0;
+TaskHandle_t workerTaskHandle;
+StaticTask_t workerTaskBuffer;                                      // The worker lives as long as the slave, no heap involved
+StackType_t workerStack[DP_WORKER_STACK_SIZE];
+dmConnId_t masterConnId;                                            // Connection the tasks came from, results are pushed back on it
+uint8_t operandBuffer[DP_MAX_DECODED_SIZE];                         // An operand decoded for a kernel without getOperandStorage, or to relay
 #endif
 
 #if DP_MASTER
 #define MAX_TASKS 4100
-Task tasks[MAX_TASKS + 1];
-Client connectedClients[DM_CONN_MAX];
-size_t taskCount;
-Task* taskQueue[MAX_TASKS + 1];
-int head = 0;
-int tail = 0;
+#define DP_NO_TASK -1
+#define DP_TASK_STATUS_BITS 2                                       // Enough for every eDpTaskStatus_t
+#define DP_TASKS_PER_STATUS_BYTE (8 / DP_TASK_STATUS_BITS)
+
+// one job of the master, a relay keeps one for each job of its parent that it passes on
+typedef struct {
+    uint8_t             id;                     // Sent in every packet of the job, DP_NO_JOB while the slot is free
+    eDpPriority_t       priority;
+    const DpKernel      *kernel;                // NULL while the slot is free
+    bool                running;                // Tasks are set up, until the last result is in
+    uint32_t            sequence;               // Order the jobs were started in, the older goes first within a priority
+    TickType_t          activeTime;             // Start of the job, on a relay the last task from the parent, the least recent makes room for a new one
+    uint8_t             taskStatus[(MAX_TASKS + DP_TASKS_PER_STATUS_BYTE - 1) / DP_TASKS_PER_STATUS_BYTE];     // Status of every task, indexed by task id
+    size_t              taskCount;
+    size_t              completedTaskCount;     // Tasks with status COMPLETE, kept by setTaskStatus
+    uint16_t            taskQueue[MAX_TASKS + 1];                   // Ids of the tasks waiting to be sent
+    int                 head;
+    int                 tail;
+    uint16_t            speculativeTasks[DP_MAX_SPECULATIVE_TASKS]; // In progress tasks to duplicate on another client
+    int                 numSpeculativeTasks;
+    // task size, see tuneTaskSize
+    uint32_t            taskWork;               // Work of the tasks the job was last cut into, 0 for the kernel's own cut
+    uint64_t            execUs;                 // Compute time the clients reported for results of the job
+    uint32_t            execWork;               // Work of those results
+    uint16_t            tuningResults;          // Results measured since the task size was last picked
+    bool                sizeTuned;              // Picked since the clients last changed
+} DpJob;
+
+DpJob jobs[DP_MAX_JOBS];                                            // Claimed by DpStartJob, set up and finished by the distributed task
+uint8_t lastJobId = DP_NO_JOB;
+uint32_t jobSequence = 0;
+Client connectedClients[DP_MAX_CLIENTS];
+uint8_t codecBuffer[DP_MAX_DECODED_SIZE];                           // Task data and operands on their way into a packet
+uint16_t regroupedTasks[MAX_TASKS];                                 // Queued tasks of a job while the kernel cuts them anew
+
+// links as the radio task sees them, syncClients brings connectedClients in line with them
+volatile bool linkUp[DM_CONN_MAX];
+volatile uint8_t linkGeneration[DP_MAX_CLIENTS];                    // Bumped on every connect and disconnect, stays 0 for the local lane
+uint8_t clientGeneration[DP_MAX_CLIENTS];                           // linkGeneration each entry of connectedClients was set up for
+volatile bool txAcked[DP_MAX_CLIENTS];                              // Set by DpTransCb, a full event queue must not lose an acknowledgement
+
+#if DP_LOCAL_LANE
+typedef struct {
+    DpJob *job;
+    uint8_t jobId;                                                  // job->id when the task was queued, the slot may be reused since
+    uint16_t taskId;
+} LocalLaneEntry;
+
+LocalLaneEntry localTaskQueue[DP_LOCAL_LANE_WINDOW + 1];            // Tasks handed to the local lane, in order
+int localHead = 0;
+int localTail = 0;
+Task localTask;                                                     // The local lane runs one task at a time in slot 0 of the kernel
+uint8_t localBuffer[AMDTP_MAX_PAYLOAD_SIZE];                        // Task data and operands, as they would go out in a packet
+TaskHandle_t localLaneTaskHandle;
+StaticTask_t localLaneTaskBuffer;
+StackType_t localLaneStack[DP_WORKER_STACK_SIZE];
+#endif
+
+typedef enum eDpEventType {
+    DP_EVENT_RESPONSE,                  // A client answered with the status of a task
+    DP_EVENT_TX_DONE,                   // A client acknowledged a packet, only wakes the distributed task, see txAcked
+    DP_EVENT_LINK,                      // A client connected or disconnected, only wakes the distributed task
+    DP_EVENT_RELAY_TASK,                // A relay received a task from its parent
+    DP_EVENT_JOB_START,                 // DpStartJob claimed a job slot
+} eDpEventType_t;
+
+// Event handed from the radio task to the distributed task, which owns all scheduler state
+typedef struct {
+    eDpEventType_t type;
+    int taskId;
+    eDpTaskStatus_t status;
+    dmConnId_t connId;
+    uint8_t generation;                 // linkGeneration of the client when the event was posted
+    uint8_t jobId;                      // Job of the task, or the job to start
+    dpWireReport_t report;              // What the client reported with the task, the execution time of this task alone
+    uint8_t kernelId;                   // Kernel of a relayed task
+    eDpPriority_t priority;             // Of a relayed task
+    uint8_t folds;                      // Results a relay folded into this one, DP_RESULT_FOLDED if it is one of them
+} DpEvent;
+
+#define DP_RESULT_FOLDED            0xFF
+
+QueueHandle_t eventQueue;
+StaticQueue_t eventQueueBuffer;
+uint8_t eventQueueStorage[DP_EVENT_QUEUE_LEN * sizeof(DpEvent)];
+
+#if DP_RELAY
+// the relay section further down
+DpJob *relayJob;
+void handleRelayTask(DpEvent *event);
+bool storeRelayResult(DpJob *job, int taskId, uint8_t *result, uint16_t resultLen, uint32_t execUs);
+bool queueRelayTask(Task *task);
+Task *foldRelayResults(Task **results, int numResults, Task *first);
+bool isFoldedRelayResult(Task *task);
+void updateRelayReport();
+uint32_t relayWorkers = 1;              // What the relay reports to its parent, see updateRelayReport
+uint32_t relayLinkUs;
+#endif
+
+#endif
 
+#if DP_TRACE
+typedef enum eDpTraceType {
+    DP_TRACE_JOB_START,                 // Every task of the job is queued, task holds the task count
+    DP_TRACE_DISPATCH,                  // Master handed the task to the link of a client
+    DP_TRACE_TX_DONE,                   // The client acknowledged the last packet, no task
+    DP_TRACE_TASK_START,                // Slave worker started executing the task
+    DP_TRACE_TASK_END,
+    DP_TRACE_RESPONSE,                  // Master received the result of the task
+    DP_TRACE_REQUEUE,                   // Master put the task back on the queue after the client gave up on it
+    DP_TRACE_JOB_END,
+    DP_TRACE_MAX
+} eDpTraceType_t;
+
+static const char *traceTypeNames[DP_TRACE_MAX] = {
+    "job_start", "dispatch", "tx_done", "start", "end", "response", "requeue", "job_end"
+};
+
+typedef struct {
+    uint32_t time;                      // DP_TRACE_TIMESTAMP() of the device that recorded it
+    uint16_t taskId;
+    uint8_t type;
+    uint8_t connId;                     // Client the event belongs to, 0 when there is none
+    uint8_t jobId;                      // Job the task belongs to, DP_NO_JOB when there is none
+} DpTraceEvent;
+
+DpTraceEvent traceEvents[DP_TRACE_LEN];
+uint32_t numTraceEvents = 0;                                        // Recorded so far, the ring slot is this modulo DP_TRACE_LEN
+uint32_t dumpedTraceEvents = 0;                                     // Value of numTraceEvents at the last dump
+uint32_t droppedTraceEvents = 0;                                    // Not recorded since the last dump, the ring was full
 #endif
 // --------------------------------------------------------------------------------------------
 
+#if DP_TRACE
+/**
+ * @brief Adds an event to the timeline, or counts it as dropped when the timeline is full so the start
+ *        of a job survives until the dump after it. The last slots are kept for the start and end of the jobs.
+ *        Called from the radio task as well as the distributed task and the worker.
+ */
+void recordTrace(eDpTraceType_t type, uint8_t jobId, int taskId, dmConnId_t connId) {
+    uint32_t time = DP_TRACE_TIMESTAMP();
+    bool jobEvent = (type == DP_TRACE_JOB_START || type == DP_TRACE_JOB_END);
+
+    taskENTER_CRITICAL();
+    if (numTraceEvents - dumpedTraceEvents >= DP_TRACE_LEN - (jobEvent ? 0 : 2 * DP_MAX_JOBS)) {
+        droppedTraceEvents++;
+        taskEXIT_CRITICAL();
+        return;
+    }
+    DpTraceEvent *event = &traceEvents[numTraceEvents % DP_TRACE_LEN];
+    event->time = time;
+    event->taskId = (uint16_t) taskId;
+    event->type = type;
+    event->connId = connId;
+    event->jobId = jobId;
+    numTraceEvents++;
+    taskEXIT_CRITICAL();
+}
+#else
+#define recordTrace(type, jobId, taskId, connId)
+#endif
+
+/**
+ * @brief Prints the recorded timeline as CSV and starts a new one.
+ *        amdtp_shared/utils/dp_timeline.py picks the lines out of the log of the master and the slaves.
+ *        Only called once the jobs finished or the worker went idle, printing stalls the caller.
+ */
+void DpTraceDump() {
+#if DP_TRACE
+    taskENTER_CRITICAL();
+    uint32_t numEvents = numTraceEvents;
+    uint32_t dropped = droppedTraceEvents;
+    droppedTraceEvents = 0;
+    taskEXIT_CRITICAL();
+
+    if (numEvents == dumpedTraceEvents && dropped == 0) {
+        return;
+    }
+
+    // the last field is the number of events that did not fit, they are missing from the end
+#if DP_RELAY
+    const char *role = "relay";
+#elif DP_MASTER
+    const char *role = "master";
+#else
+    const char *role = "slave";
+#endif
+    am_util_stdio_printf("dp_trace,begin,%s,%d,%d\n", role, DP_TRACE_CLOCK_HZ, dropped);
+    for (uint32_t i = dumpedTraceEvents; i != numEvents; i++) {
+        DpTraceEvent *event = &traceEvents[i % DP_TRACE_LEN];
+        am_util_stdio_printf("dp_trace,%u,%s,%d,%d,%d\n", event->time, traceTypeNames[event->type], event->taskId,
+                             event->connId, event->jobId);
+    }
+    am_util_stdio_printf("dp_trace,end\n");
+    dumpedTraceEvents = numEvents;      // Events recorded while printing go out with the next dump
+#endif
+}
+
+/**
+ * @brief Microseconds since an earlier DP_TRACE_TIMESTAMP(), the clock of the timeline also times the tasks
+ */
+uint32_t elapsedUs(uint32_t start) {
+    return (uint32_t) ((uint64_t) (DP_TRACE_TIMESTAMP() - start) * 1000000 / DP_TRACE_CLOCK_HZ);
+}
+
+/**
+ * @brief Where an operand goes on its way to storeOperand, the kernel's own memory if getOperandStorage
+ *        offers room for it, so it is written once
+ *
+ * @param size The bytes the operand takes, 0 if it is not decoded yet. Set to the room where it goes
+ * @param buffer Where it goes otherwise, storeOperand copies it out
+ */
+uint8_t *operandStorage(const DpKernel *kernel, uint16_t operandId, uint16_t *size, uint8_t *buffer) {
+    uint16_t room = 0;
+    uint8_t *storage = (kernel->getOperandStorage != NULL) ? kernel->getOperandStorage(operandId, &room) : NULL;
+
+    if (storage == NULL || room < *size) {
+        *size = DP_MAX_DECODED_SIZE;
+        return buffer;
+    }
+    *size = room;
+    return storage;
+}
+
 
 #if DP_MASTER
-bool isTaskQueueEmpty() {
-    return head == tail;
+eDpTaskStatus_t getTaskStatus(DpJob *job, int taskId) {
+    int shift = (taskId % DP_TASKS_PER_STATUS_BYTE) * DP_TASK_STATUS_BITS;
+    return (eDpTaskStatus_t) ((job->taskStatus[taskId / DP_TASKS_PER_STATUS_BYTE] >> shift) & ((1 << DP_TASK_STATUS_BITS) - 1));
+}
+
+/**
+ * @brief Sets the status of a task and keeps completedTaskCount of its job up to date.
+ *        Only called from the distributed task.
+ */
+void setTaskStatus(DpJob *job, int taskId, eDpTaskStatus_t status) {
+    int shift = (taskId % DP_TASKS_PER_STATUS_BYTE) * DP_TASK_STATUS_BITS;
+    uint8_t *statusByte = &job->taskStatus[taskId / DP_TASKS_PER_STATUS_BYTE];
+    eDpTaskStatus_t oldStatus = getTaskStatus(job, taskId);
+
+    if (oldStatus != DP_TASK_STATUS_COMPLETE && status == DP_TASK_STATUS_COMPLETE) {
+        job->completedTaskCount++;
+    } else if (oldStatus == DP_TASK_STATUS_COMPLETE && status != DP_TASK_STATUS_COMPLETE) {
+        job->completedTaskCount--;
+    }
+
+    *statusByte = (*statusByte & ~(((1 << DP_TASK_STATUS_BITS) - 1) << shift)) | (status << shift);
+}
+
+/**
+ * @brief Points the hooks of a relay at a job, they only get a task id and find the job in relayJob.
+ *        The distributed task calls it before it works on a job, it is the only one that calls the hooks.
+ *        Does nothing on a master that is not a relay.
+ */
+void selectRelayJob(DpJob *job) {
+#if DP_RELAY
+    relayJob = job;
+#endif
+}
+
+/**
+ * @brief Slot of a job in jobs[], also its index into Client.cachedOperands
+ */
+int jobSlot(DpJob *job) {
+    return job - jobs;
+}
+
+/**
+ * @brief Finds a running job by the id in its packets. Called from the radio task as well.
+ *
+ * @return The job, NULL if no job with this id is running
+ */
+DpJob *findJob(uint8_t jobId) {
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        if (jobs[i].running && jobs[i].id == jobId) {
+            return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief The header of a packet of a job
+ */
+dpWireHeader_t jobHeader(DpJob *job, eDpPktType_t type) {
+    dpWireHeader_t header = { .type = type, .kernelId = job->kernel->id, .jobId = job->id, .priority = job->priority };
+    return header;
+}
+
+/**
+ * @brief Fills in a task from its id, for the functions that work on one task at a time
+ */
+void loadTask(DpJob *job, int taskId, Task *task) {
+    task->taskId = taskId;
+    task->status = getTaskStatus(job, taskId);
+    task->data = NULL;                      // Copied straight into the packet by copyTaskDataToSendBuffer
+    task->dataLength = job->kernel->getTaskDataLength(taskId);
+    task->result = job->kernel->getTaskResult(taskId);
+    task->kernelId = job->kernel->id;
+    task->jobId = job->id;
+    task->priority = job->priority;
+}
+
+/**
+ * @brief Picks the encoding of the data of a task, with the length it takes on the wire.
+ *        Done once when the task is picked for a packet, encodeTaskData writes it that way.
+ */
+dpCodecPick_t pickTaskData(DpJob *job, int taskId) {
+    const DpKernel *kernel = job->kernel;
+    uint16_t len = kernel->getTaskDataLength(taskId);
+
+    if (kernel->taskDataType != DP_ELEMENT_RAW && len > 0) {
+        kernel->copyTaskDataToSendBuffer(codecBuffer, taskId);
+    }
+    return DpCodecPick(kernel->taskDataType, codecBuffer, len);
+}
+
+/**
+ * @brief Writes the data of a task into a packet in the encoding pickTaskData picked
+ *
+ * @return The number of bytes written, pick.size
+ */
+uint16_t encodeTaskData(DpJob *job, uint8_t *buf, int taskId, dpCodecPick_t pick) {
+    const DpKernel *kernel = job->kernel;
+    uint16_t len = kernel->getTaskDataLength(taskId);
+
+    if (kernel->taskDataType == DP_ELEMENT_RAW || len == 0) {
+        kernel->copyTaskDataToSendBuffer(buf, taskId);
+        return len;
+    }
+    kernel->copyTaskDataToSendBuffer(codecBuffer, taskId);
+    return DpCodecEncodePicked(kernel->taskDataType, pick, codecBuffer, len, buf);
+}
+
+/**
+ * @brief Picks the encoding of an operand, with the length it takes on the wire.
+ *        Done once when the operand is picked for a packet, encodeOperand writes it that way.
+ */
+dpCodecPick_t pickOperand(DpJob *job, uint16_t operandId) {
+    const DpKernel *kernel = job->kernel;
+    uint16_t len = kernel->getOperandLength(operandId);
+
+    if (kernel->operandType != DP_ELEMENT_RAW && len > 0) {
+        kernel->copyOperandToSendBuffer(codecBuffer, operandId);
+    }
+    return DpCodecPick(kernel->operandType, codecBuffer, len);
+}
+
+/**
+ * @brief Writes an operand into a packet in the encoding pickOperand picked
+ *
+ * @return The number of bytes written, pick.size
+ */
+uint16_t encodeOperand(DpJob *job, uint8_t *buf, uint16_t operandId, dpCodecPick_t pick) {
+    const DpKernel *kernel = job->kernel;
+    uint16_t len = kernel->getOperandLength(operandId);
+
+    if (kernel->operandType == DP_ELEMENT_RAW || len == 0) {
+        kernel->copyOperandToSendBuffer(buf, operandId);
+        return len;
+    }
+    kernel->copyOperandToSendBuffer(codecBuffer, operandId);
+    return DpCodecEncodePicked(kernel->operandType, pick, codecBuffer, len, buf);
+}
+
+bool isTaskQueueEmpty(DpJob *job) {
+    return job->head == job->tail;
 }
 
-bool enqueueTask(Task* task) {
-    if ((tail + 1) % MAX_TASKS == head) {
+bool enqueueTask(DpJob *job, int taskId) {
+    if ((job->tail + 1) % MAX_TASKS == job->head) {
         // Queue is full
         am_util_debug_printf("Task queue is full, cannot add task\n");
         return false;
     }
 
-    taskQueue[tail] = task;
-    tail = (tail + 1) % MAX_TASKS;
+    job->taskQueue[job->tail] = taskId;
+    job->tail = (job->tail + 1) % MAX_TASKS;
     return true;
 }
 
-void addTaskBackToQueue(Task *task) {
-    if (!enqueueTask(task)) {
+void addTaskBackToQueue(DpJob *job, int taskId) {
+    if (!enqueueTask(job, taskId)) {
         while(1); // Queue is full, this should not happen!
     } // Add the task back to the task queue
 }
 
 
-Task* dequeueTask() {
-    if (isTaskQueueEmpty()) {
+int dequeueTask(DpJob *job) {
+    if (isTaskQueueEmpty(job)) {
         // Queue is empty
-        return NULL;
+        return DP_NO_TASK;
     }
 
-    Task* task = taskQueue[head];
-    head = (head + 1) % MAX_TASKS;
-    return task;
+    int taskId = job->taskQueue[job->head];
+    job->head = (job->head + 1) % MAX_TASKS;
+    return taskId;
 }
-#endif
 
-#if DP_SLAVE
-void runExecuteTask(void *pvParameters) {
-    Task *task = (Task *) pvParameters;
-    am_util_debug_printf("Running task %d\n", task->taskId);
-    executeTask(task);
+/**
+ * @brief Takes the last task off the queue of a job, dropping tasks that were completed by another client in the meantime
+ */
+int takeTailTask(DpJob *job) {
+    while (!isTaskQueueEmpty(job)) {
+        job->tail = (job->tail + MAX_TASKS - 1) % MAX_TASKS;
+        int taskId = job->taskQueue[job->tail];
+        if (getTaskStatus(job, taskId) != DP_TASK_STATUS_COMPLETE) {
+            return taskId;
+        }
+    }
+    return DP_NO_TASK;
 }
-#endif
 
-// helper function to dump buffer
-void print_buffer(uint8_t *buf, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        am_util_debug_printf("%02X ", buf[i]);
-        if ((i + 1) % 16 == 0) {
-            am_util_debug_printf("\n");
+/**
+ * @brief Removes the entry at a position of the in-flight list of a client,
+ *        keeping the remaining tasks in the order they were sent
+ */
+void removeClientEntry(Client *client, int i) {
+    for (int j = i + 1; j < client->numAssignedTasks; j++) {
+        client->assignedTasks[j - 1] = client->assignedTasks[j];
+        client->assignedJobs[j - 1] = client->assignedJobs[j];
+        client->assignedTime[j - 1] = client->assignedTime[j];
+    }
+    if (i >= client->numAssignedTasks - client->numUnsentTasks) {
+        client->numUnsentTasks--;
+    }
+    client->numAssignedTasks--;
+}
+
+/**
+ * @brief Removes a task from the in-flight list of a client
+ * 
+ * @param client The client
+ * @param job The job of the task
+ * @param taskId The id of the task
+ * 
+ * @return true if the client was holding the task
+ */
+bool removeTaskFromClient(Client *client, DpJob *job, int taskId) {
+    for (int i = 0; i < client->numAssignedTasks; i++) {
+        if (client->assignedTasks[i] == taskId && client->assignedJobs[i] == jobSlot(job)) {
+            removeClientEntry(client, i);
+            return true;
         }
     }
-    am_util_debug_printf("\n");
+    return false;
 }
 
-void print_status(eDpTaskStatus_t status) {
-    switch (status) {
-    case DP_TASK_STATUS_COMPLETE:
-        am_util_stdio_printf("COMPLETE\n");
-        break;
-    case DP_TASK_STATUS_IN_PROGRESS:
-        am_util_stdio_printf("IN PROGRESS\n");
-        break;
-    case DP_TASK_STATUS_INCOMPLETE:
-        am_util_stdio_printf("INCOMPLETE\n");
-        break;
-    case DP_TASK_STATUS_UNKNOWN:
-        am_util_stdio_printf("UNKNOWN\n");
-    default:
-        am_util_stdio_printf("???\n");
-        break;
+bool clientHoldsTask(Client *client, DpJob *job, int taskId) {
+    for (int i = 0; i < client->numAssignedTasks; i++) {
+        if (client->assignedTasks[i] == taskId && client->assignedJobs[i] == jobSlot(job)) {
+            return true;
+        }
+    }
+    return false;
 }
+
+/**
+ * @brief Counts the tasks of a job in flight on a client
+ */
+int countClientJobTasks(Client *client, DpJob *job) {
+    int count = 0;
+    for (int i = 0; i < client->numAssignedTasks; i++) {
+        count += (client->assignedJobs[i] == jobSlot(job));
+    }
+    return count;
 }
 
-// --------------------------------------------------------------------------------------------
+/**
+ * @brief Counts the clients working on a task, more than one when it was sent speculatively
+ */
+int countTaskHolders(DpJob *job, int taskId) {
+    int holders = 0;
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        if (connectedClients[i].connId != 0 && clientHoldsTask(&connectedClients[i], job, taskId)) {
+            holders++;
+        }
+    }
+    return holders;
+}
 
-#if DP_MASTER
-void initializeTasks() {
-    // Call the application defined function to initialize the location to store data and result
-    am_util_debug_printf("Initializing distributed tasks...\n");
-    initClientTasks(tasks, &taskCount); 
+/**
+ * @brief Puts a task that a client gave up on back on the task queue of its job,
+ *        unless it is finished or another client is still working on it
+ * 
+ * @param job The job of the task
+ * @param taskId The id of the task
+ * @param connId The client that gave up on it
+ */
+void releaseTask(DpJob *job, int taskId, dmConnId_t connId) {
+    if (!job->running || getTaskStatus(job, taskId) == DP_TASK_STATUS_COMPLETE || countTaskHolders(job, taskId) > 0) {
+        return;
+    }
+    setTaskStatus(job, taskId, DP_TASK_STATUS_INCOMPLETE);
+    addTaskBackToQueue(job, taskId);
+    recordTrace(DP_TRACE_REQUEUE, job->id, taskId, connId);
+}
+
+/**
+ * @brief Puts every unfinished task held by a client back on the task queue of its job
+ */
+void requeueClientTasks(Client *client) {
+    uint16_t released[DP_MAX_TASKS_PER_CLIENT];
+    uint8_t releasedJobs[DP_MAX_TASKS_PER_CLIENT];
+    int numReleased = client->numAssignedTasks;
+
+    for (int i = 0; i < numReleased; i++) {
+        released[i] = client->assignedTasks[i];
+        releasedJobs[i] = client->assignedJobs[i];
+    }
+    client->numAssignedTasks = 0;
+    client->numUnsentTasks = 0;
+    client->numFoldedTasks = 0;
+
+    for (int i = 0; i < numReleased; i++) {
+        releaseTask(&jobs[releasedJobs[i]], released[i], client->connId);
+    }
+}
+
+/**
+ * @brief Feeds the time a client took for one task into its service time estimate.
+ *        Results that arrive together share the time since the previous result.
+ *        The estimate is per client, the jobs that share it are assumed to take about as long per task.
+ */
+void recordTaskTime(Client *client, DpJob *job, int taskId, TickType_t now) {
+    TickType_t start = client->lastCompletionTime;
+
+    for (int i = 0; i < client->numAssignedTasks; i++) {
+        if (client->assignedTasks[i] == taskId && client->assignedJobs[i] == jobSlot(job)
+            && (int32_t) (client->assignedTime[i] - start) > 0) {
+            start = client->assignedTime[i];    // The client was idle until this task arrived
+        }
+    }
+
+    int32_t sample = (int32_t) (now - start) * DP_SERVICE_TIME_SCALE;
+    if (client->serviceTime == 0) {
+        client->serviceTime = sample > 0 ? sample : 1;
+    } else {
+        int32_t serviceTime = client->serviceTime + (sample - (int32_t) client->serviceTime) / DP_SERVICE_TIME_WEIGHT;
+        client->serviceTime = serviceTime > 0 ? serviceTime : 1;
+    }
+    client->lastCompletionTime = now;
+    client->tasksCompleted++;
+}
+
+/**
+ * @brief Feeds the time the last packet to a client took until it was acknowledged into its link time estimate
+ */
+void recordLinkTime(Client *client, TickType_t now) {
+    int32_t sample = (int32_t) (now - client->sentTime) * DP_SERVICE_TIME_SCALE;
+
+    if (client->linkTime == 0) {
+        client->linkTime = sample > 0 ? sample : 1;
+    } else {
+        int32_t linkTime = client->linkTime + (sample - (int32_t) client->linkTime) / DP_SERVICE_TIME_WEIGHT;
+        client->linkTime = linkTime > 0 ? linkTime : 1;
+    }
+}
+
+/**
+ * @brief Time a packet to the client takes until it is acknowledged, in microseconds
+ */
+uint32_t clientLinkUs(Client *client) {
+    return (uint64_t) client->linkTime * (1000000 / configTICK_RATE_HZ) / DP_SERVICE_TIME_SCALE;
+}
+
+/**
+ * @brief Adds the compute time a client reported for a result to the measurements its job picks the task size from
+ */
+void recordExecTime(DpJob *job, int taskId, uint32_t execUs) {
+    if (execUs == 0 || job->kernel->getTaskWork == NULL) {
+        return;                             // A relay's own jobs, or a client that could not tell
+    }
+    job->execUs += execUs;
+    job->execWork += job->kernel->getTaskWork(taskId);
+    job->tuningResults++;
+}
+
+bool isOperandCached(Client *client, DpJob *job, uint16_t operandId) {
+    return (client->cachedOperands[jobSlot(job)][operandId / 8] & (1 << (operandId % 8))) != 0;
+}
+
+void setOperandCached(Client *client, DpJob *job, uint16_t operandId) {
+    client->cachedOperands[jobSlot(job)][operandId / 8] |= 1 << (operandId % 8);
+}
+
+bool isLocalLane(Client *client) {
+    return client->connId == DP_LOCAL_CONN_ID;
+}
+
+/**
+ * @brief Number of tasks a client may hold, in proportion to how fast it is compared to the
+ *        fastest client. Every client then needs about the same time to clear its list.
+ *        Clients that have not delivered a result yet get one batch.
+ */
+int clientWindow(Client *client) {
+    uint32_t fastest = 0;
+
+    if (isLocalLane(client)) {
+        return DP_LOCAL_LANE_WINDOW;        // Refilled on every result, it never waits for a link
+    }
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        uint32_t serviceTime = connectedClients[i].serviceTime;
+        // the local lane's time has no transfer in it, it would shrink the window of every BLE client
+        if (connectedClients[i].connId != 0 && !isLocalLane(&connectedClients[i]) && serviceTime != 0
+            && (fastest == 0 || serviceTime < fastest)) {
+            fastest = serviceTime;
+        }
+    }
+
+    if (client->serviceTime == 0) {
+        return DP_MAX_TASKS_PER_BATCH;
+    }
+
+    int window = (DP_MAX_TASKS_PER_CLIENT * fastest) / client->serviceTime;
+    return window > 0 ? window : 1;
+}
+
+/**
+ * @brief Tasks of every job a client may hold before a job of this priority sends it more.
+ *        While a job of a higher priority runs, each priority between them leaves DP_PRIORITY_RESERVE
+ *        more of the window free, so the tasks the clients finish make room for the more urgent job.
+ *        A job that runs alone keeps the whole window.
+ */
+int jobWindow(Client *client, DpJob *job) {
+    int window = clientWindow(client);
+    eDpPriority_t highest = job->priority;
+
+    if (isLocalLane(client)) {
+        return window;                      // Two tasks deep, a reserve would leave it idle
+    }
+
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        if (jobs[i].running && jobs[i].priority > highest) {
+            highest = jobs[i].priority;
+        }
+    }
+    window -= DP_PRIORITY_RESERVE * (highest - job->priority);
+    return window > 0 ? window : 1;
+}
+
+/**
+ * @brief Marks a task complete once its first result arrived, its result was already copied
+ *
+ * @param folded A relay folded the result into the one of another task, the kernel gets NULL for it
+ */
+void completeTask(DpJob *job, int taskId, dmConnId_t connId, bool folded) {
+    if (getTaskStatus(job, taskId) == DP_TASK_STATUS_COMPLETE) {
+        // a speculative copy already delivered, the first result wins
+        am_util_debug_printf("Discarding duplicate result for task %d from client %d\n", taskId, connId);
+        return;
+    }
+
+    setTaskStatus(job, taskId, DP_TASK_STATUS_COMPLETE);
+    if (job->kernel->onTaskComplete != NULL) {
+        // from here on no copy overwrites the result, the kernel may consume it and reuse the memory
+        const DpKernel *kernel = job->kernel;
+        kernel->onTaskComplete(taskId, folded ? NULL : kernel->getTaskResult(taskId));
+    }
+}
+
+/**
+ * @brief Puts the tasks a relay folded into a result that did not come back on the queue
+ */
+void dropFoldedTasks(Client *client) {
+    DpJob *job = &jobs[client->foldedJob];
+
+    for (int i = 0; i < client->numFoldedTasks; i++) {
+        if (removeTaskFromClient(client, job, client->foldedTasks[i])) {
+            releaseTask(job, client->foldedTasks[i], client->connId);
+        }
+    }
+    client->numFoldedTasks = 0;
+}
+
+/**
+ * @brief Keeps a task a relay folded into the result of the next entry, until that result arrives
+ */
+void holdFoldedTask(Client *client, DpJob *job, int taskId) {
+    if (client->numFoldedTasks > 0 && client->foldedJob != jobSlot(job)) {
+        dropFoldedTasks(client);            // Its result never arrived
+    }
+    if (client->numFoldedTasks == DP_MAX_TASKS_PER_CLIENT) {
+        if (removeTaskFromClient(client, job, taskId)) {
+            releaseTask(job, taskId, client->connId);
+        }
+        return;
+    }
+    client->foldedJob = jobSlot(job);
+    client->foldedTasks[client->numFoldedTasks++] = taskId;
+}
+
+/**
+ * @brief Completes a result a relay folded the results of other tasks into, together with those tasks.
+ *        If one of them completed already, through a copy on another client, the folded result holds its
+ *        part twice, and if one of them was lost on the way it holds a part the master cannot account for.
+ *        Either way the whole group goes back on the queue.
+ */
+void completeFoldedTasks(Client *client, DpJob *job, DpEvent *event, TickType_t now) {
+    if (client->numFoldedTasks > 0 && client->foldedJob != jobSlot(job)) {
+        dropFoldedTasks(client);
+    }
+
+    int numFolded = client->numFoldedTasks;
+    bool usable = event->status == DP_TASK_STATUS_COMPLETE && event->folds == numFolded
+                  && getTaskStatus(job, event->taskId) != DP_TASK_STATUS_COMPLETE;
+    for (int i = 0; i < numFolded; i++) {
+        usable = usable && getTaskStatus(job, client->foldedTasks[i]) != DP_TASK_STATUS_COMPLETE;
+    }
+
+    // the folded tasks first, a relay sends them up once the result they are part of completes
+    for (int i = 0; i <= numFolded; i++) {
+        int taskId = (i < numFolded) ? client->foldedTasks[i] : event->taskId;
+        if (usable) {
+            completeTask(job, taskId, client->connId, i < numFolded);
+            recordTaskTime(client, job, taskId, now);
+            recordExecTime(job, taskId, event->report.execUs);
+            removeTaskFromClient(client, job, taskId);
+        } else if (removeTaskFromClient(client, job, taskId)) {
+            releaseTask(job, taskId, client->connId);
+        }
+    }
+    if (!usable) {
+        am_util_stdio_printf("Result of task %d folds in %d tasks, some missing or complete already, requeueing the rest\n",
+                             event->taskId, numFolded);
+    }
+    client->numFoldedTasks = 0;
+}
+
+/**
+ * @brief Checks that an event comes from the connection the client entry was set up for,
+ *        not from one that dropped while the event waited in the queue
+ */
+bool isCurrentEvent(DpEvent *event) {
+    return connectedClients[event->connId - 1].connId == event->connId
+        && clientGeneration[event->connId - 1] == event->generation;
+}
+
+/**
+ * @brief Updates the scheduler with a response received from a client
+ * 
+ * @param event The response posted by DpRecvCb
+ */
+void handleTaskResponse(DpEvent *event) {
+    int taskId = event->taskId;
+    Client *client = &connectedClients[event->connId - 1];
+    eDpTaskStatus_t status = event->status;
+    TickType_t now = xTaskGetTickCount();
+    DpJob *job = findJob(event->jobId);
+    bool current = isCurrentEvent(event);
+
+    if (current) {
+        client->awaitingReply = false;
+        client->lastHeardTime = now;
+        client->missedReplies = 0;
+        client->nextPollTime = now + pdMS_TO_TICKS(DP_POLL_INTERVAL_MS);
+        if (event->report.workers != client->workers) {
+            // a relay, or slaves joined or left behind it, the task size is picked again
+            for (int i = 0; i < DP_MAX_JOBS; i++) {
+                jobs[i].sizeTuned = false;
+            }
+        }
+        client->workers = event->report.workers;
+        client->downstreamUs = event->report.linkUs;
+    }
+
+    if (job == NULL) {
+        return;                             // The job finished while the response waited in the queue
+    }
+    selectRelayJob(job);
+
+    if (!current) {
+        // the tasks of the old connection were requeued already, a result is still good
+        // unless a relay folded it, its group was on the old connection
+        if (status == DP_TASK_STATUS_COMPLETE && event->folds == 0) {
+            completeTask(job, taskId, event->connId, false);
+        }
+        return;
+    }
+
+    if (event->folds == DP_RESULT_FOLDED) {
+        holdFoldedTask(client, job, taskId);
+        return;
+    }
+    if (client->numFoldedTasks > 0 && event->folds == 0) {
+        dropFoldedTasks(client);            // The result they were folded into never arrived
+    }
+    if (event->folds > 0) {
+        completeFoldedTasks(client, job, event, now);
+#if !DP_PUSH_COMPLETION
+        client->nextPollTime = now;
+#endif
+        return;
+    }
+
+    if (status == DP_TASK_STATUS_COMPLETE) {
+        completeTask(job, taskId, event->connId, false);
+        recordTaskTime(client, job, taskId, now);
+        recordExecTime(job, taskId, event->report.execUs);
+        removeTaskFromClient(client, job, taskId); // Remove the task from the client
+#if !DP_PUSH_COMPLETION
+        client->nextPollTime = now;         // The next task may already be done too
+#endif
+
+    } else if (status == DP_TASK_STATUS_IN_PROGRESS) {
+        //still in progress, checkTaskDeadlines catches it if it takes too long
+    } else if (status == DP_TASK_STATUS_UNKNOWN) {
+        //task failed, or slave is not working on this task
+        if (removeTaskFromClient(client, job, taskId)) {
+            releaseTask(job, taskId, client->connId);   // Add the task back to the task queue
+        }
+    } else {
+        am_util_stdio_printf("Unknown task status, adding back to queue!\n");
+        if (removeTaskFromClient(client, job, taskId)) {
+            releaseTask(job, taskId, client->connId);   // Add the task back to the task queue
+        }
+    }
+}
+
+// the scheduler section further down
+void startJob(uint8_t jobId);
+
+/**
+ * @brief Frees the links of the clients that acknowledged their last packet since the last call
+ */
+void collectAcknowledgements() {
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (!txAcked[i]) {
+            continue;
+        }
+        txAcked[i] = false;
+        if (client->connId == 0 || clientGeneration[i] != linkGeneration[i]) {
+            continue;                       // For a connection that dropped since, syncClients starts the new one afresh
+        }
+        client->txBusy = false;
+        client->lastHeardTime = xTaskGetTickCount();
+        recordLinkTime(client, client->lastHeardTime);
+    }
+}
+
+/**
+ * @brief Handles the events posted by the radio task, in the order they arrived
+ * 
+ * @param waitTicks How long to block for the first event
+ * 
+ * @return The number of events handled
+ */
+int processEvents(TickType_t waitTicks) {
+    DpEvent event;
+    int numEvents = 0;
+
+    while (xQueueReceive(eventQueue, &event, numEvents == 0 ? waitTicks : 0) == pdTRUE) {
+        if (event.type == DP_EVENT_RESPONSE) {
+            handleTaskResponse(&event);
+        } else if (event.type == DP_EVENT_JOB_START) {
+            startJob(event.jobId);
+        }
+#if DP_RELAY
+        else if (event.type == DP_EVENT_RELAY_TASK) {
+            handleRelayTask(&event);
+        }
+#endif
+        // DP_EVENT_LINK only wakes the task, syncClients acts on it in the next pass
+        numEvents++;
+    }
+
+    collectAcknowledgements();
+    return numEvents;
+}
+#endif
+
+#if DP_SLAVE
+/**
+ * @brief Queues a task behind the queued tasks of its priority and ahead of the less urgent ones
+ */
+bool enqueueSlaveTask(Task *task) {
+    if (numQueuedSlaveTasks == DP_MAX_TASKS_PER_CLIENT) {
+        return false;
+    }
+
+    int pos = numQueuedSlaveTasks++;
+    while (pos > 0 && slaveTaskQueue[pos - 1]->priority < task->priority) {
+        slaveTaskQueue[pos] = slaveTaskQueue[pos - 1];
+        pos--;
+    }
+    slaveTaskQueue[pos] = task;
+    return true;
+}
+
+Task* dequeueSlaveTask() {
+    if (numQueuedSlaveTasks == 0) {
+        return NULL;
+    }
+
+    Task *task = slaveTaskQueue[0];
+    numQueuedSlaveTasks--;
+    for (int i = 0; i < numQueuedSlaveTasks; i++) {
+        slaveTaskQueue[i] = slaveTaskQueue[i + 1];
+    }
+    return task;
+}
+
+/**
+ * @brief Finds the slot holding the given task
+ * 
+ * @param jobId The job of the task, task ids of different jobs overlap
+ * @param taskId The id of the task
+ * 
+ * @return The task slot, or NULL if the slave does not hold this task
+ */
+Task* findSlaveTask(uint8_t jobId, int taskId) {
+    for (int i = 0; i < DP_MAX_TASKS_PER_CLIENT; i++) {
+        if (slaveTasks[i].status != DP_TASK_STATUS_UNKNOWN && slaveTasks[i].taskId == taskId
+            && slaveTasks[i].jobId == jobId) {
+            return &slaveTasks[i];
+        }
+    }
+    return NULL;
+}
+
+Task* findFreeSlaveTask() {
+    for (int i = 0; i < DP_MAX_TASKS_PER_CLIENT; i++) {
+        if (slaveTasks[i].status == DP_TASK_STATUS_UNKNOWN) {
+            return &slaveTasks[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Length of the result of a finished task on the wire, once encoded
+ */
+uint16_t encodedResultLength(Task *task) {
+    return DpCodecEncodedSize(DpFindKernel(task->kernelId)->resultType, task->result, task->dataLength);
+}
+
+/**
+ * @brief Writes the result of a finished task into a packet, encoded as its kernel declared it
+ *
+ * @return The number of bytes written, encodedResultLength(task)
+ */
+uint16_t encodeResult(uint8_t *buf, Task *task) {
+    return DpCodecEncode(DpFindKernel(task->kernelId)->resultType, task->result, task->dataLength, buf);
+}
+
+/**
+ * @brief Collects the finished tasks whose results have not been handed to the master yet
+ * 
+ * @param results Filled with the finished tasks, must hold DP_MAX_TASKS_PER_CLIENT entries
+ * 
+ * @return The number of finished tasks
+ */
+int findCompletedSlaveTasks(Task **results) {
+    int numResults = 0;
+    for (int i = 0; i < DP_MAX_TASKS_PER_CLIENT; i++) {
+        if (slaveTasks[i].status == DP_TASK_STATUS_COMPLETE) {
+            results[numResults++] = &slaveTasks[i];
+        }
+    }
+    return numResults;
+}
+
+/**
+ * @brief Whether a relay folded the result of a finished task into another, it goes up without data
+ */
+bool isFoldedResult(Task *task) {
+#if DP_RELAY
+    return isFoldedRelayResult(task);
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief What a response tells the master besides the results, see dp_wire.h
+ *
+ * @param execUs The time spent executing the tasks of the response
+ */
+dpWireReport_t slaveReport(uint32_t execUs) {
+    dpWireReport_t report = { .execUs = execUs, .workers = 1, .linkUs = 0 };
+#if DP_RELAY
+    report.workers = relayWorkers;          // Kept up to date by the distributed task
+    report.linkUs = relayLinkUs;
+#endif
+    return report;
+}
+
+/**
+ * @brief Builds the response carrying the results of finished tasks,
+ *        a RESPONSE_BATCH when there is more than one. A packet carries a single job, the most
+ *        urgent one with results, results of other jobs are left for the next response.
+ * 
+ * @param results The finished tasks, the ones packed are moved to the front
+ * @param numResults The number of finished tasks, updated to the number that fit in the packet
+ * @param buf The buffer to build the packet in
+ * @param bufSize The size of the buffer
+ * 
+ * @return The length of the packet
+ */
+uint16_t buildResultPacket(Task **results, int *numResults, uint8_t *buf, int bufSize) {
+    Task *first = results[0];
+
+    for (int i = 1; i < *numResults; i++) {
+        if (results[i]->priority > first->priority) {
+            first = results[i];
+        }
+    }
+
+#if DP_RELAY
+    // the folded results go first, the one they are part of after them
+    Task *folded = foldRelayResults(results, *numResults, first);
+    for (int i = 0; folded != NULL && i < *numResults - 1; i++) {
+        if (results[i] == folded) {
+            results[i] = results[i + 1];
+            results[i + 1] = folded;
+        }
+    }
+#endif
+
+    if (*numResults == 1) {
+        return DpBuildPacket(DP_PKT_TYPE_RESPONSE, results[0], buf, bufSize);
+    }
+
+    dpWireHeader_t header = { .type = DP_PKT_TYPE_RESPONSE_BATCH, .kernelId = first->kernelId, .jobId = first->jobId,
+                              .priority = first->priority };
+    eDpPktType_t type = header.type;
+    dpWireEntry_t entry;
+    uint16_t count = 0;
+    uint16_t len = DP_WIRE_MAX_RESPONSE_HEADER_SIZE;
+    uint32_t execUs = 0;
+
+    // find how many results fit before writing, the count goes in front of them
+    for (int i = 0; i < *numResults; i++) {
+        if (results[i]->jobId != header.jobId) {
+            continue;
+        }
+        entry.id = results[i]->taskId;
+        entry.len = encodedResultLength(results[i]);
+        entry.status = results[i]->status;
+        entry.folded = isFoldedResult(results[i]);
+        if (len + DpWireEntrySize(type, &entry) > bufSize) {
+            break;                                      // The rest goes out with the next response
+        }
+        len += DpWireEntrySize(type, &entry);
+        execUs += results[i]->execUs;
+        results[count++] = results[i];
+    }
+    while (count > 1 && isFoldedResult(results[count - 1])) {
+        execUs -= results[--count]->execUs;             // Folded results never go up without theirs
+    }
+
+    dpWireReport_t report = slaveReport(execUs);
+    len = DpWireEncodeHeader(buf, &header);
+    len += DpWireEncodeReport(buf + len, &report);
+    len += DpWirePutVarint(buf + len, count);
+    for (int i = 0; i < count; i++) {
+        entry.id = results[i]->taskId;
+        entry.len = encodedResultLength(results[i]);
+        entry.status = results[i]->status;
+        entry.folded = isFoldedResult(results[i]);
+        len += DpWireEncodeEntry(buf + len, type, &entry);
+        len += encodeResult(buf + len, results[i]);
+    }
+    *numResults = count;
+    am_util_debug_printf("Built response batch of %d results, %d bytes\n", count, len);
+    return len;
+}
+
+/**
+ * @brief Frees the slots of tasks whose results were handed to the AMDTP link
+ */
+void releaseSlaveTasks(Task **results, int numResults) {
+    taskENTER_CRITICAL();
+    for (int i = 0; i < numResults; i++) {
+        if (results[i]->status == DP_TASK_STATUS_COMPLETE) {
+            results[i]->status = DP_TASK_STATUS_UNKNOWN;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+#if DP_PUSH_COMPLETION
+/**
+ * @brief Sends the results of finished tasks to the master without waiting to be asked.
+ *        If the link stays busy the results are kept in their slots so an ENQUIRY can still collect them.
+ */
+void pushCompletedResults() {
+    Task *results[DP_MAX_TASKS_PER_CLIENT];
+    int numResults = findCompletedSlaveTasks(results);
+
+    if (numResults == 0) {
+        return;
+    }
+
+    for (int i = 0; i < DP_PUSH_RETRY_MS; i++) {
+        // the reservation keeps the radio task from answering an enquiry into the same buffer
+        uint8_t *buf = AmdtpsReserveTxBuf(masterConnId);
+        if (buf != NULL) {
+            uint16_t overallPacketLength = buildResultPacket(results, &numResults, buf, AMDTP_MAX_PAYLOAD_SIZE);
+            if (AmdtpsSendTxBuf(0, 1, overallPacketLength, masterConnId) == AMDTP_STATUS_SUCCESS) {
+                releaseSlaveTasks(results, numResults);     // Results handed over, free the slots
+            }
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    am_util_debug_printf("Could not push %d results, waiting for enquiry\n", numResults);
+}
+#endif
+
+/**
+ * @brief Worker of the slave. Sleeps until notified of new tasks, then executes queued tasks one after another
+ */
+void runExecuteTask(void *pvParameters) {
+    Task *task;
+
+    while (1) {
+        taskENTER_CRITICAL();
+        task = dequeueSlaveTask();
+        taskEXIT_CRITICAL();
+
+        if (task == NULL) {
+#if DP_TRACE
+            // the slave does not know when a job ends, a long idle spell is the closest it gets
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DP_TRACE_IDLE_MS)) == 0) {
+                DpTraceDump();
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+#else
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);    // Queue drained, wait for wakeWorker
+#endif
+            continue;
+        }
+
+        am_util_debug_printf("Running task %d\n", task->taskId);
+        recordTrace(DP_TRACE_TASK_START, task->jobId, task->taskId, 0);
+        uint32_t start = DP_TRACE_TIMESTAMP();
+        DpFindKernel(task->kernelId)->executeTask(task);       // Checked when the task was received
+        task->execUs = elapsedUs(start);
+        recordTrace(DP_TRACE_TASK_END, task->jobId, task->taskId, 0);
+#if DP_PUSH_COMPLETION
+        // send results in batches while more work of the same priority is queued, and straight away once
+        // the queue runs dry or only holds less urgent work
+        Task *results[DP_MAX_TASKS_PER_CLIENT];
+        taskENTER_CRITICAL();
+        bool lastOfPriority = numQueuedSlaveTasks == 0 || slaveTaskQueue[0]->priority < task->priority;
+        taskEXIT_CRITICAL();
+        if (lastOfPriority || findCompletedSlaveTasks(results) >= DP_MAX_TASKS_PER_BATCH) {
+            pushCompletedResults();
+        }
+#endif
+    }
+}
+#endif
+
+// helper function to dump buffer
+void print_buffer(uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        am_util_debug_printf("%02X ", buf[i]);
+        if ((i + 1) % 16 == 0) {
+            am_util_debug_printf("\n");
+        }
+    }
+    am_util_debug_printf("\n");
+}
+
+void print_status(eDpTaskStatus_t status) {
+    switch (status) {
+    case DP_TASK_STATUS_COMPLETE:
+        am_util_stdio_printf("COMPLETE\n");
+        break;
+    case DP_TASK_STATUS_IN_PROGRESS:
+        am_util_stdio_printf("IN PROGRESS\n");
+        break;
+    case DP_TASK_STATUS_INCOMPLETE:
+        am_util_stdio_printf("INCOMPLETE\n");
+        break;
+    case DP_TASK_STATUS_UNKNOWN:
+        am_util_stdio_printf("UNKNOWN\n");
+    default:
+        am_util_stdio_printf("???\n");
+        break;
+}
+}
+
+// --------------------------------------------------------------------------------------------
+
+#if DP_MASTER
+void initializeTasks(DpJob *job) {
+    // Call the application defined function to initialize the location to store data and result
+    am_util_debug_printf("Initializing distributed tasks...\n");
+    job->kernel->initClientTasks(&job->taskCount);
+
+    if (job->taskCount > MAX_TASKS) {
+        am_util_debug_printf("Too many tasks for dp to handle, this should not happen\n");
+        while(1); // Too many tasks, this should not happen
+    }
+
+    memset(job->taskStatus, 0, sizeof(job->taskStatus));
+    job->completedTaskCount = 0;
+    job->head = job->tail = 0;
+    job->numSpeculativeTasks = 0;
+    job->taskWork = 0;
+    job->execUs = 0;
+    job->execWork = 0;
+    job->tuningResults = 0;
+    job->sizeTuned = false;
+    for (int i = 0; i < job->taskCount; i++) {
+        setTaskStatus(job, i, DP_TASK_STATUS_INCOMPLETE);
+        // am_util_debug_printf("Task %d initialized\n", i);
+        if (!enqueueTask(job, i)) {
+            while(1); // Queue is full, this should not happen
+        }; // Add the incomplete task to the task queue
+    }
+    recordTrace(DP_TRACE_JOB_START, job->id, job->taskCount, 0);
+}
+#endif
+
+/**
+ * @brief Builds a distributed protocol packet
+ * 
+ * @param type The packet type
+ * @param task The task
+ * @param buf The buffer that the data is located in
+ * 
+ * @return The length of the packet
+ */
+uint16_t DpBuildPacket(uint8_t type, Task *task, uint8_t *buf, int bufSize) {
+    am_util_debug_printf("Building packet of type %d\n", type);
+
+    dpWireEntry_t entry = { .id = task->taskId, .len = 0, .status = task->status };
+    dpWireHeader_t header = { .type = type, .kernelId = task->kernelId, .jobId = task->jobId, .priority = task->priority };
+    uint16_t offset = DpWireEncodeHeader(buf, &header);
+    // Build the packet
+
+#if DP_MASTER
+    if (type == DP_PKT_TYPE_ENQUIRY) {
+        return offset + DpWireEncodeEntry(buf + offset, type, &entry);
+    } else if (type == DP_PKT_TYPE_NEW_TASK) {
+        DpJob *job = findJob(task->jobId);
+        dpCodecPick_t pick = pickTaskData(job, task->taskId);
+        entry.len = pick.size;
+        am_util_debug_printf("Task data length: %d, %d on the wire\n", task->dataLength, entry.len);
+        if (offset + DpWireEntrySize(type, &entry) > bufSize) {
+            am_util_stdio_printf("Task data length is too large for the buffer, this should not happen\n");
+            while(1); // Task data length is 0, this should not happen
+        } 
+
+        offset += DpWireEncodeEntry(buf + offset, type, &entry);
+        encodeTaskData(job, buf + offset, task->taskId, pick);
+        // am_util_debug_printf("packet dump:\n");
+        // print_buffer(buf + offset, entry.len);
+        return offset + entry.len;
+    }
+#endif
+
+#if DP_SLAVE
+    if (type == DP_PKT_TYPE_RESPONSE) {
+        am_util_debug_printf("Building response packet ");
+
+        dpWireReport_t report = slaveReport(task->status == DP_TASK_STATUS_COMPLETE ? task->execUs : 0);
+        offset += DpWireEncodeReport(buf + offset, &report);
+        if (task->status == DP_TASK_STATUS_COMPLETE) {
+            entry.len = encodedResultLength(task);
+            if (offset + DpWireEntrySize(type, &entry) > bufSize) {
+                am_util_stdio_printf("Task data length is too large for the buffer, this should not happen\n");
+                while(1); // Task data length is 0, this should not happen
+            } 
+            am_util_debug_printf("for completed task %d, \n", task->taskId);
+            // am_util_debug_printf("Pointer to task result: %x\n", task->result);
+            offset += DpWireEncodeEntry(buf + offset, type, &entry);
+            encodeResult(buf + offset, task);
+            return offset + entry.len;
+        } 
+        am_util_debug_printf("for unfinished task %d, \n", task->taskId);
+        return offset + DpWireEncodeEntry(buf + offset, type, &entry);
+    }
+#endif
+
+    // a relay builds the packets of both roles, anything else is a bug
+    am_util_debug_printf("Building unknown packet of type %d????\n", type);
+    while(1);
+    return 0;
+}
+
+#if DP_MASTER
+/**
+ * @brief Decodes a result into the memory the kernel keeps for it
+ *
+ * @return false if the result is malformed
+ */
+bool storeTaskResult(DpJob *job, int taskId, uint8_t *result, uint16_t resultLen, dmConnId_t connId, uint32_t execUs) {
+#if DP_RELAY
+    return storeRelayResult(job, taskId, result, resultLen, execUs);
+#else
+    const DpKernel *kernel = job->kernel;
+    uint16_t resultSize = (kernel->getResultSize != NULL) ? kernel->getResultSize(taskId) : kernel->resultSize;
+    uint16_t decodedLen;
+
+    if (connId == DP_LOCAL_CONN_ID) {
+        if (resultLen > resultSize) {
+            return false;
+        }
+        memcpy(kernel->getTaskResult(taskId), result, resultLen);
+        return true;
+    }
+    // am_util_debug_printf("Pointer to task result: %x\n", getTaskResult(taskId));
+    return DpCodecDecode(kernel->resultType, result, resultLen, kernel->getTaskResult(taskId), resultSize, &decodedLen);
+#endif
+}
+
+/**
+ * @brief Stores a result received from a client and hands the response to the distributed task
+ * 
+ * @param job The job of the task
+ * @param taskId The id of the task
+ * @param status The status of the task reported by the client
+ * @param result The result data as it came over the link, only valid during the receive callback.
+ *               The local lane hands over the result of its slot as it is.
+ * @param resultLen The length of the result data
+ * @param connId The connection ID of the slave device
+ * @param report What the client reported with the result, the time it took to execute this task alone
+ * @param folds The number of results a relay folded into this one, they came right before it.
+ *              DP_RESULT_FOLDED if this is one of them and carries no result of its own
+ */
+void receiveTaskResult(DpJob *job, int taskId, eDpTaskStatus_t status, uint8_t *result, uint16_t resultLen, dmConnId_t connId,
+                       const dpWireReport_t *report, uint8_t folds) {
+    // ids a kernel re-cut its tasks into may lie beyond the first cut, one the job never had reads UNKNOWN
+    if (taskId < 0 || taskId >= MAX_TASKS || getTaskStatus(job, taskId) == DP_TASK_STATUS_UNKNOWN) {
+        am_util_stdio_printf("Received response from client %d for unknown task %d\n", connId, taskId);
+        return;
+    }
+
+    am_util_stdio_printf("Received response from client %d for task %d of job %d, task status: ", connId, taskId, job->id);
+    print_status(status);
+
+    if (status == DP_TASK_STATUS_COMPLETE && folds != DP_RESULT_FOLDED && getTaskStatus(job, taskId) != DP_TASK_STATUS_COMPLETE
+        && !storeTaskResult(job, taskId, result, resultLen, connId, report->execUs)) {
+        am_util_stdio_printf("Result of task %d is malformed, requeueing it\n", taskId);
+        status = DP_TASK_STATUS_UNKNOWN;
+    }
+
+    if (status == DP_TASK_STATUS_COMPLETE) {
+        recordTrace(DP_TRACE_RESPONSE, job->id, taskId, connId);
+    }
+
+    // the scheduler state is only touched by the distributed task, hand the response over to it
+    DpEvent event = { .type = DP_EVENT_RESPONSE, .taskId = taskId, .status = status, .connId = connId,
+                      .generation = linkGeneration[connId - 1], .jobId = job->id, .report = *report, .folds = folds };
+    if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+        am_util_stdio_printf("Event queue is full, this should not happen\n");
+        while(1);
+    }
+}
+#endif
+
+#if DP_MASTER && DP_LOCAL_LANE
+/**
+ * @brief Hands tasks of a job to the local lane, the counterpart of sending them to a slave
+ * 
+ * @return false if the lane has no room for all of them
+ */
+bool queueLocalTasks(DpJob *job, uint16_t *batch, int numBatched) {
+    bool queued = true;
+
+    taskENTER_CRITICAL();
+    if ((localTail - localHead + DP_LOCAL_LANE_WINDOW + 1) % (DP_LOCAL_LANE_WINDOW + 1) + numBatched > DP_LOCAL_LANE_WINDOW) {
+        queued = false;
+    } else {
+        for (int i = 0; i < numBatched; i++) {
+            localTaskQueue[localTail] = (LocalLaneEntry) { .job = job, .jobId = job->id, .taskId = batch[i] };
+            localTail = (localTail + 1) % (DP_LOCAL_LANE_WINDOW + 1);
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if (queued) {
+        xTaskNotifyGive(localLaneTaskHandle);
+    }
+    return queued;
+}
+
+/**
+ * @brief Runs one task on the master. The kernel sees the same calls as on a slave,
+ *        the operands it does not hold yet and the task data come from its own master side.
+ */
+void executeLocalTask(DpJob *job, uint8_t jobId, const DpKernel *kernel, int taskId) {
+    Client *lane = &connectedClients[DP_LOCAL_CONN_ID - 1];
+    uint16_t operandIds[DP_MAX_OPERANDS_PER_TASK];
+    uint8_t numOperands = kernel->getTaskOperands(taskId, operandIds);
+
+    for (int k = 0; k < numOperands; k++) {
+        if (!isOperandCached(lane, job, operandIds[k])) {
+            uint16_t len = kernel->getOperandLength(operandIds[k]);
+            uint16_t room = len;
+            uint8_t *storage = operandStorage(kernel, operandIds[k], &room, localBuffer);
+            kernel->copyOperandToSendBuffer(storage, operandIds[k]);
+            kernel->storeOperand(operandIds[k], storage, len);
+            if (job->id == jobId) {
+                setOperandCached(lane, job, operandIds[k]);
+            }
+        }
+    }
+
+    kernel->initServerTask(&localTask, 0);
+    localTask.kernelId = kernel->id;
+    localTask.jobId = jobId;
+    localTask.priority = job->priority;
+    localTask.taskId = taskId;
+    localTask.dataLength = kernel->getTaskDataLength(taskId);
+    if (localTask.dataLength > 0) {
+        kernel->copyTaskDataToSendBuffer(localBuffer, taskId);
+        memcpy(localTask.data, localBuffer, localTask.dataLength);
+    }
+    localTask.status = DP_TASK_STATUS_IN_PROGRESS;
+
+    recordTrace(DP_TRACE_TASK_START, jobId, taskId, DP_LOCAL_CONN_ID);
+    uint32_t start = DP_TRACE_TIMESTAMP();
+    kernel->executeTask(&localTask);
+    localTask.execUs = elapsedUs(start);
+    recordTrace(DP_TRACE_TASK_END, jobId, taskId, DP_LOCAL_CONN_ID);
+
+    if (findJob(jobId) != job) {
+        return;                             // The job finished while this copy was running
+    }
+    if (localTask.status != DP_TASK_STATUS_COMPLETE) {
+        localTask.status = DP_TASK_STATUS_UNKNOWN;     // Goes back on the queue
+    }
+    dpWireReport_t report = { .execUs = localTask.execUs, .workers = 1, .linkUs = 0 };
+    receiveTaskResult(job, taskId, localTask.status, localTask.result, localTask.dataLength, DP_LOCAL_CONN_ID, &report, 0);
+}
+
+/**
+ * @brief Local lane of the master. Sleeps until tasks are queued, then executes them at a
+ *        lower priority than the radio and the distributed task, which keep the slaves fed.
+ */
+void runLocalLane(void *pvParameters) {
+    LocalLaneEntry entry;
+    const DpKernel *kernel;
+
+    while (1) {
+        bool queued = false;
+
+        taskENTER_CRITICAL();
+        if (localHead != localTail) {
+            entry = localTaskQueue[localHead];
+            localHead = (localHead + 1) % (DP_LOCAL_LANE_WINDOW + 1);
+            queued = true;
+        }
+        kernel = (queued && findJob(entry.jobId) == entry.job) ? entry.job->kernel : NULL;
+        taskEXIT_CRITICAL();
+
+        if (!queued) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);    // Wait for queueLocalTasks
+            continue;
+        }
+        if (kernel != NULL) {
+            executeLocalTask(entry.job, entry.jobId, kernel, entry.taskId);
+        }
+    }
+}
+#endif
+
+#if DP_SLAVE
+/**
+ * @brief Tells the worker that tasks were queued, a notification sent while it is busy is kept until it next waits
+ */
+void wakeWorker() {
+    xTaskNotifyGive(workerTaskHandle);
+}
+
+/**
+ * @brief Puts a task received from the master in a free slot and queues it for execution
+ * 
+ * @param kernel The kernel that executes the task
+ * @param header The header of the packet, with the job of the task
+ * @param taskId The id of the task
+ * @param data The task data as it came over the link, only valid during the receive callback
+ * @param dataLen The length of the task data
+ * @param connId The connection ID of the master device
+ * 
+ * @return true if the task was queued
+ */
+bool receiveTask(const DpKernel *kernel, const dpWireHeader_t *header, int taskId, uint8_t *data, uint16_t dataLen,
+                 dmConnId_t connId) {
+    if (findSlaveTask(header->jobId, taskId) != NULL) {
+        am_util_debug_printf("Received Task %d but it is already queued\n", taskId);
+        return false;
+    }
+
+    Task *task = findFreeSlaveTask();
+    if (task == NULL) {
+        // the master will get UNKNOWN when it enquires about this task and requeue it
+        am_util_debug_printf("Received Task %d but all %d task slots are in use\n", taskId, DP_MAX_TASKS_PER_CLIENT);
+        return false;
+    }
+
+    //receive the new task, the slot takes the data and result memory of its kernel
+    kernel->initServerTask(task, task - slaveTasks);
+    masterConnId = connId;
+    task->kernelId = kernel->id;
+    task->jobId = header->jobId;
+    task->priority = header->priority;
+    task->taskId = taskId;
+    task->execUs = 0;
+    am_util_debug_printf("length of task data: %d\n", dataLen);
+
+    // decoded straight into the slot, tasks that only use cached operands carry no data
+    if (!DpCodecDecode(kernel->taskDataType, data, dataLen, task->data, kernel->taskDataSize, &task->dataLength)) {
+        am_util_stdio_printf("Data of task %d is malformed\n", taskId);
+        return false;                               // The slot stays free, the master gets UNKNOWN and requeues the task
+    }
+    task->status = DP_TASK_STATUS_IN_PROGRESS;
+    // am_util_debug_printf("packet dump:\n");
+    // print_buffer(data, dataLen);
+
+#if DP_RELAY
+    if (!queueRelayTask(task)) {
+        task->status = DP_TASK_STATUS_UNKNOWN;      // The parent gets UNKNOWN when it enquires and requeues it
+        return false;
+    }
+#else
+    taskENTER_CRITICAL();
+    enqueueSlaveTask(task);                         // Cannot fail, the queue holds as many tasks as there are slots
+    taskEXIT_CRITICAL();
+#endif
+    return true;
+}
+#endif
+
+#if DP_SLAVE
+/**
+ * @brief Answers an ENQUIRY with every finished result, or with the status of the task
+ *        that was asked about when nothing is finished yet
+ * 
+ * @param header The header of the ENQUIRY, with the job of the task
+ * @param taskId The task the master asked about
+ * @param connId The connection ID of the master device
+ */
+void replyToEnquiry(const dpWireHeader_t *header, int taskId, dmConnId_t connId) {
+    am_util_debug_printf("Received enquiry for task %d\n", taskId);
+    Task *results[DP_MAX_TASKS_PER_CLIENT];
+    int numResults;
+    Task unknownTask;
+    uint8_t *buf = AmdtpsReserveTxBuf(connId);
+
+    if (buf == NULL) {
+        return;                                     // Link busy, the master asks again
+    }
+
+    numResults = findCompletedSlaveTasks(results);
+    if (numResults == 0) {
+        // nothing finished yet, report on the task that was asked about
+        results[0] = findSlaveTask(header->jobId, taskId);
+        numResults = 1;
+    }
+
+    if (results[0] == NULL) {
+        // not holding this task, tell the master so it can be requeued
+        unknownTask.taskId = taskId;
+        unknownTask.kernelId = header->kernelId;
+        unknownTask.jobId = header->jobId;
+        unknownTask.priority = header->priority;
+        unknownTask.status = DP_TASK_STATUS_UNKNOWN;
+        unknownTask.dataLength = 0;
+        unknownTask.execUs = 0;
+        results[0] = &unknownTask;
+    }
+
+    // build response packet using the finished tasks
+    uint16_t overallPacketLength = buildResultPacket(results, &numResults, buf, AMDTP_MAX_PAYLOAD_SIZE);
+    if (AmdtpsSendTxBuf(0, 1, overallPacketLength, connId) == AMDTP_STATUS_SUCCESS
+        && results[0] != &unknownTask) {
+        releaseSlaveTasks(results, numResults);     // Results handed over, free the slots
+    }
+}
+#endif
+
+#if DP_RELAY
+// --------------------------------------------------------------------------------------------
+// Relay: the tasks in the slave slots are the jobs of the master side, one for each job of the parent,
+// under the ids the parent gave them. The children get the tasks and operands as the parent sent them,
+// and their results go back up in batches.
+
+#define DP_RELAY_NO_POOL            0xFF
+
+#if DP_RELAY_OPERAND_POOL_SIZE > 0xFFFF
+#error "DP_RELAY_OPERAND_POOL_SIZE above 64KB, RelayOperandPool holds 16 bit offsets"
+#endif
+
+// operands of one job of the parent, their bytes are in relayOperandData next to those of the other jobs
+typedef struct {
+    uint8_t     jobId;                                              // Parent's job the operands belong to, DP_NO_JOB if unused
+    TickType_t  lastUse;                                            // A new job takes the pool used least recently
+    uint16_t    offset[DP_MAX_OPERANDS];                            // In relayOperandData, behind its RelayOperandHeader
+    uint16_t    length[DP_MAX_OPERANDS];                            // 0 if the operand was not received
+} RelayOperandPool;
+
+// precedes every operand in relayOperandData, compacting the data walks them
+typedef struct {
+    uint8_t     pool;                                               // Index of the pool it belongs to, DP_RELAY_NO_POOL once dropped
+    uint16_t    operandId;
+    uint16_t    length;
+} RelayOperandHeader;
+
+DpKernel relayKernels[DP_MAX_JOBS];                                 // Per job slot, the master side runs it instead of the kernel
+uint16_t relayResultLength[DP_MAX_TASKS_PER_CLIENT];                // Length of the result a child delivered, per slot
+uint32_t relayExecUs[DP_MAX_TASKS_PER_CLIENT];                      // Time the child reported for it, goes up with the result
+bool relayFolded[DP_MAX_TASKS_PER_CLIENT];                          // The result of the slot is part of another's, see foldRelayResults
+RelayOperandPool relayOperandPools[DP_MAX_JOBS];                    // Operands received from the parent, to pass on to the children
+uint8_t relayOperandData[DP_RELAY_OPERAND_POOL_SIZE];               // Shared by the pools, one job's operands leave room for the others'
+uint32_t relayOperandUsed = 0;
+
+_Static_assert(sizeof(relayKernels) + sizeof(relayResultLength) + sizeof(relayExecUs) + sizeof(relayFolded)
+               + sizeof(relayOperandPools) + sizeof(relayOperandData) <= DP_RELAY_RAM, "the relay state does not fit DP_RELAY_RAM");
+
+/**
+ * @brief Finds the slot of a relayed task that has not gone back to the parent yet
+ */
+Task *findRelayTask(DpJob *job, int taskId) {
+    Task *task = findSlaveTask(job->id, taskId);
+    return (task != NULL && task->status == DP_TASK_STATUS_IN_PROGRESS) ? task : NULL;
+}
+
+/**
+ * @brief Moves the operands still in use to the front of relayOperandData, dropping those of a pool
+ *        and the ones a longer copy replaced. Runs in the radio task, the distributed task copies
+ *        operands out in a critical section and never sees one half moved.
+ *
+ * @param dropPool Index of the pool whose operands go, DP_RELAY_NO_POOL to only drop replaced ones
+ */
+void compactRelayOperands(uint8_t dropPool) {
+    RelayOperandHeader header;
+    uint32_t used = 0;
+
+    taskENTER_CRITICAL();
+    for (uint32_t pos = 0; pos < relayOperandUsed; pos += sizeof(header) + header.length) {
+        memcpy(&header, relayOperandData + pos, sizeof(header));
+        if (header.pool == DP_RELAY_NO_POOL || header.pool == dropPool) {
+            continue;
+        }
+        memmove(relayOperandData + used, relayOperandData + pos, sizeof(header) + header.length);
+        relayOperandPools[header.pool].offset[header.operandId] = used + sizeof(header);
+        used += sizeof(header) + header.length;
+    }
+    relayOperandUsed = used;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Makes room for the operands of a job by dropping those of the job used least recently before it,
+ *        usually one that finished. Should it still run its tasks are refused, the parent sends them elsewhere.
+ */
+void dropRelayOperandPool(RelayOperandPool *keep) {
+    RelayOperandPool *oldest = NULL;
+
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        RelayOperandPool *pool = &relayOperandPools[i];
+        if (pool != keep && pool->jobId != DP_NO_JOB
+            && (oldest == NULL || (int32_t) (pool->lastUse - oldest->lastUse) < 0)) {
+            oldest = pool;
+        }
+    }
+    if (oldest != NULL) {
+        am_util_stdio_printf("Operand pool is full, dropping the operands of job %d\n", oldest->jobId);
+        compactRelayOperands(oldest - relayOperandPools);
+        memset(oldest->length, 0, sizeof(oldest->length));
+        oldest->jobId = DP_NO_JOB;
+    }
+}
+
+/**
+ * @brief Finds the operand pool of a job of the parent
+ *
+ * @param claim Hand the least recently used pool to the job if it has none
+ *
+ * @return The pool, NULL if the job has none and claim is false
+ */
+RelayOperandPool *findRelayOperandPool(uint8_t jobId, bool claim) {
+    RelayOperandPool *oldest = &relayOperandPools[0];
+
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        RelayOperandPool *pool = &relayOperandPools[i];
+        if (pool->jobId == jobId) {
+            return pool;
+        }
+        if (pool->jobId == DP_NO_JOB
+            || (oldest->jobId != DP_NO_JOB && (int32_t) (pool->lastUse - oldest->lastUse) < 0)) {
+            oldest = pool;
+        }
+    }
+
+    if (!claim) {
+        return NULL;
+    }
+    // operand ids are per job, the first operand of a new job starts an empty pool
+    compactRelayOperands(oldest - relayOperandPools);
+    memset(oldest->length, 0, sizeof(oldest->length));
+    oldest->jobId = jobId;
+    oldest->lastUse = xTaskGetTickCount();
+    return oldest;
+}
+
+/**
+ * @brief Keeps an operand from the parent in the pool of its job, the children get it from there
+ *        before the first task that reads it. Runs in the radio task.
+ */
+void storeRelayOperand(uint8_t jobId, uint16_t operandId, uint8_t *data, uint16_t len) {
+    RelayOperandPool *pool = findRelayOperandPool(jobId, true);
+
+    if (operandId >= DP_MAX_OPERANDS) {
+        am_util_stdio_printf("Operand %d is out of range, increase DP_MAX_OPERANDS\n", operandId);
+        return;
+    }
+
+    pool->lastUse = xTaskGetTickCount();
+    if (pool->length[operandId] != len) {
+        RelayOperandHeader header = { .pool = pool - relayOperandPools, .operandId = operandId, .length = len };
+
+        if (pool->length[operandId] != 0) {
+            // the copy of another length stays behind until the next compaction
+            relayOperandData[pool->offset[operandId] - sizeof(header)] = DP_RELAY_NO_POOL;
+            pool->length[operandId] = 0;
+        }
+        if (relayOperandUsed + sizeof(header) + len > DP_RELAY_OPERAND_POOL_SIZE) {
+            compactRelayOperands(DP_RELAY_NO_POOL);
+        }
+        if (relayOperandUsed + sizeof(header) + len > DP_RELAY_OPERAND_POOL_SIZE) {
+            dropRelayOperandPool(pool);
+        }
+        if (relayOperandUsed + sizeof(header) + len > DP_RELAY_OPERAND_POOL_SIZE) {
+            // the tasks that read it are refused, the parent sends them elsewhere
+            am_util_stdio_printf("Operand pool is full, increase DP_RELAY_OPERAND_POOL_SIZE\n");
+            return;
+        }
+        memcpy(relayOperandData + relayOperandUsed, &header, sizeof(header));
+        pool->offset[operandId] = relayOperandUsed + sizeof(header);
+        relayOperandUsed += sizeof(header) + len;
+    }
+    memcpy(relayOperandData + pool->offset[operandId], data, len);
+    pool->length[operandId] = len;
+}
+
+/**
+ * @brief Hands a task received from the parent to the distributed task. Runs in the radio task.
+ * 
+ * @return false if the relay cannot pass it on, an operand it reads is missing or the event queue is full
+ */
+bool queueRelayTask(Task *task) {
+    const DpKernel *kernel = DpFindKernel(task->kernelId);
+    relayFolded[task - slaveTasks] = false;
+    RelayOperandPool *pool = findRelayOperandPool(task->jobId, false);
+    uint16_t operandIds[DP_MAX_OPERANDS_PER_TASK];
+    uint8_t numOperands = kernel->getTaskOperands(task->taskId, operandIds);
+
+    for (int i = 0; i < numOperands; i++) {
+        if (pool == NULL || operandIds[i] >= DP_MAX_OPERANDS || pool->length[operandIds[i]] == 0) {
+            am_util_stdio_printf("Refusing task %d, operand %d is missing\n", task->taskId, operandIds[i]);
+            return false;
+        }
+    }
+    if (pool != NULL) {
+        pool->lastUse = xTaskGetTickCount();
+    }
+
+    DpEvent event = { .type = DP_EVENT_RELAY_TASK, .taskId = task->taskId, .status = DP_TASK_STATUS_INCOMPLETE,
+                      .connId = 0, .generation = 0, .jobId = task->jobId, .kernelId = task->kernelId,
+                      .priority = task->priority };
+    return xQueueSend(eventQueue, &event, 0) == pdTRUE;
+}
+
+/**
+ * @brief Decodes the result a child delivered into the slot of its task, it stays there until it goes up
+ *        to the parent. Runs in the radio task.
+ *
+ * @return false if the result is malformed
+ */
+bool storeRelayResult(DpJob *job, int taskId, uint8_t *result, uint16_t resultLen, uint32_t execUs) {
+    Task *task = findRelayTask(job, taskId);
+
+    if (task == NULL) {
+        return true;                        // Another child delivered it and it went up already
+    }
+    relayExecUs[task - slaveTasks] = execUs;
+    return DpCodecDecode(job->kernel->resultType, result, resultLen, task->result, job->kernel->resultSize,
+                         &relayResultLength[task - slaveTasks]);
+}
+
+uint16_t relayGetTaskDataLength(int taskId) {
+    Task *task = findRelayTask(relayJob, taskId);
+    return task != NULL ? task->dataLength : 0;
+}
+
+void relayCopyTaskDataToSendBuffer(uint8_t *startOfData, int taskId) {
+    Task *task = findRelayTask(relayJob, taskId);
+    if (task != NULL && task->dataLength > 0) {
+        memcpy(startOfData, task->data, task->dataLength);
+    }
+}
+
+void *relayGetTaskResult(int taskId) {
+    Task *task = findRelayTask(relayJob, taskId);
+    return task != NULL ? task->result : NULL;
+}
+
+uint8_t relayGetTaskOperands(int taskId, uint16_t *operandIds) {
+    return DpFindKernel(relayJob->kernel->id)->getTaskOperands(taskId, operandIds);
+}
+
+uint16_t relayGetOperandLength(uint16_t operandId) {
+    RelayOperandPool *pool = findRelayOperandPool(relayJob->id, false);
+    return pool != NULL ? pool->length[operandId] : 0;
+}
+
+void relayCopyOperandToSendBuffer(uint8_t *buffer, uint16_t operandId) {
+    RelayOperandPool *pool = findRelayOperandPool(relayJob->id, false);
+    if (pool != NULL) {
+        taskENTER_CRITICAL();               // compactRelayOperands may move it
+        memcpy(buffer, relayOperandData + pool->offset[operandId], pool->length[operandId]);
+        taskEXIT_CRITICAL();
+    }
+}
+
+/**
+ * @brief Marks the slot of a task complete once a child delivered it, the reply task sends it up.
+ *        A task a child relay folded into another result completes with that result, the scheduler
+ *        hands it over first, so the reply task never sends one without the other.
+ */
+void relayTaskComplete(int taskId, void *result) {
+    Task *task = findRelayTask(relayJob, taskId);
+
+    if (task == NULL) {
+        return;
+    }
+    if (result == NULL) {
+        relayFolded[task - slaveTasks] = true;
+        return;
+    }
+    taskENTER_CRITICAL();
+    for (int i = 0; i < DP_MAX_TASKS_PER_CLIENT; i++) {
+        if (relayFolded[i] && slaveTasks[i].status == DP_TASK_STATUS_IN_PROGRESS) {
+            slaveTasks[i].dataLength = 0;
+            slaveTasks[i].execUs = 0;
+            slaveTasks[i].status = DP_TASK_STATUS_COMPLETE;
+        }
+    }
+    task->dataLength = relayResultLength[task - slaveTasks];
+    task->execUs = relayExecUs[task - slaveTasks];
+    task->status = DP_TASK_STATUS_COMPLETE;
+    taskEXIT_CRITICAL();
+    wakeWorker();
+}
+
+bool isFoldedRelayResult(Task *task) {
+    return relayFolded[task - slaveTasks];
+}
+
+/**
+ * @brief Folds the finished results of a job into one with the combineResults hook of its kernel,
+ *        so the parent gets a single result for what the children delivered instead of one per task.
+ *        The slots stay marked, a response that could not go out sends the same results again.
+ *
+ * @param results The finished tasks
+ * @param first The one whose job the response carries
+ *
+ * @return The task holding the folded result, NULL if the kernel folds nothing
+ */
+Task *foldRelayResults(Task **results, int numResults, Task *first) {
+    const DpKernel *kernel = DpFindKernel(first->kernelId);
+    Task *lead = NULL;
+
+    if (kernel == NULL || kernel->combineResults == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < numResults; i++) {
+        Task *task = results[i];
+        if (task->jobId != first->jobId || task->status != DP_TASK_STATUS_COMPLETE || relayFolded[task - slaveTasks]) {
+            continue;
+        }
+        if (lead == NULL) {
+            lead = task;
+            continue;
+        }
+        kernel->combineResults(lead->result, task->result);
+        relayFolded[task - slaveTasks] = true;
+        task->dataLength = 0;
+    }
+    return lead;
+}
+
+/**
+ * @brief Works out what the relay tells its parent with every response: how many slaves compute the tasks
+ *        it passes on, and how long a packet takes down to the slowest of them, through relays below it too
+ */
+void updateRelayReport() {
+    uint32_t workers = 0;
+    uint32_t linkUs = 0;
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0) {
+            continue;
+        }
+        workers += client->workers;
+        if (clientLinkUs(client) + client->downstreamUs > linkUs) {
+            linkUs = clientLinkUs(client) + client->downstreamUs;
+        }
+    }
+    relayWorkers = workers > 0 ? workers : 1;
+    relayLinkUs = linkUs;
+}
+
+// the hooks of every relayed job, startRelayJob fills in the kernel of the tasks the parent sends
+const DpKernel relayHooks = {
+    .id = DP_NO_KERNEL,
+    .name = "Relay",
+    .getTaskDataLength = relayGetTaskDataLength,
+    .copyTaskDataToSendBuffer = relayCopyTaskDataToSendBuffer,
+    .getTaskResult = relayGetTaskResult,
+    .getTaskOperands = relayGetTaskOperands,
+    .getOperandLength = relayGetOperandLength,
+    .copyOperandToSendBuffer = relayCopyOperandToSendBuffer,
+    .onTaskComplete = relayTaskComplete,
+};
+
+/**
+ * @brief Takes on a job of the parent in a free job slot, or in the one of the job the parent sent
+ *        nothing for the longest. The parent only runs DP_MAX_JOBS jobs at once, so that one is over.
+ */
+DpJob *startRelayJob(DpEvent *event) {
+    DpJob *job = &jobs[0];
+
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        if (!jobs[i].running) {
+            job = &jobs[i];
+            break;
+        }
+        if ((int32_t) (jobs[i].activeTime - job->activeTime) < 0) {
+            job = &jobs[i];
+        }
+    }
+
+    if (job->running) {
+        // whatever is left of the old job is of no use to the parent any more
+        for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+            Client *client = &connectedClients[i];
+            for (int j = client->numAssignedTasks - 1; j >= 0; j--) {
+                if (client->assignedJobs[j] == jobSlot(job)) {
+                    removeClientEntry(client, j);
+                }
+            }
+        }
+        taskENTER_CRITICAL();
+        for (int i = 0; i < DP_MAX_TASKS_PER_CLIENT; i++) {
+            if (slaveTasks[i].status != DP_TASK_STATUS_UNKNOWN && slaveTasks[i].jobId == job->id) {
+                slaveTasks[i].status = DP_TASK_STATUS_UNKNOWN;
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    const DpKernel *relayedKernel = DpFindKernel(event->kernelId);     // Checked when the task was received
+    DpKernel *kernel = &relayKernels[jobSlot(job)];
+    *kernel = relayHooks;
+    kernel->id = event->kernelId;
+    kernel->taskDataType = relayedKernel->taskDataType;    // Decoded on the way in, encoded again for the children
+    kernel->operandType = relayedKernel->operandType;
+    kernel->resultType = relayedKernel->resultType;
+    kernel->taskDataSize = relayedKernel->taskDataSize;    // The tasks wait in the slots of the relayed kernel
+    kernel->resultSize = relayedKernel->resultSize;
+    am_util_stdio_printf("Relaying job %d, %s\n", event->jobId, relayedKernel->name);
+
+    job->kernel = kernel;
+    job->id = event->jobId;
+    job->priority = event->priority;
+    job->sequence = jobSequence++;
+    job->taskCount = MAX_TASKS;             // Task ids are the parent's
+    memset(job->taskStatus, 0, sizeof(job->taskStatus));
+    job->completedTaskCount = 0;
+    job->head = job->tail = 0;
+    job->numSpeculativeTasks = 0;
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        memset(connectedClients[i].cachedOperands[jobSlot(job)], 0, sizeof(connectedClients[i].cachedOperands[0]));
+    }
+    job->running = true;
+    recordTrace(DP_TRACE_JOB_START, job->id, 0, 0);
+    return job;
+}
+
+/**
+ * @brief Queues a task the parent sent for the children, in the distributed task
+ */
+void handleRelayTask(DpEvent *event) {
+    DpJob *job = findJob(event->jobId);
+
+    if (job == NULL) {
+        job = startRelayJob(event);
+    }
+    job->activeTime = xTaskGetTickCount();
+
+    eDpTaskStatus_t status = getTaskStatus(job, event->taskId);
+    if (status == DP_TASK_STATUS_INCOMPLETE || status == DP_TASK_STATUS_IN_PROGRESS) {
+        return;                             // Still queued or with a child
+    }
+    // a task that completed before came back, the parent lost its result
+    setTaskStatus(job, event->taskId, DP_TASK_STATUS_INCOMPLETE);
+    enqueueTask(job, event->taskId);
+}
+
+/**
+ * @brief Worker of the relay. Sends the results the children delivered up to the parent as they come,
+ *        a child's results already arrive as a batch and more pile up while the link to the parent is busy.
+ *        Holding them back for the other children would make the parent see the relay as slow.
+ */
+void runRelayReplies(void *pvParameters) {
+    while (1) {
+#if DP_TRACE
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DP_TRACE_IDLE_MS)) == 0) {
+            DpTraceDump();
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+#else
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);        // Woken by relayTaskComplete
+#endif
+
+#if DP_PUSH_COMPLETION
+        Task *results[DP_MAX_TASKS_PER_CLIENT];
+        int numResults;
+        while ((numResults = findCompletedSlaveTasks(results)) > 0) {
+            pushCompletedResults();
+            if (findCompletedSlaveTasks(results) >= numResults) {
+                break;                      // Link stayed busy, left for an ENQUIRY
+            }
+        }
+#endif
+    }
+}
+#endif
+
+/**
+ * @brief Callback function for receiving distributed protocol packets
+ * 
+ * @param buf The buffer containing the packet, usually from the transport layer protocol
+ * @param len The len of the packet
+ * @param connId The connection ID of the slave device
+ */
+void DpRecvCb(uint8_t *buf, uint16_t len, dmConnId_t connId) {
+    dpWireHeader_t header;
+    dpWireEntry_t entry;
+    dpWireReport_t report;
+    uint32_t count = 1;
+    uint16_t offset = DpWireDecodeHeader(buf, len, &header);
+    eDpPktType_t type = header.type;
+
+    if (offset == 0) {
+        // from another protocol version, or not a distributed protocol packet at all
+        am_util_stdio_printf("Dropping packet with unknown version or type, len: %d\n", len);
+        return;
+    }
+
+    // responses come from the slaves, everything else from the master, a relay gets both
+    bool isResponse = (type == DP_PKT_TYPE_RESPONSE || type == DP_PKT_TYPE_RESPONSE_BATCH);
+    const DpKernel *kernel = NULL;
+
+#if DP_MASTER
+    DpJob *job = NULL;
+    uint8_t folds = 0;                      // Results a relay folded into the next one with data
+    if (isResponse) {
+        job = findJob(header.jobId);
+        if (job == NULL || job->kernel->id != header.kernelId) {
+            am_util_debug_printf("Dropping packet for job %d, not a running job\n", header.jobId);
+            return;
+        }
+        kernel = job->kernel;
+    }
+#endif
+
+#if DP_SLAVE
+    if (!isResponse) {
+        kernel = DpFindKernel(header.kernelId);
+        if (kernel == NULL) {
+            // the tasks time out on the master and go to another client
+            am_util_stdio_printf("Dropping packet for kernel %d, not registered on this slave\n", header.kernelId);
+            return;
+        }
+    }
+#endif
+
+    if (kernel == NULL) {
+        am_util_stdio_printf("Dropping packet of type %d, not meant for this node\n", type);
+        return;
+    }
+
+    if (isResponse) {
+        uint16_t size = DpWireDecodeReport(buf + offset, len - offset, &report);
+        if (size == 0) {
+            am_util_stdio_printf("Dropping response without a report, len: %d\n", len);
+            return;
+        }
+        offset += size;
+    }
+
+    if (DpWireIsBatch(type)) {
+        uint8_t size = DpWireGetVarint(buf + offset, len - offset, &count);
+        if (size == 0) {
+            am_util_stdio_printf("Dropping batch packet without a count, len: %d\n", len);
+            return;
+        }
+        offset += size;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t size = DpWireDecodeEntry(buf + offset, len - offset, type, &entry);
+        if (size == 0) {
+            am_util_stdio_printf("Entry %d of packet type %d is cut off, dropping the rest\n", i, type);
+            break;
+        }
+        uint8_t *data = buf + offset + size;
+        offset += size + entry.len;
+
+#if DP_MASTER
+        if (isResponse) { //should only have this for master device
+            // the results of a batch share the time the client reported for all of them
+            dpWireReport_t taskReport = report;
+            taskReport.execUs = report.execUs / count;
+            receiveTaskResult(job, entry.id, entry.status, data, entry.len, connId, &taskReport,
+                              entry.folded ? DP_RESULT_FOLDED : folds);
+            folds = entry.folded ? folds + 1 : 0;
+        }
+#endif
+
+#if DP_SLAVE
+        if (type == DP_PKT_TYPE_ENQUIRY) {
+            replyToEnquiry(&header, entry.id, connId);
+        } else if (type == DP_PKT_TYPE_NEW_TASK || type == DP_PKT_TYPE_NEW_TASK_BATCH) {
+            am_util_debug_printf("Received new task for task %d\n", entry.id);
+            // am_util_debug_printf("packet dump:\n");
+            // print_buffer(data, entry.len);
+            receiveTask(kernel, &header, entry.id, data, entry.len, connId);
+        } else if (type == DP_PKT_TYPE_OPERAND) {
+#if DP_RELAY
+            uint16_t room = DP_MAX_DECODED_SIZE;
+            uint8_t *storage = operandBuffer;                               // Kept in the pool to pass on to the children
+#else
+            uint16_t room = 0;
+            uint8_t *storage = operandStorage(kernel, entry.id, &room, operandBuffer);
+#endif
+            uint16_t operandLen;
+            if (!DpCodecDecode(kernel->operandType, data, entry.len, storage, room, &operandLen)) {
+                am_util_stdio_printf("Operand %d is malformed, the tasks that read it are refused\n", entry.id);
+                continue;
+            }
+#if DP_RELAY
+            storeRelayOperand(header.jobId, entry.id, storage, operandLen);
+#else
+            kernel->storeOperand(entry.id, storage, operandLen);            // Application keeps its own copy, or took it in place
+#endif
+        }
+#endif
+    }
+
+#if DP_SLAVE
+    if (type == DP_PKT_TYPE_NEW_TASK || type == DP_PKT_TYPE_NEW_TASK_BATCH) {
+        wakeWorker();
+    }
+#endif
+}
+
+#if DP_MASTER
+/**
+ * @brief Callback for the AMDTP transmit result, the link to the client can take the next packet
+ * 
+ * @param status The AMDTP status of the transfer
+ * @param connId The connection ID of the slave device
+ */
+void DpTransCb(eAmdtpStatus_t status, dmConnId_t connId) {
+    DpEvent event = { .type = DP_EVENT_TX_DONE, .taskId = 0, .status = DP_TASK_STATUS_UNKNOWN, .connId = connId,
+                      .generation = linkGeneration[connId - 1] };
+
+    recordTrace(DP_TRACE_TX_DONE, DP_NO_JOB, 0, connId);
+
+    txAcked[connId - 1] = true;
+    // only wakes the distributed task, if the queue is full it is awake anyway and picks the flag up
+    xQueueSend(eventQueue, &event, 0);
+}
+
+/**
+ * @brief Reserves the AMDTP transmit buffer of a client so the next packet can be built in place, never blocks
+ * 
+ * @return Room for AMDTP_MAX_PAYLOAD_SIZE bytes, NULL if the link is busy
+ */
+uint8_t *reserveClientTxBuf(Client *client) {
+    uint8_t *buf = AmdtpcReserveTxBuf(client->connId);
+
+    // busy without a packet of ours pending, e.g. not ready for notifications yet, so no acknowledgement
+    // will come: tried again DP_TX_RETRY_MS later
+    client->txRetry = (buf == NULL);
+    return buf;
+}
+
+/**
+ * @brief Hands the packet built in the reserved transmit buffer to the AMDTP link of a client
+ * 
+ * @return true if the link accepted the packet
+ */
+bool sendClientTxBuf(Client *client, uint16_t len) {
+    if (AmdtpcSendTxBuf(0, 1, len, client->connId) != AMDTP_STATUS_SUCCESS) {
+        client->txRetry = true;             // Nothing went out, no acknowledgement will come
+        return false;
+    }
+
+    client->txBusy = true;                  // Busy until DpTransCb reports the acknowledgement
+    client->lastHeardTime = xTaskGetTickCount();
+    client->sentTime = client->lastHeardTime;
+    return true;
+}
+
+/**
+ * @brief Size of a task in a NEW_TASK_BATCH packet, including its data
+ *
+ * @param pick The encoding of its data, from pickTaskData
+ */
+uint16_t taskEntrySize(int taskId, dpCodecPick_t pick) {
+    dpWireEntry_t entry = { .id = taskId, .len = pick.size, .status = DP_TASK_STATUS_UNKNOWN };
+    return DpWireEntrySize(DP_PKT_TYPE_NEW_TASK_BATCH, &entry);
+}
+
+/**
+ * @brief Picks as many queued tasks of a job as fit into one packet for a client
+ * 
+ * @param client The client the packet is for
+ * @param job The job
+ * @param batch Filled with the tasks that were picked
+ * @param picks Filled with the encoding of the data of each, buildTaskBatch writes them that way
+ * @param numConsumed Set to the number of queue entries used, including completed tasks that were skipped
+ * 
+ * @return The number of tasks picked
+ */
+int selectQueuedTasks(Client *client, DpJob *job, uint16_t *batch, dpCodecPick_t *picks, int *numConsumed) {
+    int queueLength = (job->tail - job->head + MAX_TASKS) % MAX_TASKS;
+    int maxBatch = jobWindow(client, job) - client->numAssignedTasks;
+    uint16_t size = DP_WIRE_MAX_BATCH_HEADER_SIZE;
+    int numBatched = 0;
+    int pos;
+
+    if (maxBatch > DP_MAX_TASKS_PER_BATCH) {
+        maxBatch = DP_MAX_TASKS_PER_BATCH;
+    }
+
+    // a short queue, a small job, the end of a large one or a relay's, goes out in even shares so every client has work
+    int numClients = 0;
+    int outstanding = queueLength;
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        if (connectedClients[i].connId != 0) {
+            numClients++;
+            outstanding += countClientJobTasks(&connectedClients[i], job);
+        }
+    }
+    int share = (outstanding + numClients - 1) / numClients - countClientJobTasks(client, job);
+    if (maxBatch > share) {
+        maxBatch = share > 0 ? share : 1;
+    }
+
+    for (pos = 0; pos < queueLength && numBatched < maxBatch; pos++) {
+        int taskId = job->taskQueue[(job->head + pos) % MAX_TASKS];
+        if (getTaskStatus(job, taskId) == DP_TASK_STATUS_COMPLETE) {
+            continue;                                   // Completed by another client in the meantime
+        }
+        picks[numBatched] = pickTaskData(job, taskId);
+        uint16_t entrySize = taskEntrySize(taskId, picks[numBatched]);
+        if (size + entrySize > AMDTP_MAX_PAYLOAD_SIZE) {
+            break;                                      // Packet is full, the rest goes in the next one
+        }
+        size += entrySize;
+        batch[numBatched++] = taskId;
+    }
+    *numConsumed = pos;
+
+    if (numBatched == 0 && pos < queueLength) {
+        am_util_stdio_printf("Task %d does not fit in a packet, this should not happen\n", job->taskQueue[(job->head + pos) % MAX_TASKS]);
+        while(1);
+    }
+    return numBatched;
+}
+
+/**
+ * @brief Picks speculative tasks of a job for a client that is not working on them yet
+ * 
+ * @return The number of tasks picked
+ */
+int selectSpeculativeTasks(Client *client, DpJob *job, uint16_t *batch, dpCodecPick_t *picks) {
+    int maxBatch = jobWindow(client, job) - client->numAssignedTasks;
+    uint16_t size = DP_WIRE_MAX_BATCH_HEADER_SIZE;
+    int numBatched = 0;
+
+    for (int i = 0; i < job->numSpeculativeTasks && numBatched < maxBatch; i++) {
+        int taskId = job->speculativeTasks[i];
+        if (getTaskStatus(job, taskId) != DP_TASK_STATUS_IN_PROGRESS || clientHoldsTask(client, job, taskId)) {
+            continue;
+        }
+        picks[numBatched] = pickTaskData(job, taskId);
+        uint16_t entrySize = taskEntrySize(taskId, picks[numBatched]);
+        if (size + entrySize > AMDTP_MAX_PAYLOAD_SIZE) {
+            break;
+        }
+        size += entrySize;
+        batch[numBatched++] = taskId;
+    }
+    return numBatched;
+}
+
+/**
+ * @brief Builds the packet for a batch of tasks of a job. A single task is sent as a plain
+ *        NEW_TASK packet, several go into a NEW_TASK_BATCH packet.
+ * 
+ * @param picks The encoding of the data of each task, the data is encoded once, straight into the packet
+ * @param buf The buffer to build the packet in, room for AMDTP_MAX_PAYLOAD_SIZE bytes
+ * 
+ * @return The length of the packet
+ */
+uint16_t buildTaskBatch(DpJob *job, uint16_t *batch, const dpCodecPick_t *picks, int numBatched, uint8_t *buf) {
+    dpWireHeader_t header = jobHeader(job, numBatched == 1 ? DP_PKT_TYPE_NEW_TASK : DP_PKT_TYPE_NEW_TASK_BATCH);
+    uint16_t offset = DpWireEncodeHeader(buf, &header);
+
+    if (numBatched > 1) {
+        offset += DpWirePutVarint(buf + offset, numBatched);
+    }
+    for (int i = 0; i < numBatched; i++) {
+        dpWireEntry_t entry = { .id = batch[i], .len = picks[i].size, .status = DP_TASK_STATUS_UNKNOWN };
+        offset += DpWireEncodeEntry(buf + offset, header.type, &entry);
+        offset += encodeTaskData(job, buf + offset, batch[i], picks[i]);
+    }
+    return offset;
+}
+
+/**
+ * @brief Adds the operands of a task that the client does not hold yet to an OPERAND packet being put together
+ *
+ * @param picks The encoding of each of operandIds, buildOperandPacket writes them that way
+ * @param size The packet size so far, grows by every operand added
+ * @param maxSize The size the packet may grow to, at most AMDTP_MAX_PAYLOAD_SIZE
+ *
+ * @return false if an operand did not fit, in maxSize or in operandIds, the rest goes in the next operand packet
+ */
+bool packTaskOperands(Client *client, DpJob *job, int taskId, uint16_t *operandIds, dpCodecPick_t *picks, int *numOperands,
+                      uint16_t *size, uint16_t maxSize) {
+    eDpPktType_t type = jobHeader(job, DP_PKT_TYPE_OPERAND).type;
+    uint16_t taskOperands[DP_MAX_OPERANDS_PER_TASK];
+    uint8_t n = job->kernel->getTaskOperands(taskId, taskOperands);
+
+    for (int k = 0; k < n; k++) {
+        uint16_t operandId = taskOperands[k];
+        bool packed = false;
+
+        if (operandId >= DP_MAX_OPERANDS) {
+            am_util_stdio_printf("Operand id %d is out of range, increase DP_MAX_OPERANDS\n", operandId);
+            while(1);
+        }
+        for (int m = 0; m < *numOperands; m++) {
+            packed |= (operandIds[m] == operandId);
+        }
+        if (packed || isOperandCached(client, job, operandId)) {
+            continue;
+        }
+
+        if (*numOperands == DP_MAX_OPERANDS_PER_PACKET) {
+            return false;
+        }
+        picks[*numOperands] = pickOperand(job, operandId);
+        dpWireEntry_t entry = { .id = operandId, .len = picks[*numOperands].size, .status = DP_TASK_STATUS_UNKNOWN };
+        if (*size + DpWireEntrySize(type, &entry) > maxSize) {
+            return false;
+        }
+        *size += DpWireEntrySize(type, &entry);
+        operandIds[(*numOperands)++] = operandId;
+    }
+    return true;
+}
+
+/**
+ * @brief Builds an OPERAND packet with the operands of a batch that the client does not hold yet.
+ *        Room left in the packet goes to the operands of the queued tasks the client is likely to get
+ *        next, DP_OPERAND_PREFETCH turns of all clients ahead, so its next batch does not wait a round trip for them.
+ * 
+ * @param client The client the batch is for
+ * @param job The job of the batch
+ * @param batch The tasks about to be sent
+ * @param numBatched The number of tasks in the batch
+ * @param operandIds Filled with the operands that were packed, room for DP_MAX_OPERANDS_PER_PACKET
+ * @param picks Room for the encoding of each of them, picked once while packing
+ * @param numOperands Set to the number of operands packed
+ * @param buf The buffer to build the packet in, room for AMDTP_MAX_PAYLOAD_SIZE bytes
+ * 
+ * @return The length of the packet, 0 if the client already holds everything
+ */
+uint16_t buildOperandPacket(Client *client, DpJob *job, uint16_t *batch, int numBatched, uint16_t *operandIds,
+                            dpCodecPick_t *picks, int *numOperands, uint8_t *buf) {
+    dpWireHeader_t header = jobHeader(job, DP_PKT_TYPE_OPERAND);
+    eDpPktType_t type = header.type;
+    uint16_t size = DP_WIRE_MAX_BATCH_HEADER_SIZE;
+    bool packetFull = false;
+
+    *numOperands = 0;
+    for (int i = 0; i < numBatched && !packetFull; i++) {
+        packetFull = !packTaskOperands(client, job, batch[i], operandIds, picks, numOperands, &size, AMDTP_MAX_PAYLOAD_SIZE);
+    }
+
+    if (*numOperands == 0) {
+        if (packetFull) {
+            am_util_stdio_printf("Operand does not fit in a packet, this should not happen\n");
+            while(1);
+        }
+        return 0;
+    }
+
+    // the batch may still be at the head of the queue, its operands are packed already and add nothing.
+    // Prefetching at most doubles the packet, operands the client never uses must not cost more than its own
+    uint16_t maxSize = (2 * size < AMDTP_MAX_PAYLOAD_SIZE) ? 2 * size : AMDTP_MAX_PAYLOAD_SIZE;
+    int queueLength = (job->tail - job->head + MAX_TASKS) % MAX_TASKS;
+    int lookahead = numBatched;
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        if (connectedClients[i].connId != 0 && !isLocalLane(&connectedClients[i])) {
+            lookahead += DP_OPERAND_PREFETCH * DP_MAX_TASKS_PER_BATCH;
+        }
+    }
+    for (int pos = 0; pos < queueLength && pos < lookahead && !packetFull; pos++) {
+        packetFull = !packTaskOperands(client, job, job->taskQueue[(job->head + pos) % MAX_TASKS], operandIds, picks,
+                                      numOperands, &size, maxSize);
+    }
+
+    uint16_t offset = DpWireEncodeHeader(buf, &header);
+    offset += DpWirePutVarint(buf + offset, *numOperands);
+    for (int i = 0; i < *numOperands; i++) {
+        dpWireEntry_t entry = { .id = operandIds[i], .len = picks[i].size, .status = DP_TASK_STATUS_UNKNOWN };
+        offset += DpWireEncodeEntry(buf + offset, type, &entry);
+        offset += encodeOperand(job, buf + offset, operandIds[i], picks[i]);
+    }
+    return offset;
+}
+
+/**
+ * @brief Records that a client holds the tasks of a batch that went out to it
+ */
+void assignBatch(Client *client, DpJob *job, uint16_t *batch, int numBatched) {
+    TickType_t now = xTaskGetTickCount();
+
+    for (int j = 0; j < numBatched; j++) {
+        setTaskStatus(job, batch[j], DP_TASK_STATUS_IN_PROGRESS);
+        client->assignedTime[client->numAssignedTasks] = now;
+        client->assignedJobs[client->numAssignedTasks] = jobSlot(job);
+        client->assignedTasks[client->numAssignedTasks++] = batch[j];
+        recordTrace(DP_TRACE_DISPATCH, job->id, batch[j], client->connId);
+    }
+#if DP_PUSH_COMPLETION
+    client->nextPollTime = now + pdMS_TO_TICKS(DP_POLL_INTERVAL_MS);
+#endif
+}
+
+/**
+ * @brief Sends the operands of a batch that the client does not hold yet
+ *
+ * @param buf The client's reserved transmit buffer
+ *
+ * @return The number of operands sent, 0 if the client holds them all, -1 if the link refused the packet
+ */
+int sendMissingOperands(Client *client, DpJob *job, uint16_t *batch, int numBatched, uint8_t *buf) {
+    uint16_t operandIds[DP_MAX_OPERANDS_PER_PACKET];
+    dpCodecPick_t picks[DP_MAX_OPERANDS_PER_PACKET];
+    int numOperands;
+
+    uint16_t operandPacketLength = buildOperandPacket(client, job, batch, numBatched, operandIds, picks, &numOperands, buf);
+    if (operandPacketLength == 0) {
+        return 0;
+    }
+
+    am_util_stdio_printf("Sending %d operands to client %d\n", numOperands, client->connId);
+    if (!sendClientTxBuf(client, operandPacketLength)) {
+        return -1;
+    }
+    for (int j = 0; j < numOperands; j++) {
+        setOperandCached(client, job, operandIds[j]);
+    }
+    return numOperands;
+}
+
+/**
+ * @brief Sends a batch to a client, preceded by the operands it does not hold yet.
+ *        Tasks for the local lane are queued on the master instead.
+ *        When the operands take the link the batch is assigned to the client all the same, as its
+ *        unsent tasks, and sendUnsentTasks sends it once they are through. Selecting it again on
+ *        a later pass could pick tasks that need yet other operands, and never send any.
+ * 
+ * @param picks The encoding of the data of each task, from selecting them
+ *
+ * @return true if the batch was sent, or is waiting for its operands, and is assigned to the client
+ */
+bool sendBatchToClient(Client *client, DpJob *job, uint16_t *batch, const dpCodecPick_t *picks, int numBatched) {
+#if DP_LOCAL_LANE
+    if (isLocalLane(client)) {
+        if (!queueLocalTasks(job, batch, numBatched)) {
+            return false;
+        }
+        am_util_debug_printf("Running %d tasks starting with task %d locally\n", numBatched, batch[0]);
+        assignBatch(client, job, batch, numBatched);
+        return true;
+    }
+#endif
+
+    uint8_t *buf = reserveClientTxBuf(client);
+
+    if (buf == NULL) {
+        return false;
+    }
+
+    int numOperands = sendMissingOperands(client, job, batch, numBatched, buf);
+    if (numOperands < 0) {
+        return false;
+    }
+    if (numOperands > 0) {
+        assignBatch(client, job, batch, numBatched);
+        client->numUnsentTasks = numBatched;
+        return true;
+    }
+
+    am_util_stdio_printf("Sending %d tasks of job %d starting with task %d to client %d\n", numBatched, job->id, batch[0],
+                         client->connId);
+    uint16_t overallPacketLength = buildTaskBatch(job, batch, picks, numBatched, buf);
+    if (!sendClientTxBuf(client, overallPacketLength)) {
+        return false;
+    }
+
+    assignBatch(client, job, batch, numBatched);
+    return true;
+}
+
+/**
+ * @brief Sends the batch a client holds unsent once the link took the operands it waited for,
+ *        or the rest of them if they needed more than one packet.
+ *        The tasks of the batch count from when they are sent.
+ */
+void sendUnsentTasks(Client *client) {
+    int first = client->numAssignedTasks - client->numUnsentTasks;
+    DpJob *job = &jobs[client->assignedJobs[first]];
+    uint16_t *batch = &client->assignedTasks[first];
+    dpCodecPick_t picks[DP_MAX_TASKS_PER_BATCH];
+    uint8_t *buf = reserveClientTxBuf(client);
+
+    selectRelayJob(job);
+    if (buf == NULL || sendMissingOperands(client, job, batch, client->numUnsentTasks, buf) != 0) {
+        return;
+    }
+
+    am_util_stdio_printf("Sending %d tasks of job %d starting with task %d to client %d\n", client->numUnsentTasks, job->id,
+                         batch[0], client->connId);
+    // the picks of the pass that selected the batch are gone, each task is picked once more as it goes out
+    for (int i = 0; i < client->numUnsentTasks; i++) {
+        picks[i] = pickTaskData(job, batch[i]);
+    }
+    uint16_t overallPacketLength = buildTaskBatch(job, batch, picks, client->numUnsentTasks, buf);
+    if (!sendClientTxBuf(client, overallPacketLength)) {
+        return;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    for (int i = first; i < client->numAssignedTasks; i++) {
+        client->assignedTime[i] = now;
+    }
+    client->numUnsentTasks = 0;
+#if DP_PUSH_COMPLETION
+    client->nextPollTime = now + pdMS_TO_TICKS(DP_POLL_INTERVAL_MS);
+#endif
+}
+
+/**
+ * @brief Returns the next task of a job to send without removing it from the queue,
+ *        dropping tasks that were completed by another client in the meantime
+ */
+int peekTask(DpJob *job) {
+    while (!isTaskQueueEmpty(job)) {
+        if (getTaskStatus(job, job->taskQueue[job->head]) != DP_TASK_STATUS_COMPLETE) {
+            return job->taskQueue[job->head];
+        }
+        dequeueTask(job);
+    }
+    return DP_NO_TASK;
+}
+
+/**
+ * @brief Returns the first speculative task of a job that still needs a second client,
+ *        dropping the ones that completed or went back to the queue
+ */
+int peekSpeculativeTask(DpJob *job) {
+    int kept = 0;
+    for (int i = 0; i < job->numSpeculativeTasks; i++) {
+        if (getTaskStatus(job, job->speculativeTasks[i]) == DP_TASK_STATUS_IN_PROGRESS) {
+            job->speculativeTasks[kept++] = job->speculativeTasks[i];
+        }
+    }
+    job->numSpeculativeTasks = kept;
+    return job->numSpeculativeTasks > 0 ? job->speculativeTasks[0] : DP_NO_TASK;
+}
+
+void removeSpeculativeTasks(DpJob *job, uint16_t *batch, int numBatched) {
+    int kept = 0;
+    for (int i = 0; i < job->numSpeculativeTasks; i++) {
+        bool sent = false;
+        for (int j = 0; j < numBatched; j++) {
+            sent |= (job->speculativeTasks[i] == batch[j]);
+        }
+        if (!sent) {
+            job->speculativeTasks[kept++] = job->speculativeTasks[i];
+        }
+    }
+    job->numSpeculativeTasks = kept;
+}
+
+bool isTaskSpeculative(DpJob *job, int taskId) {
+    for (int i = 0; i < job->numSpeculativeTasks; i++) {
+        if (job->speculativeTasks[i] == taskId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool canSpeculateTask(DpJob *job, int taskId) {
+    return job->numSpeculativeTasks < DP_MAX_SPECULATIVE_TASKS && countTaskHolders(job, taskId) < DP_MAX_TASK_COPIES
+        && !isTaskSpeculative(job, taskId);
+}
+
+/**
+ * @brief Marks a task to be duplicated on another client, the first result wins
+ * 
+ * @return true if the task was added to the speculative list of its job
+ */
+bool speculateTask(DpJob *job, int taskId) {
+    if (!canSpeculateTask(job, taskId)) {
+        return false;
+    }
+    job->speculativeTasks[job->numSpeculativeTasks++] = taskId;
+    return true;
+}
+
+/**
+ * @brief Picks the client for the next task of a job out of those that can take work and do not
+ *        hold it already. Queued tasks go where most of their operands are cached,
+ *        speculative copies go to the least loaded client.
+ *        The local lane only takes speculative copies here, its queued tasks come off the tail, see sendLocalTasks.
+ */
+Client* findClientForTask(DpJob *job, int taskId, bool preferIdle) {
+    uint16_t taskOperands[DP_MAX_OPERANDS_PER_TASK];
+    uint8_t n = job->kernel->getTaskOperands(taskId, taskOperands);
+    Client *bestClient = NULL;
+    int bestScore = -1;
+    uint32_t bestFinish = 0;
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0 || client->txBusy || client->numUnsentTasks > 0 || (isLocalLane(client) && !preferIdle)
+            || client->numAssignedTasks >= jobWindow(client, job) || clientHoldsTask(client, job, taskId)) {
+            continue;
+        }
+
+        int score = 0;
+        if (!preferIdle) {
+            for (int k = 0; k < n; k++) {
+                score += isOperandCached(client, job, taskOperands[k]);
+            }
+        }
+
+        // expected time until the client would deliver this task, unmeasured clients go first
+        uint32_t finish = (client->numAssignedTasks + 1) * client->serviceTime;
+        if (score > bestScore || (score == bestScore && finish < bestFinish)) {
+            bestScore = score;
+            bestFinish = finish;
+            bestClient = client;
+        }
+    }
+
+    return bestClient;
+}
+
+/**
+ * @brief Counts the unfinished tasks of a job on a client that could still go to another client as well
+ */
+int countSpeculableTasks(Client *client, DpJob *job) {
+    int count = 0;
+    for (int i = 0; i < client->numAssignedTasks; i++) {
+        int taskId = client->assignedTasks[i];
+        count += (client->assignedJobs[i] == jobSlot(job) && getTaskStatus(job, taskId) == DP_TASK_STATUS_IN_PROGRESS
+                  && countTaskHolders(job, taskId) < DP_MAX_TASK_COPIES);
+    }
+    return count;
+}
+
+/**
+ * @brief Once nothing is left in the queue of a job, lets idle clients duplicate its tasks
+ *        at the end of the busiest client's list, which would otherwise finish last.
+ *        Busiest counts the tasks not duplicated yet, so once one client's are, the next one's follow.
+ */
+void speculateTailTasks(DpJob *job) {
+    bool idleClient = false;
+    Client *busiestClient = NULL;
+    int busiestTasks = 0;
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0) {
+            continue;
+        }
+        int numTasks = countSpeculableTasks(client, job);
+        if (client->numAssignedTasks == 0) {
+            idleClient = true;
+        } else if (numTasks > busiestTasks) {
+            busiestTasks = numTasks;
+            busiestClient = client;
+        }
+    }
+
+    if (!idleClient || busiestClient == NULL) {
+        return;
+    }
+
+    for (int i = busiestClient->numAssignedTasks - 1; i >= 0; i--) {
+        int taskId = busiestClient->assignedTasks[i];
+        if (busiestClient->assignedJobs[i] == jobSlot(job) && getTaskStatus(job, taskId) == DP_TASK_STATUS_IN_PROGRESS) {
+            speculateTask(job, taskId);
+        }
+    }
+}
+
+/**
+ * @brief Lists the running jobs, the most urgent first and the oldest first within a priority
+ *
+ * @param order Filled with the jobs, room for DP_MAX_JOBS
+ *
+ * @return The number of running jobs
+ */
+int runningJobsByPriority(DpJob **order) {
+    int numJobs = 0;
+
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        DpJob *job = &jobs[i];
+        if (!job->running) {
+            continue;
+        }
+        int pos = numJobs++;
+        while (pos > 0 && (order[pos - 1]->priority < job->priority
+                           || (order[pos - 1]->priority == job->priority && order[pos - 1]->sequence > job->sequence))) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = job;
+    }
+    return numJobs;
+}
+
+#if DP_LOCAL_LANE
+/**
+ * @brief Refills the local lane from the tail of the queue of a job. The slaves take the head, where
+ *        the operands they were sent last are for. The local lane needs none, it always looks the soonest
+ *        and taking the head would leave the slaves with tasks they hold nothing for.
+ *        The two meet at the end of the queue, by then only speculative copies are left.
+ *
+ * @return The number of tasks queued on the local lane
+ */
+int sendLocalTasks(DpJob *job) {
+    Client *lane = &connectedClients[DP_LOCAL_CONN_ID - 1];
+    uint16_t batch[DP_LOCAL_LANE_WINDOW];
+    int numBatched = 0;
+
+    while (lane->numAssignedTasks + numBatched < jobWindow(lane, job)) {
+        int taskId = takeTailTask(job);
+        if (taskId == DP_NO_TASK) {
+            break;
+        }
+        batch[numBatched++] = taskId;
+    }
+
+    if (numBatched > 0 && !sendBatchToClient(lane, job, batch, NULL, numBatched)) {      // Nothing to encode for the lane
+        for (int i = numBatched - 1; i >= 0; i--) {
+            addTaskBackToQueue(job, batch[i]);
+        }
+        return 0;
+    }
+    return numBatched;
+}
+#endif
+
+/**
+ * @brief Sends a batch of tasks of one job to every client that has room for it in its window and a free link.
+ *        Speculative copies go first, then the task queue.
+ * 
+ * @return The number of tasks sent
+ */
+int sendJobTasks(DpJob *job) {
+    int tasksSent = 0;
+    uint16_t batch[DP_MAX_TASKS_PER_BATCH];
+    dpCodecPick_t picks[DP_MAX_TASKS_PER_BATCH];
+    int numBatched;
+    int numConsumed;
+
+    selectRelayJob(job);
+
+    // every pass leaves the chosen client busy, so each client is served at most once
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        int taskId = peekSpeculativeTask(job);
+        Client *client = (taskId != DP_NO_TASK) ? findClientForTask(job, taskId, true) : NULL;
+        if (client != NULL) {
+            numBatched = selectSpeculativeTasks(client, job, batch, picks);
+            if (numBatched > 0 && sendBatchToClient(client, job, batch, picks, numBatched)) {
+                am_util_stdio_printf("Speculatively duplicated %d tasks on client %d\n", numBatched, client->connId);
+                removeSpeculativeTasks(job, batch, numBatched);
+                tasksSent += numBatched;
+            }
+            continue;
+        }
+
+        taskId = peekTask(job);
+        if (taskId == DP_NO_TASK) {
+            am_util_debug_printf("No tasks in the queue, exiting sendJobTasks...\n");
+            break;
+        }
+
+        client = findClientForTask(job, taskId, false);
+        if (client == NULL) {
+            break;
+        }
+
+        numBatched = selectQueuedTasks(client, job, batch, picks, &numConsumed);
+        if (sendBatchToClient(client, job, batch, picks, numBatched)) {
+            for (int j = 0; j < numConsumed; j++) {
+                dequeueTask(job);
+            }
+            tasksSent += numBatched;
+        }
+    }
+
+#if DP_LOCAL_LANE
+    tasksSent += sendLocalTasks(job);
+#endif
+    return tasksSent;
+}
+
+/**
+ * @brief Hands out the tasks of the running jobs, the most urgent job first, so it takes
+ *        the free links and the room in the windows before the others.
+ *        Clients are refilled further as their acknowledgements come in.
+ */
+int sendTasksToClients() {
+    DpJob *order[DP_MAX_JOBS];
+    int numJobs = runningJobsByPriority(order);
+    int tasksSent = 0;
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId != 0 && client->numUnsentTasks > 0 && !client->txBusy) {
+            sendUnsentTasks(client);        // Before anything new, whatever its priority, the operands are there already
+        }
+    }
+
+    for (int j = 0; j < numJobs; j++) {
+        // a relay's queue runs dry after every batch of its parent, only the parent knows the job's tail
+        if (!DP_RELAY && peekTask(order[j]) == DP_NO_TASK) {
+            speculateTailTasks(order[j]);
+        }
+    }
+
+    for (int j = 0; j < numJobs; j++) {
+        tasksSent += sendJobTasks(order[j]);
+    }
+    return tasksSent;
+}
+
+/**
+ * @brief Asks a client about the oldest task it holds. The slave executes its tasks in order,
+ *        so this is the first one expected to complete. Does not wait for the reply.
+ */
+void pollClient(Client *client) {
+    uint16_t overallPacketLength;
+    Task oldestTask;
+    uint8_t *buf = reserveClientTxBuf(client);
 
-    if (taskCount > MAX_TASKS) {
-        am_util_debug_printf("Too many tasks for dp to handle, this should not happen\n");
-        while(1); // Too many tasks, this should not happen
+    if (buf == NULL) {
+        return;
     }
 
-    for (int i = 0; i < taskCount; i++) {
-        tasks[i].taskId = i;
-        tasks[i].status = DP_TASK_STATUS_INCOMPLETE;
-        // am_util_debug_printf("Task %d initialized\n", i);
-        if (!enqueueTask(&tasks[i])) {
-            while(1); // Queue is full, this should not happen
-        }; // Add the incomplete task to the task queue
+    selectRelayJob(&jobs[client->assignedJobs[0]]);
+    loadTask(&jobs[client->assignedJobs[0]], client->assignedTasks[0], &oldestTask);
+    overallPacketLength = DpBuildPacket(DP_PKT_TYPE_ENQUIRY, &oldestTask, buf, AMDTP_MAX_PAYLOAD_SIZE);
+    am_util_debug_printf("Polling client %d\n", client->connId);
+    if (!sendClientTxBuf(client, overallPacketLength)) {
+        return;
     }
+    am_util_debug_printf("Poll request sent to client %d for task %d\n", client->connId, oldestTask.taskId);
+    client->awaitingReply = true;
 }
-#endif
 
 /**
- * @brief Builds a distributed protocol packet
- * 
- * @param type The packet type
- * @param task The task
- * @param buf The buffer that the data is located in
- * 
- * @return The length of the packet
+ * @brief Sends an ENQUIRY to every client that is due for one, replies are handled by processEvents
  */
-uint16_t DpBuildPacket(uint8_t type, Task *task, uint8_t *buf, int bufSize) {
-    am_util_debug_printf("Building packet of type %d\n", type);
+void pollClientsForReplies() {
+    TickType_t now = xTaskGetTickCount();
 
-    distributedProtocolPacket_t *pkt;
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0 || client->numAssignedTasks == client->numUnsentTasks || client->awaitingReply
+            || client->txBusy || isLocalLane(client)) {
+            continue;                       // Nothing sent to ask about, or the local lane that reports every task itself
+        }
 
-    pkt = (distributedProtocolPacket_t *) buf;
+        if ((int32_t) (now - client->nextPollTime) >= 0) {
+            pollClient(client);
+        }
+    }
+}
 
-    pkt->type = type;
-    pkt->taskId = task->taskId;
-    // Build the packet
+bool clientHasWork(Client *client) {
+    return client->numAssignedTasks > 0 || client->awaitingReply || client->txBusy;
+}
 
-#if DP_MASTER
-    if (type == DP_PKT_TYPE_ENQUIRY) {
-        return DP_ENQUIRY_PKT_SIZE;
-    } else if (type == DP_PKT_TYPE_NEW_TASK) {
-        pkt->len = task->dataLength;
-        am_util_debug_printf("Task data length: %d\n", task->dataLength);
-        if (task->dataLength + DP_NEW_TASK_HEADER_SIZE >= bufSize) {
-            am_util_stdio_printf("Task data length is too large for the buffer, this should not happen\n");
-            while(1); // Task data length is 0, this should not happen
-        } 
+/**
+ * @brief Gives up waiting on clients that stayed silent for DP_REPLY_TIMEOUT_MS,
+ *        so one stalled slave cannot hold up the others
+ */
+void checkClientTimeouts() {
+    TickType_t now = xTaskGetTickCount();
 
-        // am_util_debug_printf("Pointer to task data: %x\n", task->data);
-        // am_util_debug_printf("Pointer to pkt task data: %x\n", &(pkt->taskData.data));
-        // am_util_debug_printf("Value of task data: %d\n", *((int *) task->data));
-        copyTaskDataToSendBuffer(&(pkt->data), task);
-        // memcpy(&(pkt->data), task->data, task->dataLength);
-        // am_util_debug_printf("Value of task data in pkt -> data: %d\n", *((int *) &(pkt->data)));
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0 || !clientHasWork(client) || isLocalLane(client)) {
+            continue;                       // Nothing gets lost on the local lane, a slow task is caught by its deadline
+        }
 
-        // am_util_debug_printf("packet dump:\n");
-        // print_buffer(&(pkt->data), pkt->len);
-        am_util_debug_printf("Task data length: %d\n", task->dataLength);
-        return DP_NEW_TASK_HEADER_SIZE + task->dataLength;
-    } else {
-        am_util_debug_printf("Building unknown packet for master????\n");
-        while(1);
-        return 0;
+        if ((int32_t) (now - client->lastHeardTime) < (int32_t) pdMS_TO_TICKS(DP_REPLY_TIMEOUT_MS)) {
+            continue;
+        }
+
+        am_util_stdio_printf("Client %d timed out\n", client->connId);
+        client->awaitingReply = false;
+        client->txBusy = false;
+        client->lastHeardTime = now;
+        client->nextPollTime = now;
+
+        if (++client->missedReplies >= DP_MAX_MISSED_REPLIES) {
+            am_util_stdio_printf("Client %d missed %d replies, requeueing its tasks\n", client->connId, client->missedReplies);
+            requeueClientTasks(client);
+            client->missedReplies = 0;
+        }
     }
-#endif
+}
 
-#if DP_SLAVE
-    if (type == DP_PKT_TYPE_RESPONSE) {
-        pkt->len = task->dataLength;
-        am_util_debug_printf("Building response packet ");
+/**
+ * @brief Finds the oldest task of a client that has not delivered a result yet.
+ *        The slave runs its tasks in order, so this is the one that should finish next.
+ * 
+ * @param client The client
+ * @param deadline Set to the time by which its result is expected
+ * @param job Set to the job of the task
+ * 
+ * @return The id of the task, DP_NO_TASK if there is none or no execution time was measured yet
+ */
+int findNextDeadline(Client *client, TickType_t *deadline, DpJob **job) {
+    if (client->serviceTime == 0) {
+        return DP_NO_TASK;                  // Nothing measured yet, only the reply timeout applies
+    }
 
-        if (task->status == DP_TASK_STATUS_COMPLETE) {
-            if (task->dataLength + DP_RESPONSE_HEADER_SIZE >= bufSize) {
-                am_util_stdio_printf("Task data length is too large for the buffer, this should not happen\n");
-                while(1); // Task data length is 0, this should not happen
-            } 
-            pkt->status = task->status;
-            am_util_debug_printf("for completed task %d, \n", task->taskId);
-            // am_util_debug_printf("Pointer to task result: %x\n", task->result);
-            // am_util_debug_printf("Pointer to pkt task data: %x\n", &(pkt->taskData.statusWithData.data));
-            memcpy(&(pkt->data), task->result, task->dataLength);
-            return DP_RESPONSE_HEADER_SIZE + task->dataLength;
-        } 
-        am_util_debug_printf("for unfinished task %d, \n", task->taskId);
-        pkt->len = 0;
-        pkt->status = task->status;
-        return DP_RESPONSE_HEADER_SIZE;
+    for (int i = 0; i < client->numAssignedTasks; i++) {
+        int taskId = client->assignedTasks[i];
+        *job = &jobs[client->assignedJobs[i]];
+        if (getTaskStatus(*job, taskId) != DP_TASK_STATUS_IN_PROGRESS) {
+            continue;                       // Already delivered by a speculative copy
+        }
 
-    } else {
-        am_util_debug_printf("Building unknown packet for slave????\n");
-        while(1);
-        return 0;
+        TickType_t start = client->assignedTime[i];
+        if ((int32_t) (client->lastCompletionTime - start) > 0) {
+            start = client->lastCompletionTime;
+        }
+        *deadline = start + (DP_DEADLINE_FACTOR * DP_RESULTS_PER_REPLY * client->serviceTime) / DP_SERVICE_TIME_SCALE
+                    + pdMS_TO_TICKS(DP_POLL_INTERVAL_MS);
+        return taskId;
     }
-#endif
+    return DP_NO_TASK;
 }
 
 /**
- * @brief Callback function for receiving distributed protocol packets
- * 
- * @param buf The buffer containing the packet, usually from the transport layer protocol
- * @param len The len of the packet
- * @param connId The connection ID of the slave device
+ * @brief Duplicates the tasks that are overdue on a slow or hung client onto another client
  */
-void DpRecvCb(uint8_t *buf, uint16_t len, dmConnId_t connId) {
+void checkTaskDeadlines() {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t deadline;
+    DpJob *job;
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0) {
+            continue;
+        }
 
-    if (len < DP_ENQUIRY_PKT_SIZE) {
-        // Packet is too short, thats wrong
-        am_util_debug_printf("Packet is too short, thats wrong. len: %d", len);
-        while (1);
+        int taskId = findNextDeadline(client, &deadline, &job);
+        if (taskId != DP_NO_TASK && (int32_t) (now - deadline) >= 0 && speculateTask(job, taskId)) {
+            am_util_stdio_printf("Task %d of job %d is late on client %d, sending it to another client\n", taskId, job->id,
+                                 client->connId);
+        }
     }
+}
 
-    distributedProtocolPacket_t *DpPkt = (distributedProtocolPacket_t *) buf;
-    eDpPktType_t type = DpPkt->type;
+/**
+ * @brief How long the distributed task can sleep before a poll, a timeout or a task deadline is due
+ */
+TickType_t ticksUntilNextDeadline() {
+    TickType_t now = xTaskGetTickCount();
+    int32_t wait = pdMS_TO_TICKS(DP_COMPLETION_WAIT_MS);
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId != 0 && client->txRetry && (int32_t) pdMS_TO_TICKS(DP_TX_RETRY_MS) < wait) {
+            wait = pdMS_TO_TICKS(DP_TX_RETRY_MS);
+        }
+        if (client->connId == 0 || !clientHasWork(client)) {
+            continue;
+        }
 
-#if DP_MASTER
-    if (type == DP_PKT_TYPE_RESPONSE) { //should only have this for master device
-        Task *task = &tasks[DpPkt->taskId];
-        eDpTaskStatus_t status = DpPkt->status;
-        am_util_stdio_printf("Received response from client %d for task %d, task status: ", connId, task->taskId);
-        print_status(status);
-        
-        if (status == DP_TASK_STATUS_COMPLETE) {
-            uint8_t resultLen = DpPkt->len;
-            // am_util_debug_printf("Pointer to task result: %x\n", task->result);
-            // am_util_debug_printf("Pointer to pkt task result: %x\n", &(DpPkt->data));
-            memcpy(task->result, &(DpPkt->data), resultLen);
+        int32_t untilTimeout = (int32_t) (client->lastHeardTime + pdMS_TO_TICKS(DP_REPLY_TIMEOUT_MS) - now);
+        if (untilTimeout < wait && !isLocalLane(client)) {
+            wait = untilTimeout;
+        }
 
-            task->status = DP_TASK_STATUS_COMPLETE;
-            connectedClients[connId - 1].assignedTask = NULL; // Remove the task from the client
+        if (!client->awaitingReply && !client->txBusy && !isLocalLane(client)) {
+            int32_t untilPoll = (int32_t) (client->nextPollTime - now);
+            if (untilPoll < wait) {
+                wait = untilPoll;
+            }
+        }
 
-        } else if (status == DP_TASK_STATUS_IN_PROGRESS) {
-            //still in progress
-            // upgrade with time out checks later
-            // do nothing and continue for now
-        } else if (status == DP_TASK_STATUS_UNKNOWN) {
-            //task failed, or slave is not working on this task
-            task->status = DP_TASK_STATUS_INCOMPLETE;
-            addTaskBackToQueue(task); // Add the task back to the task queue
-        } else {
-            am_util_stdio_printf("Unknown task status, adding back to queue!\n");
-            task->status = DP_TASK_STATUS_INCOMPLETE;
-            addTaskBackToQueue(task); // Add the task back to the task queue
+        TickType_t deadline;
+        DpJob *job;
+        int taskId = findNextDeadline(client, &deadline, &job);
+        if (taskId != DP_NO_TASK && canSpeculateTask(job, taskId)) {
+            int32_t untilDeadline = (int32_t) (deadline - now);
+            if (untilDeadline < wait) {
+                wait = untilDeadline;
+            }
         }
-        xSemaphoreGive(connectedClients[connId - 1].receivedReplySem); // Set the receivedReplySem flag for the client
     }
-#endif
 
-#if DP_SLAVE
-    if (type == DP_PKT_TYPE_ENQUIRY) {
-        am_util_debug_printf("Received enquiry for task %d\n", DpPkt->taskId);
-        // build response packet using task
-        uint16_t overallPacketLength = DpBuildPacket(DP_PKT_TYPE_RESPONSE, &task, dpBuf, DP_BUF_SIZE);
-        AmdtpsSendPacket(AMDTP_PKT_TYPE_DATA, 0, 1, dpBuf, overallPacketLength, connId);
+    return wait > 0 ? (TickType_t) wait : 0;
+}
 
-    } else if (type == DP_PKT_TYPE_NEW_TASK) {
-        am_util_debug_printf("Received new task for task %d\n", DpPkt->taskId);
+bool areAllTasksCompleted(DpJob *job) {
+    return job->completedTaskCount >= job->taskCount;
+}
 
-        // am_util_debug_printf("packet dump:\n");
-        // print_buffer(DpPkt, len);
+int areClientsConnected() {
+    int numConnectedClients = 0;
+
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        if (connectedClients[i].connId != 0) {
+            numConnectedClients++;
+            am_util_debug_printf("address: %x, connId: %d\n", connectedClients[i], connectedClients[i].connId);
 
-        if (task.status != DP_TASK_STATUS_IN_PROGRESS) {
+        }
+    }
 
-            //receive the new task
-            task.taskId = DpPkt->taskId;
-            am_util_debug_printf("length of task data: %d\n", DpPkt->len);
+    am_util_debug_printf("Number of connected clients: %d\n", numConnectedClients);
 
-            memcpy(task.data, &(DpPkt->data), DpPkt->len);
-            task.status = DP_TASK_STATUS_IN_PROGRESS;            
-            // am_util_debug_printf("packet dump:\n");
-            // print_buffer(&(DpPkt->data), DpPkt->len);
+    return numConnectedClients;
+}
 
-            xTaskCreate(runExecuteTask, "Task", 1024, &task, 1, &distributionProtocolTaskHandle);
-            return;
-        } else {
-            am_util_debug_printf("Received Task %d but task %d is already in progress\n", DpPkt->taskId, task.taskId);
+/**
+ * @brief Has the kernel cut the queued tasks of a job that no client holds into tasks of another size.
+ *        The tasks it was cut out of read as COMPLETE, so a result that still comes in for one is dropped,
+ *        but count neither as tasks of the job nor as completed ones.
+ *
+ * @param job The job, its kernel has regroupTasks
+ * @param taskWork The work each new task should have at least, in tasks of the smallest size
+ */
+void regroupJob(DpJob *job, uint32_t taskWork) {
+    size_t completedTaskCount = job->completedTaskCount;
+    size_t numRegrouped = 0;
+    int kept = job->head;
+
+    for (int i = job->head; i != job->tail; i = (i + 1) % MAX_TASKS) {
+        int taskId = job->taskQueue[i];
+        eDpTaskStatus_t status = getTaskStatus(job, taskId);
+
+        if (status == DP_TASK_STATUS_INCOMPLETE && countTaskHolders(job, taskId) == 0) {
+            setTaskStatus(job, taskId, DP_TASK_STATUS_COMPLETE);    // Also skips a second entry of the same task
+            regroupedTasks[numRegrouped++] = taskId;
+        } else if (status != DP_TASK_STATUS_COMPLETE) {
+            job->taskQueue[kept] = taskId;
+            kept = (kept + 1) % MAX_TASKS;
         }
     }
-#endif
+    job->tail = kept;
+
+    size_t numTasks = job->kernel->regroupTasks(taskWork, regroupedTasks, numRegrouped, MAX_TASKS);
+    for (size_t i = 0; i < numTasks; i++) {
+        if (regroupedTasks[i] >= MAX_TASKS) {
+            am_util_stdio_printf("Task %d is out of range, this should not happen\n", regroupedTasks[i]);
+            while(1);
+        }
+        setTaskStatus(job, regroupedTasks[i], DP_TASK_STATUS_INCOMPLETE);
+        addTaskBackToQueue(job, regroupedTasks[i]);
+    }
+
+    job->taskCount = job->taskCount - numRegrouped + numTasks;
+    job->completedTaskCount = completedTaskCount;      // Nothing completed, some tasks were only swapped for others
+    job->taskWork = taskWork;
+    am_util_stdio_printf("Job %d: %d queued tasks cut into %d of %d units of work\n", job->id, (int) numRegrouped,
+                         (int) numTasks, (int) taskWork);
 }
 
-#if DP_MASTER
-void sendTaskToClient(Client *client, Task *task) {
+/**
+ * @brief Picks the task size of a job once it measured DP_TUNING_RESULTS results since the clients last changed,
+ *        the first ones in the kernel's own size, and cuts the tasks still queued to it.
+ *        The smallest tasks that still keep every client busy are the best: while a client works through one
+ *        batch, its results have to go back and the next batch has to come in, about DP_TUNING_LINK_FACTOR
+ *        packets over its link. Smaller tasks leave the slaves waiting for the link, larger ones leave the
+ *        slowest clients with a larger share at the end of the job. A relay splits each batch over its
+ *        children and adds the links down to them.
+ */
+void tuneTaskSize(DpJob *job) {
+    uint64_t slowestLinkUs = 0;
 
-    am_util_stdio_printf("Sending task %d to client %d\n", task->taskId, client->connId);
-    task->status = DP_TASK_STATUS_IN_PROGRESS;
-    client->assignedTask = task;
-    uint16_t overallPacketLength = DpBuildPacket(DP_PKT_TYPE_NEW_TASK, task, dpBuf, DP_BUF_SIZE);
+    if (!DP_TUNE_TASK_SIZE || !job->running || job->kernel->regroupTasks == NULL || job->sizeTuned
+        || job->tuningResults < DP_TUNING_RESULTS) {
+        return;
+    }
 
-    am_util_debug_printf("Invoking amdtpc send for task %d to client %d\n", task->taskId, client->connId);
-    // am_util_debug_printf("packet size %d\n", overallPacketLength);
-    // am_util_debug_printf("packet dump:\n");
-    print_buffer(dpBuf, overallPacketLength);
-    AmdtpcSendPacket(AMDTP_PKT_TYPE_DATA, 0, 1, dpBuf, overallPacketLength, client->connId);
-    
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0 || isLocalLane(client)) {
+            continue;
+        }
+        if (client->linkTime == 0) {
+            return;                         // The local lane may deliver before the first packet is acknowledged
+        }
+        // link time per batch of the client, for each slave the batch is split over
+        uint64_t linkUs = (uint64_t) (clientLinkUs(client) + client->downstreamUs) * client->workers;
+        if (linkUs > slowestLinkUs) {
+            slowestLinkUs = linkUs;
+        }
+    }
+
+    // work per task so that a batch computes for as long as the packets take: taskWork * (execUs / execWork)
+    // * DP_MAX_TASKS_PER_BATCH >= DP_TUNING_LINK_FACTOR * linkUs
+    uint64_t batchUs = job->execUs * DP_MAX_TASKS_PER_BATCH;
+    uint64_t taskWork = (DP_TUNING_LINK_FACTOR * slowestLinkUs * job->execWork + batchUs - 1) / batchUs;
+
+    job->sizeTuned = true;
+    am_util_stdio_printf("Job %d: %d us per unit of work, %d us of link time per batch on the slowest client\n", job->id,
+                         (int) (job->execUs / job->execWork), (int) slowestLinkUs);
+    if (taskWork == 0) {
+        taskWork = 1;
+    }
+    if (taskWork != job->taskWork) {
+        regroupJob(job, taskWork > UINT32_MAX ? UINT32_MAX : (uint32_t) taskWork);
+    }
 }
 
 /**
- * @brief Assigns a task to each client that is free
+ * @brief Sets up a client entry for a new connection, with no tasks, no estimates and an empty operand cache
  */
-int sendTasksToClients() {
-    int tasksSent = 0;
+void resetClient(Client *client, dmConnId_t connId) {
+    TickType_t now = xTaskGetTickCount();
+
+    client->connId = connId;
+    client->numAssignedTasks = 0;
+    client->numUnsentTasks = 0;
+    client->numFoldedTasks = 0;
+    client->awaitingReply = false;
+    client->txBusy = false;
+    client->txRetry = false;
+    client->missedReplies = 0;
+    client->nextPollTime = now;
+    client->lastHeardTime = now;
+    client->lastCompletionTime = now;
+    client->serviceTime = 0;
+    client->linkTime = 0;
+    client->workers = 1;
+    client->downstreamUs = 0;
+    client->tasksCompleted = 0;
+    memset(client->cachedOperands, 0, sizeof(client->cachedOperands));     // A new connection starts with an empty cache
+}
+
+/**
+ * @brief Brings connectedClients in line with the links the radio task reported.
+ *        A dropped client gives its tasks back to the queue, a new one can take work right away.
+ *        A link that dropped and came back in between counts as both.
+ */
+void syncClients() {
     for (int i = 0; i < DM_CONN_MAX; i++) {
-        if (connectedClients[i].connId == 0 || connectedClients[i].assignedTask != NULL) {
+        Client *client = &connectedClients[i];
+        uint8_t generation = linkGeneration[i];     // Read before linkUp, a change in between is caught by the next call
+
+        if (generation == clientGeneration[i]) {
             continue;
         }
+        clientGeneration[i] = generation;
 
-        Task *task = dequeueTask();                     // Get the task from the task queue
-        if (task == NULL) {
-            am_util_debug_printf("No tasks in the queue, exiting sendTasksToClients...\n");
-            break;
+        if (client->connId != 0) {
+            am_util_stdio_printf("Client %d disconnected, requeueing its %d tasks\n", client->connId, client->numAssignedTasks);
+            requeueClientTasks(client);
+            client->connId = 0;
+            client->numAssignedTasks = 0;
+        }
+
+        if (linkUp[i]) {
+            resetClient(client, i + 1);
+            if (DpJobRunning(DP_NO_KERNEL)) {
+                am_util_stdio_printf("Client %d joined the running jobs\n", client->connId);
+            }
         }
 
-        sendTaskToClient(&connectedClients[i], task);   // Send the task to the client
-        tasksSent++;
+        // the links and the slaves to keep busy changed, the task size is picked again from fresh results
+        for (int j = 0; j < DP_MAX_JOBS; j++) {
+            jobs[j].tuningResults = 0;
+            jobs[j].sizeTuned = false;
+        }
     }
+}
 
-    return tasksSent;
+/**
+ * @brief Sets up the tasks of a job DpStartJob claimed a slot for, from here on the scheduler hands them out
+ */
+void startJob(uint8_t jobId) {
+    DpJob *job = NULL;
 
-}
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        if (jobs[i].kernel != NULL && !jobs[i].running && jobs[i].id == jobId) {
+            job = &jobs[i];
+        }
+    }
+    if (job == NULL) {
+        return;
+    }
 
-void pollClient(Client *client) {
-    uint16_t overallPacketLength;
-    overallPacketLength = DpBuildPacket(DP_PKT_TYPE_ENQUIRY, client->assignedTask, dpBuf, DP_BUF_SIZE);
-    am_util_debug_printf("Polling client %d\n", client->connId);
-    while (AmdtpcSendPacket(AMDTP_PKT_TYPE_DATA, 0, 1, dpBuf, overallPacketLength, client->connId) != AMDTP_STATUS_SUCCESS);
-    am_util_debug_printf("Poll request sent to client %d for task %d, waiting for reply before polling others...\n", client->connId, client->assignedTask->taskId);
-    xSemaphoreTake(client->receivedReplySem, portMAX_DELAY);
-    // will block until the semaphore is given in the recv callback
+    am_util_stdio_printf("Running job %d, %s\n", job->id, job->kernel->name);
+    initializeTasks(job);
+    syncClients();
+
+    TickType_t now = xTaskGetTickCount();
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->numAssignedTasks == 0) {
+            // a client that waited for work would time out as soon as it gets some
+            client->nextPollTime = now;
+            client->lastHeardTime = now;
+            client->lastCompletionTime = now;
+        }
+        // operand ids are per kernel, the previous job in this slot may have used the same ones
+        memset(client->cachedOperands[jobSlot(job)], 0, sizeof(client->cachedOperands[0]));
+    }
+    job->activeTime = now;
+    job->running = true;
+
+    if (areClientsConnected() == 0) {
+        am_util_debug_printf("No clients connected, dropping job %d\n", job->id);
+        job->running = false;
+        job->kernel = NULL;
+    }
 }
 
-void pollClientsForReplies() {
-    for (int i = 0; i < DM_CONN_MAX; i++) {
-        if (connectedClients[i].connId == 0 || connectedClients[i].assignedTask == NULL) {
-            continue;
+/**
+ * @brief Reassembles the results of a job that has all of them and frees its slot.
+ *        Copies of its tasks that are still running on a client are forgotten, their results get dropped.
+ */
+void finishJob(DpJob *job) {
+    TickType_t elapsed = xTaskGetTickCount() - job->activeTime;
+
+    recordTrace(DP_TRACE_JOB_END, job->id, job->taskCount, 0);
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        for (int j = client->numAssignedTasks - 1; j >= 0; j--) {
+            if (client->assignedJobs[j] == jobSlot(job)) {
+                removeClientEntry(client, j);
+            }
         }
+    }
+    am_util_stdio_printf("Job %d, %s, finished in %d ms\n", job->id, job->kernel->name,
+                         (int) (elapsed * 1000 / configTICK_RATE_HZ));
+    printClientEstimates();
+
+    // Reassemble results
+    am_util_debug_printf("Reassembling task results...\n");
+    job->kernel->reassembleTaskResults(job->taskCount); // Call the application defined function to reassemble the task results
+
+    taskENTER_CRITICAL();
+    job->running = false;               // Results of duplicates that are still running get dropped from here on
+    job->kernel = NULL;
+    taskEXIT_CRITICAL();
 
-        pollClient(&connectedClients[i]); // Call pollClient() for each client
+    if (!DpJobRunning(DP_NO_KERNEL)) {
+        DpTraceDump();                  // One timeline for every job that overlapped
     }
 }
 
-bool areAllTasksCompleted() {
-    for (int i = 0; i < taskCount; i++) {
-        if (tasks[i].status != DP_TASK_STATUS_COMPLETE) {
-            return false;
+/**
+ * @brief Hands out queued tasks, then sleeps until the next event or deadline and catches up with it
+ */
+void runSchedulerPass() {
+    syncClients();                          // Before sending, so nothing goes to a dropped link and new slaves get work
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        tuneTaskSize(&jobs[i]);
+    }
+#if DP_RELAY
+    updateRelayReport();
+#endif
+    sendTasksToClients();
+    // with DP_PUSH_COMPLETION this only reaches clients that have not pushed anything for a while,
+    // in case a result was left behind on a busy link
+    pollClientsForReplies();
+
+    // sleep until a response or an acknowledgement arrives, or a poll or timeout is due
+    processEvents(ticksUntilNextDeadline());
+    checkClientTimeouts();
+    checkTaskDeadlines();
+
+#if !DP_RELAY
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        if (jobs[i].running && areAllTasksCompleted(&jobs[i])) {
+            finishJob(&jobs[i]);
         }
     }
-    return true;
+#endif
 }
 
-int areClientsConnected() {
-    int numConnectedClients = 0;
+/**
+ * @brief Distributed task, runs the jobs DpStartJob hands it for as long as the master runs.
+ *        A relay schedules the tasks of its parent on the children the same way.
+ */
+void doDistributedTask(void *pvParameters) {
+    while (1) {
+        runSchedulerPass();
+    }
+}
 
-    for (int i = 0; i < DM_CONN_MAX; i++) {
-        if (connectedClients[i].connId != 0) {
-            numConnectedClients++;
-            am_util_debug_printf("address: %x, connId: %d\n", connectedClients[i], connectedClients[i].connId);
+/**
+ * @brief Starts a job on the connected clients, next to the one that may be running
+ * 
+ * @param kernelId The registered kernel to run
+ * @param priority How the job shares the clients with the other running jobs
+ * 
+ * @return false if the kernel is unknown or already running, or DP_MAX_JOBS jobs are running
+ */
+bool DpStartJobWithPriority(uint8_t kernelId, eDpPriority_t priority) {
+    const DpKernel *kernel = DpFindKernel(kernelId);
+    DpJob *job = NULL;
+
+    if (kernel == NULL) {
+        am_util_stdio_printf("No kernel with id %d\n", kernelId);
+        return false;
+    }
+    if (priority >= DP_PRIORITY_MAX) {
+        am_util_stdio_printf("No priority %d\n", priority);
+        return false;
+    }
 
+    taskENTER_CRITICAL();
+    if (!DpJobRunning(kernelId)) {
+        for (int i = 0; i < DP_MAX_JOBS && job == NULL; i++) {
+            if (jobs[i].kernel == NULL) {
+                job = &jobs[i];
+            }
         }
     }
+    if (job != NULL) {
+        // ids of the last jobs may still be in flight, never reuse one that is in a slot
+        do {
+            lastJobId = lastJobId % DP_WIRE_MAX_JOB_ID + 1;
+        } while (findJob(lastJobId) != NULL);
+        job->kernel = kernel;               // Set before the distributed task sets it up so a second start is refused
+        job->id = lastJobId;
+        job->priority = priority;
+        job->sequence = jobSequence++;
+    }
+    taskEXIT_CRITICAL();
 
-    am_util_debug_printf("Number of connected clients: %d\n", numConnectedClients);
+    if (job == NULL) {
+        am_util_stdio_printf("Job %s is still running, or %d jobs are\n", kernel->name, DP_MAX_JOBS);
+        return false;
+    }
 
-    return numConnectedClients;
+    DpEvent event = { .type = DP_EVENT_JOB_START, .taskId = 0, .status = DP_TASK_STATUS_UNKNOWN, .connId = 0,
+                      .generation = 0, .jobId = job->id };
+    if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+        am_util_stdio_printf("Event queue is full, this should not happen\n");
+        while(1);
+    }
+    return true;
 }
 
+/**
+ * @brief Starts a job of normal priority, see DpStartJobWithPriority
+ */
+bool DpStartJob(uint8_t kernelId) {
+    return DpStartJobWithPriority(kernelId, DP_PRIORITY_NORMAL);
+}
 
-void doDistributedTask() {
-    initializeTasks();
+/**
+ * @brief Tells whether a job of a kernel was started and has not finished yet
+ *
+ * @param kernelId The kernel, DP_NO_KERNEL for a job of any kernel
+ */
+bool DpJobRunning(uint8_t kernelId) {
+    for (int i = 0; i < DP_MAX_JOBS; i++) {
+        const DpKernel *kernel = jobs[i].kernel;
+        if (kernel != NULL && (kernelId == DP_NO_KERNEL || kernel->id == kernelId)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    if (areClientsConnected() == 0) {
-        am_util_debug_printf("No clients connected, exiting distributed task...\n");
-        vTaskDelete(NULL); //task complete, stop the task...
-        return;
+/**
+ * @brief Returns the estimated time a client needs per task, transfer plus compute
+ * 
+ * @param connId The connection ID of the slave device
+ * 
+ * @return The estimate in microseconds, 0 if the client is not connected or has not delivered a result yet
+ */
+uint32_t getClientServiceTimeUs(dmConnId_t connId) {
+    if (connId == 0 || connId > DP_MAX_CLIENTS || connectedClients[connId - 1].connId == 0) {
+        return 0;
     }
-    
-    sendTasksToClients();
+    return (connectedClients[connId - 1].serviceTime * (1000000 / configTICK_RATE_HZ)) / DP_SERVICE_TIME_SCALE;
+}
 
-    while (!areAllTasksCompleted()) {
-        pollClientsForReplies();
-        if (sendTasksToClients() == 0) {
-            am_util_debug_printf("No tasks sent, inserting extra time...\n");
-            
-            vTaskDelay(1000); // Wait for 0.3 seconds before polling clients again
-        };
+void printClientEstimates() {
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
+        Client *client = &connectedClients[i];
+        if (client->connId == 0) {
+            continue;
+        }
+        am_util_stdio_printf("Client %d: %d us per task, window %d, %d tasks completed\n", client->connId,
+                             getClientServiceTimeUs(client->connId), clientWindow(client), client->tasksCompleted);
     }
+}
 
-    // Reassemble results
-    am_util_debug_printf("Reassembling task results...\n");
-    reassembleTaskResults(tasks, taskCount); // Call the application defined function to reassemble the task results
-    
-    vTaskDelete(NULL); //task complete, stop the task...
+/**
+ * @brief Wakes the distributed task so it picks up a link change right away
+ */
+void notifyLinkChange(dmConnId_t connId) {
+    DpEvent event = { .type = DP_EVENT_LINK, .taskId = 0, .status = DP_TASK_STATUS_UNKNOWN, .connId = connId,
+                      .generation = linkGeneration[connId - 1] };
+
+    // only a wake up hint, the next pass syncs the clients either way
+    xQueueSend(eventQueue, &event, 0);
 }
 
+/**
+ * @brief Called by the radio task once an AMDTP server is connected. A running job hands it work from its next pass
+ */
 void addConnectedClient(dmConnId_t connId) {
-    // Add the client to the list
-    connectedClients[connId - 1].connId = connId;
-    connectedClients[connId - 1].assignedTask = NULL;   
-    connectedClients[connId - 1].receivedReplySem = xSemaphoreCreateBinaryStatic(&(connectedClients[connId - 1].xSemaphoreBuffer));
-
-    if (connectedClients[connId - 1].receivedReplySem == NULL) {
-        // Semaphore creation failed
-        am_util_debug_printf("Semaphore creation failed");
-    }
+    linkUp[connId - 1] = true;
+    linkGeneration[connId - 1]++;
+    notifyLinkChange(connId);
 }
 
+/**
+ * @brief Called by the radio task once a link closed. The tasks in flight on it go back on the queue
+ */
 void removeConnectedClient(dmConnId_t connId) {
-    // Remove the client from the list
-    connectedClients[connId - 1].connId = 0;
-    connectedClients[connId - 1].assignedTask = NULL;
-    vSemaphoreDelete(connectedClients[connId - 1].receivedReplySem);
+    linkUp[connId - 1] = false;
+    linkGeneration[connId - 1]++;
+    notifyLinkChange(connId);
 }
 #endif
 
@@ -441,17 +3521,65 @@ void initializeDistributedProtocol() {
     am_util_debug_printf("Initializing distributed protocol...");
 #if DP_MASTER
     am_util_debug_printf("for master...\n");
-    for (int i = 0; i < DM_CONN_MAX; i++) {
+    eventQueue = xQueueCreateStatic(DP_EVENT_QUEUE_LEN, sizeof(DpEvent), eventQueueStorage, &eventQueueBuffer);
+    for (int i = 0; i < DP_MAX_CLIENTS; i++) {
         connectedClients[i].connId = 0;
-        connectedClients[i].assignedTask = NULL;
+        connectedClients[i].numAssignedTasks = 0;
         am_util_debug_printf("address: %x, connId: %d\n", connectedClients[i], connectedClients[i].connId);
 
     }
-    taskCount = 0;
+#if DP_LOCAL_LANE
+    resetClient(&connectedClients[DP_LOCAL_CONN_ID - 1], DP_LOCAL_CONN_ID);     // Stays connected, jobs run even without slaves
+    localLaneTaskHandle = xTaskCreateStatic(runLocalLane, "Local lane", DP_WORKER_STACK_SIZE, NULL,
+                                            DP_LOCAL_LANE_PRIORITY, localLaneStack, &localLaneTaskBuffer);
+#endif
+    // waits for DpStartJob, on a relay for the jobs the parent sends
+    xTaskCreate(doDistributedTask, "Distributed Task", 1024, NULL, 1, &distributionProtocolTaskHandle);
 #endif
 
 #if DP_SLAVE
     am_util_debug_printf("for slave...\n");
-    initServerTask(&task);
+    for (int i = 0; i < DP_MAX_TASKS_PER_CLIENT; i++) {
+        slaveTasks[i].status = DP_TASK_STATUS_UNKNOWN;
+        slaveTasks[i].kernelId = DP_NO_KERNEL;      // Set up for a kernel when a task arrives
+        slaveTasks[i].jobId = DP_NO_JOB;
+    }
+#if DP_RELAY
+    workerTaskHandle = xTaskCreateStatic(runRelayReplies, "Relay replies", DP_WORKER_STACK_SIZE, NULL,
+                                         DP_WORKER_PRIORITY, workerStack, &workerTaskBuffer);
+#else
+    workerTaskHandle = xTaskCreateStatic(runExecuteTask, "Worker", DP_WORKER_STACK_SIZE, NULL,
+                                         DP_WORKER_PRIORITY, workerStack, &workerTaskBuffer);
 #endif
-}
\ No newline at end of file
+#endif
+}
+
+/**
+ * @brief Adds a job type. The master and the slaves have to register a kernel under the same id
+ * 
+ * @return false if the id is taken or the table is full
+ */
+bool DpRegisterKernel(const DpKernel *kernel) {
+    if (kernel->id == DP_NO_KERNEL || DpFindKernel(kernel->id) != NULL || numKernels == DP_MAX_KERNELS) {
+        am_util_stdio_printf("Could not register kernel %d, increase DP_MAX_KERNELS or pick another id\n", kernel->id);
+        return false;
+    }
+
+    kernels[numKernels++] = kernel;
+    return true;
+}
+
+const DpKernel *DpFindKernel(uint8_t kernelId) {
+    for (int i = 0; i < numKernels; i++) {
+        if (kernels[i]->id == kernelId) {
+            return kernels[i];
+        }
+    }
+    return NULL;
+}
+
+void DpPrintKernels() {
+    for (int i = 0; i < numKernels; i++) {
+        am_util_stdio_printf("%d. %s\n", kernels[i]->id, kernels[i]->name);
+    }
+}
@@ -1,17 +1,24 @@
 #ifndef DISTRIBUTED_PROTOCOL_H
 #define DISTRIBUTED_PROTOCOL_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "dm_api.h"
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "amdtp_common.h"
 #include "dp_config.h"
 
+// the wire layout of each packet type is described in dp_wire.h
 typedef enum eDpPktType {
     DP_PKT_TYPE_UNKNOWN,
-    DP_PKT_TYPE_NEW_TASK,       // TYPE + TASK_ID + LEN + DATA
-    DP_PKT_TYPE_RESPONSE,       // TYPE + TASK_ID + LEN + STATUS + DATA
+    DP_PKT_TYPE_NEW_TASK,
+    DP_PKT_TYPE_RESPONSE,
     DP_PKT_TYPE_ENQUIRY,
-    DP_PKT_TYPE_MAX
+    DP_PKT_TYPE_NEW_TASK_BATCH,
+    DP_PKT_TYPE_RESPONSE_BATCH,
+    DP_PKT_TYPE_OPERAND,
+    DP_PKT_TYPE_MAX             // Must stay below 16, the type shares its byte with the version
 } eDpPktType_t;
 
 
@@ -24,26 +31,142 @@ typedef enum eDpTaskStatus {
 } eDpTaskStatus_t;
 
 
-#define DP_LEN_SIZE                 sizeof(uint16_t)
-#define DP_STATUS_SIZE              sizeof(eDpTaskStatus_t)
-#define DP_TASK_ID_SIZE             sizeof(int)
-#define DP_PKT_TYPE_SIZE            sizeof(eDpPktType_t)
+// what a kernel's task data, operands and results are made of, so the protocol can compress them on the wire
+typedef enum eDpElementType {
+    DP_ELEMENT_RAW,             // Opaque bytes, sent as they are
+    DP_ELEMENT_INT8,
+    DP_ELEMENT_INT16,
+    DP_ELEMENT_INT32,
+    DP_ELEMENT_FLOAT,
+    DP_ELEMENT_MAX
+} eDpElementType_t;
 
-#define DP_ENQUIRY_PKT_SIZE         2 * DP_TASK_ID_SIZE
-#define DP_NEW_TASK_HEADER_SIZE     DP_PKT_TYPE_SIZE + DP_TASK_ID_SIZE + DP_LEN_SIZE + DP_STATUS_SIZE
-#define DP_RESPONSE_HEADER_SIZE     DP_PKT_TYPE_SIZE + DP_TASK_ID_SIZE + DP_LEN_SIZE + DP_STATUS_SIZE
 
-#define DP_BUF_SIZE                 100000
+// how urgently the master wants a job done, a job of higher priority goes first on every link and every slave
+typedef enum eDpPriority {
+    DP_PRIORITY_BATCH,          // Long running, only gets what the others leave
+    DP_PRIORITY_NORMAL,         // DpStartJob
+    DP_PRIORITY_URGENT,         // Short and latency sensitive, overtakes the others
+    DP_PRIORITY_MAX             // Must stay at or below 4, the priority shares its byte with the job id
+} eDpPriority_t;
 
 
+#ifndef DP_MAX_TASKS_PER_CLIENT
+#define DP_MAX_TASKS_PER_CLIENT     32          // Tasks a client can hold in flight, also the size of the slave's local queue
+#endif
+
+#ifndef DP_MAX_TASKS_PER_BATCH
+#define DP_MAX_TASKS_PER_BATCH      (DP_MAX_TASKS_PER_CLIENT / 2)   // Half the window, so one batch is queued while the other executes
+#endif
+
+#ifndef DP_MAX_OPERANDS
+#define DP_MAX_OPERANDS             256         // Operand ids the master keeps track of per client
+#endif
+
+#define DP_MAX_OPERANDS_PER_TASK    4
+
+#ifndef DP_OPERAND_PREFETCH
+#define DP_OPERAND_PREFETCH         1           // Batches per client the operands of a batch look ahead in the queue, 0 to send only the batch's own
+#endif
+#define DP_MAX_OPERANDS_PER_PACKET  (2 * DP_MAX_TASKS_PER_BATCH * DP_MAX_OPERANDS_PER_TASK)
+
+#ifndef DP_MAX_JOBS
+#define DP_MAX_JOBS                 2           // Jobs the master runs at once, each has a task table of its own
+#endif
+#define DP_NO_JOB                   0           // Job ids start at 1
+
+#ifndef DP_PRIORITY_RESERVE
+#define DP_PRIORITY_RESERVE         4           // Tasks of a client's window a job leaves free for each priority above its own that is running
+#endif
+
+#ifndef DP_PUSH_COMPLETION
+#define DP_PUSH_COMPLETION          1           // 1: slaves send results as soon as a task completes, 0: master polls with ENQUIRY
+#endif
+
+// a node built as both master and slave is a relay: a slave to its parent that hands the tasks
+// it receives on to slaves of its own and sends their results back up, so a job reaches more
+// boards than one master can connect to
+#if DP_MASTER && DP_SLAVE
+#define DP_RELAY                    1
+#else
+#define DP_RELAY                    0
+#endif
+
+#ifndef DP_LOCAL_LANE
+#if DP_RELAY
+#define DP_LOCAL_LANE               0           // The kernels' slot memory of a relay holds the tasks it passes on
+#else
+#define DP_LOCAL_LANE               1           // 1: the master executes tasks too, as one more client without a link
+#endif
+#endif
+
+#if DP_RELAY && DP_LOCAL_LANE
+#error "A relay has no local lane, the kernels' slot memory holds the tasks it passes on"
+#endif
+
+#ifndef DP_RELAY_OPERAND_POOL_SIZE
+#define DP_RELAY_OPERAND_POOL_SIZE  (DP_MAX_OPERANDS * (128 + 8))    // Bytes of operands a relay keeps to pass on, shared by the jobs. The largest set of the kernels, all of A and B of the matrix job, and a header per operand
+#endif
+#ifndef DP_RELAY_RAM
+#define DP_RELAY_RAM                (40 * 1024) // Static RAM the relay state may take on top of its master and slave sides, checked at build time
+#endif
+
+#if DP_LOCAL_LANE
+#define DP_MAX_CLIENTS              (DM_CONN_MAX + 1)
+#else
+#define DP_MAX_CLIENTS              DM_CONN_MAX
+#endif
+#define DP_LOCAL_CONN_ID            (DM_CONN_MAX + 1)   // Client id of the local lane, after the ids of the BLE connections
+#define DP_LOCAL_LANE_WINDOW        2           // Tasks the local lane holds, one executing and one waiting
+#define DP_LOCAL_LANE_PRIORITY      0           // Below the distributed task and the radio, it only takes spare cycles
+
+#define DP_EVENT_QUEUE_LEN          (DP_MAX_CLIENTS * (DP_MAX_TASKS_PER_CLIENT + 1) + DP_RELAY * DP_MAX_TASKS_PER_CLIENT + DP_MAX_JOBS)
+#define DP_COMPLETION_WAIT_MS       1000        // Longest the master sleeps without any event before re-checking the jobs
+#define DP_REPLY_TIMEOUT_MS         2000        // A client with work that stays silent this long has timed out
+#define DP_MAX_MISSED_REPLIES       3           // Timeouts in a row before the tasks of a client are requeued
+
+#if DP_PUSH_COMPLETION
+#define DP_POLL_INTERVAL_MS         DP_COMPLETION_WAIT_MS   // Only poll clients that have not pushed anything for a while
+#else
+#define DP_POLL_INTERVAL_MS         100         // Minimum time between ENQUIRYs to a client whose task is still running
+#endif
+#define DP_TX_RETRY_MS              10          // When the link to a client refused a packet, try again this much later
+#define DP_PUSH_RETRY_MS            1000        // How long the slave keeps retrying to push a result before leaving it for an ENQUIRY
+#define DP_WORKER_STACK_SIZE        1024        // Words, the slave worker runs executeTask on this stack
+#define DP_WORKER_PRIORITY          1
+
+#define DP_DEADLINE_FACTOR          4           // A task is late once it took this many times the expected time
+#define DP_SERVICE_TIME_SCALE       16          // Fixed point scale of Client.serviceTime
+#define DP_SERVICE_TIME_WEIGHT      8           // Moving average over roughly this many results
+#define DP_MAX_TASK_COPIES          2           // Clients that may work on the same task at once
+#define DP_MAX_SPECULATIVE_TASKS    DP_MAX_TASKS_PER_BATCH      // Late and tail tasks waiting for a second client
+#if DP_PUSH_COMPLETION
+#define DP_RESULTS_PER_REPLY        DP_MAX_TASKS_PER_BATCH      // Slaves hold results back until a batch is ready
+#else
+#define DP_RESULTS_PER_REPLY        1
+#endif
+
+#ifndef DP_TRACE
+#define DP_TRACE                    0           // 1: record a timeline of every task, dumped after the jobs for amdtp_shared/utils/dp_timeline.py, dp_sim builds with it
+#endif
+
+#ifndef DP_TRACE_LEN
+#define DP_TRACE_LEN                2048        // Events kept until the next dump, later ones are dropped and counted
+#endif
+
+#ifndef DP_TRACE_TIMESTAMP
+#define DP_TRACE_TIMESTAMP()        am_hal_stimer_counter_get()     // The STIMER also drives the FreeRTOS tick
+#define DP_TRACE_CLOCK_HZ           32768
+#endif
+#define DP_TRACE_IDLE_MS            3000        // The slave dumps its timeline once its worker was idle this long
+
+#ifndef DP_TUNE_TASK_SIZE
+#define DP_TUNE_TASK_SIZE           1           // 1: the master picks the task size of kernels with regroupTasks from what it measures
+#endif
+#define DP_TUNING_RESULTS           4           // Results measured before the task size is picked, and again after a client joined or left
+#define DP_TUNING_LINK_FACTOR       2           // A batch has to compute this many times as long as a packet takes over the slowest link
+
 
-typedef struct {
-    eDpPktType_t type;
-    eDpTaskStatus_t status;
-    uint16_t len;                    // Length of the data   
-    int taskId;
-    void *data;
-} distributedProtocolPacket_t;
 
 typedef struct {
     int taskId;
@@ -51,35 +174,103 @@ typedef struct {
     void *data;
     uint16_t dataLength;
     void *result;                             // Store the result of the task
+    uint8_t kernelId;                         // Kernel that executes the task
+    uint8_t jobId;                            // Job of the master the task belongs to, task ids of different jobs overlap
+    eDpPriority_t priority;                   // Of its job, the slave executes the most urgent task first
+    uint32_t execUs;                          // Time executeTask took, reported to the master with the result
     // Add any other task-related data here
 } Task;
 
+#define DP_MAX_KERNELS              8           // Job types one image can register
+#define DP_NO_KERNEL                0           // Kernel ids start at 1
+
+// Hooks of one type of distributed job, registered at start up with DpRegisterKernel.
+// The master runs up to DP_MAX_JOBS jobs at once, of different kernels since the master side of a kernel
+// holds one job's data. The slave executes every task with the kernel named in its packet,
+// so any registered job can follow or overtake another without reflashing.
+typedef struct {
+    uint8_t     id;                             // Sent in every packet header, the same on master and slaves
+    const char  *name;
+    // both, see dp_codec.h. Left out they are DP_ELEMENT_RAW
+    eDpElementType_t    taskDataType;
+    eDpElementType_t    operandType;
+    eDpElementType_t    resultType;
+    // both, bytes of the memory a task's data and result decode into, the master's and a slave slot's.
+    // A packet that decodes to more is malformed, 0 for a kernel whose tasks carry no data
+    uint16_t    taskDataSize;
+    uint16_t    resultSize;
+    // master
+    void        (*initClientTasks)(size_t *numTasks);
+    uint16_t    (*getTaskDataLength)(int taskId);
+    void        (*copyTaskDataToSendBuffer)(uint8_t *startOfData, int taskId);
+    void        *(*getTaskResult)(int taskId);
+    uint8_t     (*getTaskOperands)(int taskId, uint16_t *operandIds);     // Relays call it too, it may only depend on the task id
+    uint16_t    (*getOperandLength)(uint16_t operandId);
+    void        (*copyOperandToSendBuffer)(uint8_t *buffer, uint16_t operandId);
+    void        (*reassembleTaskResults)(size_t numTasksCompleted);
+    void        (*onTaskComplete)(int taskId, void *result);    // Optional, once per task as its first result arrives
+    uint16_t    (*getResultSize)(int taskId);                   // Optional, room at getTaskResult of a task that has less than resultSize
+    // master, optional: a kernel whose work can be cut into tasks of different sizes lets the master pick the size
+    // as the job runs, see DP_TUNE_TASK_SIZE. regroupTasks cuts the work of the tasks in taskIds, none of them sent,
+    // into tasks of at least taskWork where it can and overwrites taskIds with them, up to maxTasks
+    uint32_t    (*getTaskWork)(int taskId);                     // Work of a task, in tasks of the smallest size
+    size_t      (*regroupTasks)(uint32_t taskWork, uint16_t *taskIds, size_t numTasks, size_t maxTasks);
+    // slave
+    void        (*initServerTask)(Task *task, int slot);
+    void        (*storeOperand)(uint16_t operandId, uint8_t *data, uint16_t len);
+    // optional: where an operand decodes to and the bytes of room there, NULL for one the kernel keeps nowhere.
+    // The operand then arrives in place and storeOperand gets it there, it is not copied from a buffer of the protocol
+    void        *(*getOperandStorage)(uint16_t operandId, uint16_t *size);
+    void        (*executeTask)(Task *task);
+    // relay, optional: folds the result of another task of the same job into a result, in place. A relay then
+    // sends the results its children delivered up as one, and onTaskComplete gets NULL for the tasks folded in
+    void        (*combineResults)(void *result, const void *other);
+} DpKernel;
+
 
 // typedef void (*SendFunction)(uint8_t *buf, uint16_t len);
 
 typedef struct {
     dmConnId_t          connId;                 // Connection ID of the client
-    Task*               assignedTask;           // Task assigned to the client
-    SemaphoreHandle_t   receivedReplySem;       // Flag to indicate if the client has replied
-    StaticSemaphore_t   xSemaphoreBuffer;       // Semaphore structure
+    uint16_t            assignedTasks[DP_MAX_TASKS_PER_CLIENT];     // Ids of the tasks in flight on the client, oldest first
+    uint8_t             assignedJobs[DP_MAX_TASKS_PER_CLIENT];      // Job slot on the master of each of assignedTasks
+    TickType_t          assignedTime[DP_MAX_TASKS_PER_CLIENT];      // When each of assignedTasks was sent
+    uint8_t             numAssignedTasks;       // Number of valid entries in assignedTasks
+    uint8_t             numUnsentTasks;         // The newest of assignedTasks, a batch waiting for its operands to go out first
+    bool                awaitingReply;          // An ENQUIRY was sent and not answered yet
+    bool                txBusy;                 // The last packet sent to the client has not been acknowledged yet
+    bool                txRetry;                // The link refused the last packet without one of ours pending
+    TickType_t          nextPollTime;           // Earliest time to send the next ENQUIRY
+    TickType_t          lastHeardTime;          // Last time the client acknowledged or answered anything
+    TickType_t          lastCompletionTime;     // Last time the client delivered a result
+    TickType_t          sentTime;               // When the packet in flight was handed to the link
+    uint32_t            linkTime;               // Moving average of ticks until a packet is acknowledged, times DP_SERVICE_TIME_SCALE. 0 until measured
+    uint32_t            serviceTime;            // Moving average of ticks per task, transfer plus compute, times DP_SERVICE_TIME_SCALE. 0 until measured
+    uint32_t            workers;                // Slaves behind the client, as its last response reported, more than 1 for a relay
+    uint32_t            downstreamUs;           // Time a packet takes from the client to the slowest of them, 0 unless it is a relay
+    uint32_t            tasksCompleted;         // Results delivered since the client connected
+    uint8_t             missedReplies;          // Consecutive timeouts
+    uint16_t            foldedTasks[DP_MAX_TASKS_PER_CLIENT];       // Tasks a relay folded into the result of the next entry, until it arrives
+    uint8_t             foldedJob;              // Job slot of foldedTasks
+    uint8_t             numFoldedTasks;
+    uint8_t             cachedOperands[DP_MAX_JOBS][DP_MAX_OPERANDS / 8];   // Per job slot, bit set for every operand the client already holds
 } Client;
 
-// application layer to initialize tasks
-// sets the memory location for data and results
-// typedef void (*dp_initialize_tasks_t)(Task* tasks, size_t* numTasks);
-// typedef void (*dp_reassemble_task_results_t)(Task* tasks, size_t numTasksCompleted);
-
-void doDistributedTask();
+bool DpStartJob(uint8_t kernelId);
+bool DpStartJobWithPriority(uint8_t kernelId, eDpPriority_t priority);
+bool DpJobRunning(uint8_t kernelId);
+bool DpRegisterKernel(const DpKernel *kernel);
+const DpKernel *DpFindKernel(uint8_t kernelId);
+void DpPrintKernels();
 void initializeDistributedProtocol();
 void addConnectedClient(dmConnId_t connId);
 void removeConnectedClient(dmConnId_t connId);
 void DpRecvCb(uint8_t *buf, uint16_t len, dmConnId_t connId);
-
-extern void copyTaskDataToSendBuffer(uint8_t *startOfData, Task *task);
-extern void initServerTask(Task *task);
-extern void executeTask(Task *task);
-extern void initClientTasks(Task *tasks, size_t *numTasks);
-extern void reassembleTaskResults(Task *tasks, size_t numTasksCompleted);
+void DpTransCb(eAmdtpStatus_t status, dmConnId_t connId);
+uint32_t getClientServiceTimeUs(dmConnId_t connId);
+void printClientEstimates();
+uint16_t DpBuildPacket(uint8_t type, Task *task, uint8_t *buf, int bufSize);
+void DpTraceDump();
 
 
 extern TaskHandle_t distributionProtocolTaskHandle;
@@ -0,0 +1,440 @@
+#include "dp_codec.h"
+#include "dp_wire.h"
+#include <string.h>
+
+// writes encoded data, or only counts its bytes when buf is NULL
+typedef struct {
+    uint8_t     *buf;
+    uint32_t    len;
+    uint64_t    bits;                   // Packed bits not written yet
+    uint8_t     numBits;
+} codecWriter_t;
+
+typedef struct {
+    const uint8_t   *buf;
+    uint16_t        len;
+    uint16_t        offset;
+    uint64_t        bits;               // Packed bits not consumed yet
+    uint8_t         numBits;
+    bool            error;              // The data is cut off or malformed
+} codecReader_t;
+
+typedef void (*encoder_t)(codecWriter_t *w, eDpElementType_t type, const uint8_t *data, uint16_t len);
+
+uint8_t DpElementSize(eDpElementType_t type) {
+    switch (type) {
+    case DP_ELEMENT_INT16:
+        return 2;
+    case DP_ELEMENT_INT32:
+    case DP_ELEMENT_FLOAT:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * @brief Reads element i, integers sign extended, floats as their bits
+ */
+static uint32_t loadElement(eDpElementType_t type, const uint8_t *data, uint32_t i) {
+    int8_t value8;
+    int16_t value16;
+    uint32_t value32;
+
+    switch (type) {
+    case DP_ELEMENT_INT8:
+        memcpy(&value8, data + i, sizeof(value8));
+        return (uint32_t) (int32_t) value8;
+    case DP_ELEMENT_INT16:
+        memcpy(&value16, data + 2 * i, sizeof(value16));
+        return (uint32_t) (int32_t) value16;
+    default:
+        memcpy(&value32, data + 4 * i, sizeof(value32));
+        return value32;
+    }
+}
+
+static void storeElement(eDpElementType_t type, uint8_t *data, uint32_t i, uint32_t value) {
+    int8_t value8 = (int8_t) value;
+    int16_t value16 = (int16_t) value;
+
+    switch (type) {
+    case DP_ELEMENT_INT8:
+        memcpy(data + i, &value8, sizeof(value8));
+        break;
+    case DP_ELEMENT_INT16:
+        memcpy(data + 2 * i, &value16, sizeof(value16));
+        break;
+    default:
+        memcpy(data + 4 * i, &value, sizeof(value));
+        break;
+    }
+}
+
+static uint32_t zigzag(uint32_t value) {
+    return (value << 1) ^ (uint32_t) ((int32_t) value >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value) {
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+/**
+ * @brief Bits needed for an unsigned value
+ */
+static uint8_t bitWidth(uint32_t value) {
+    uint8_t width = 0;
+    while (value != 0) {
+        value >>= 1;
+        width++;
+    }
+    return width;
+}
+
+static void putByte(codecWriter_t *w, uint8_t value) {
+    if (w->buf != NULL) {
+        w->buf[w->len] = value;
+    }
+    w->len++;
+}
+
+static void putVarint(codecWriter_t *w, uint32_t value) {
+    if (w->buf != NULL) {
+        w->len += DpWirePutVarint(w->buf + w->len, value);
+    } else {
+        w->len += DpWireVarintSize(value);
+    }
+}
+
+static void putBits(codecWriter_t *w, uint32_t value, uint8_t width) {
+    w->bits |= (uint64_t) value << w->numBits;
+    w->numBits += width;
+    while (w->numBits >= 8) {
+        putByte(w, (uint8_t) w->bits);
+        w->bits >>= 8;
+        w->numBits -= 8;
+    }
+}
+
+static void flushBits(codecWriter_t *w) {
+    if (w->numBits > 0) {
+        putByte(w, (uint8_t) w->bits);
+    }
+    w->bits = 0;
+    w->numBits = 0;
+}
+
+static uint8_t getByte(codecReader_t *r) {
+    if (r->offset >= r->len) {
+        r->error = true;
+        return 0;
+    }
+    return r->buf[r->offset++];
+}
+
+static uint32_t getVarint(codecReader_t *r) {
+    uint32_t value = 0;
+    uint8_t size = DpWireGetVarint(r->buf + r->offset, r->len - r->offset, &value);
+
+    if (size == 0) {
+        r->error = true;
+    }
+    r->offset += size;
+    return value;
+}
+
+static uint32_t getBits(codecReader_t *r, uint8_t width) {
+    while (r->numBits < width && !r->error) {
+        r->bits |= (uint64_t) getByte(r) << r->numBits;
+        r->numBits += 8;
+    }
+    uint32_t value = (uint32_t) (r->bits & (((uint64_t) 1 << width) - 1));
+    r->bits >>= width;
+    r->numBits -= width;
+    return value;
+}
+
+static void encodeRaw(codecWriter_t *w, eDpElementType_t type, const uint8_t *data, uint16_t len) {
+    putByte(w, DP_ENCODING_RAW);
+    if (w->buf != NULL) {
+        memcpy(w->buf + w->len, data, len);
+    }
+    w->len += len;
+}
+
+static void encodeVarint(codecWriter_t *w, eDpElementType_t type, const uint8_t *data, uint16_t len) {
+    uint32_t count = len / DpElementSize(type);
+
+    putByte(w, DP_ENCODING_VARINT);
+    for (uint32_t i = 0; i < count; i++) {
+        putVarint(w, zigzag(loadElement(type, data, i)));
+    }
+}
+
+/**
+ * @brief Packs count elements from element first on, relative to the smallest of them.
+ *        With delta set the values packed are the differences to the element before.
+ */
+static void packValues(codecWriter_t *w, eDpElementType_t type, const uint8_t *data, uint32_t first, uint32_t count, bool delta) {
+    int32_t min = INT32_MAX;
+    int32_t max = INT32_MIN;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        int32_t value = (int32_t) (loadElement(type, data, i) - (delta ? loadElement(type, data, i - 1) : 0));
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+    if (count == 0) {
+        min = max = 0;
+    }
+
+    uint8_t width = bitWidth((uint32_t) max - (uint32_t) min);
+    putByte(w, width);
+    putVarint(w, zigzag((uint32_t) min));
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t value = loadElement(type, data, i) - (delta ? loadElement(type, data, i - 1) : 0);
+        putBits(w, value - (uint32_t) min, width);
+    }
+    flushBits(w);
+}
+
+static void encodeBitpack(codecWriter_t *w, eDpElementType_t type, const uint8_t *data, uint16_t len) {
+    uint32_t count = len / DpElementSize(type);
+
+    putByte(w, DP_ENCODING_BITPACK);
+    putVarint(w, count);
+    packValues(w, type, data, 0, count, false);
+}
+
+static void encodeDelta(codecWriter_t *w, eDpElementType_t type, const uint8_t *data, uint16_t len) {
+    uint32_t count = len / DpElementSize(type);
+
+    putByte(w, DP_ENCODING_DELTA);
+    putVarint(w, count);
+    putVarint(w, zigzag(loadElement(type, data, 0)));
+    packValues(w, type, data, 1, count - 1, true);
+}
+
+static void encodeZeroRun(codecWriter_t *w, eDpElementType_t type, const uint8_t *data, uint16_t len) {
+    uint8_t elementSize = DpElementSize(type);
+    uint32_t count = len / elementSize;
+    uint32_t i = 0;
+
+    putByte(w, DP_ENCODING_ZERO_RUN);
+    putVarint(w, count);
+    while (i < count) {
+        uint32_t start = i;
+        while (i < count && loadElement(type, data, i) == 0) {
+            i++;
+        }
+        putVarint(w, i - start);
+        if (i == count) {
+            break;
+        }
+
+        start = i;
+        while (i < count && loadElement(type, data, i) != 0) {
+            i++;
+        }
+        putVarint(w, i - start);
+        for (uint32_t k = start; k < i; k++) {
+            if (type == DP_ELEMENT_FLOAT) {
+                for (uint8_t b = 0; b < elementSize; b++) {
+                    putByte(w, data[k * elementSize + b]);
+                }
+            } else {
+                putVarint(w, zigzag(loadElement(type, data, k)));
+            }
+        }
+    }
+}
+
+static const encoder_t encoders[DP_ENCODING_MAX] = {
+    [DP_ENCODING_RAW] = encodeRaw,
+    [DP_ENCODING_VARINT] = encodeVarint,
+    [DP_ENCODING_BITPACK] = encodeBitpack,
+    [DP_ENCODING_DELTA] = encodeDelta,
+    [DP_ENCODING_ZERO_RUN] = encodeZeroRun,
+};
+
+/**
+ * @brief Tries every encoding the element type allows and keeps the shortest
+ *
+ * @param size Set to the encoded size
+ */
+static eDpEncoding_t pickEncoding(eDpElementType_t type, const uint8_t *data, uint16_t len, uint32_t *size) {
+    eDpEncoding_t best = DP_ENCODING_RAW;
+    *size = 1 + len;
+
+    if (len % DpElementSize(type) != 0) {
+        return best;                                // Not whole elements, sent as they are
+    }
+
+    for (eDpEncoding_t encoding = DP_ENCODING_VARINT; encoding < DP_ENCODING_MAX; encoding++) {
+        if (type == DP_ELEMENT_FLOAT && encoding != DP_ENCODING_ZERO_RUN) {
+            continue;                               // The bits of a float do not pack
+        }
+        codecWriter_t w = { .buf = NULL };
+        encoders[encoding](&w, type, data, len);
+        if (w.len < *size) {
+            best = encoding;
+            *size = w.len;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Picks the shortest encoding of the data, DpCodecEncodePicked writes it
+ *
+ * @param type The element type the kernel declared for the data
+ * @param data The data as it is in memory
+ * @param len The length of the data
+ */
+dpCodecPick_t DpCodecPick(eDpElementType_t type, const uint8_t *data, uint16_t len) {
+    dpCodecPick_t pick = { .encoding = DP_ENCODING_RAW, .size = len };
+    uint32_t size;
+
+    if (type == DP_ELEMENT_RAW || len == 0) {
+        return pick;                                // Sent as they are, without an ENCODING byte
+    }
+    pick.encoding = pickEncoding(type, data, len, &size);
+    pick.size = (uint16_t) size;
+    return pick;
+}
+
+/**
+ * @brief Writes the data in the encoding DpCodecPick picked for it
+ *
+ * @param buf The buffer to write to, needs room for pick.size bytes
+ *
+ * @return The number of bytes written, pick.size
+ */
+uint16_t DpCodecEncodePicked(eDpElementType_t type, dpCodecPick_t pick, const uint8_t *data, uint16_t len, uint8_t *buf) {
+    if (type == DP_ELEMENT_RAW || len == 0) {
+        memcpy(buf, data, len);
+        return len;
+    }
+
+    codecWriter_t w = { .buf = buf };
+    encoders[pick.encoding](&w, type, data, len);
+    return (uint16_t) w.len;
+}
+
+/**
+ * @brief Returns the number of bytes DpCodecEncode writes for the data
+ */
+uint16_t DpCodecEncodedSize(eDpElementType_t type, const uint8_t *data, uint16_t len) {
+    return DpCodecPick(type, data, len).size;
+}
+
+/**
+ * @brief Writes the data in its shortest encoding
+ *
+ * @param buf The buffer to write to, needs room for DpCodecEncodedSize bytes
+ *
+ * @return The number of bytes written
+ */
+uint16_t DpCodecEncode(eDpElementType_t type, const uint8_t *data, uint16_t len, uint8_t *buf) {
+    return DpCodecEncodePicked(type, DpCodecPick(type, data, len), data, len, buf);
+}
+
+/**
+ * @brief Decodes data written by DpCodecEncode
+ *
+ * @param type The element type the kernel declared for the data
+ * @param buf The encoded data
+ * @param len The length of the encoded data
+ * @param data The buffer to decode into
+ * @param dataSize The size of that buffer
+ * @param dataLen Set to the length of the decoded data
+ *
+ * @return false if the data is malformed or does not fit
+ */
+bool DpCodecDecode(eDpElementType_t type, const uint8_t *buf, uint16_t len, uint8_t *data, uint16_t dataSize, uint16_t *dataLen) {
+    codecReader_t r = { .buf = buf, .len = len, .offset = 1 };
+    uint8_t elementSize = DpElementSize(type);
+    uint32_t count = 0;
+
+    if (type == DP_ELEMENT_RAW || len == 0 || buf[0] == DP_ENCODING_RAW) {
+        uint16_t offset = (type == DP_ELEMENT_RAW || len == 0) ? 0 : 1;
+        if (len - offset > dataSize) {
+            return false;
+        }
+        memcpy(data, buf + offset, len - offset);
+        *dataLen = len - offset;
+        return true;
+    }
+
+    if (buf[0] == DP_ENCODING_VARINT) {
+        while (r.offset < len && !r.error) {
+            if (count >= dataSize / elementSize) {
+                return false;
+            }
+            storeElement(type, data, count++, unzigzag(getVarint(&r)));
+        }
+    } else if (buf[0] == DP_ENCODING_BITPACK || buf[0] == DP_ENCODING_DELTA) {
+        bool delta = (buf[0] == DP_ENCODING_DELTA);
+        uint32_t value = 0;
+        uint32_t i = 0;
+
+        count = getVarint(&r);
+        if (count > dataSize / elementSize || (delta && count == 0)) {
+            return false;
+        }
+        if (delta) {
+            value = unzigzag(getVarint(&r));
+            storeElement(type, data, i++, value);
+        }
+        uint8_t width = getByte(&r);
+        uint32_t base = unzigzag(getVarint(&r));
+        if (width > 32) {
+            return false;
+        }
+        for (; i < count && !r.error; i++) {
+            uint32_t packed = getBits(&r, width) + base;
+            value = delta ? value + packed : packed;
+            storeElement(type, data, i, value);
+        }
+    } else if (buf[0] == DP_ENCODING_ZERO_RUN) {
+        uint32_t i = 0;
+
+        count = getVarint(&r);
+        if (count > dataSize / elementSize) {
+            return false;
+        }
+        while (i < count && !r.error) {
+            uint32_t zeros = getVarint(&r);
+            if (zeros > count - i) {
+                return false;
+            }
+            memset(data + i * elementSize, 0, zeros * elementSize);
+            i += zeros;
+            if (i == count) {
+                break;
+            }
+
+            uint32_t literals = getVarint(&r);
+            if (literals > count - i) {
+                return false;
+            }
+            for (; literals > 0 && !r.error; literals--, i++) {
+                if (type == DP_ELEMENT_FLOAT) {
+                    for (uint8_t b = 0; b < elementSize; b++) {
+                        data[i * elementSize + b] = getByte(&r);
+                    }
+                } else {
+                    storeElement(type, data, i, unzigzag(getVarint(&r)));
+                }
+            }
+        }
+    } else {
+        return false;                               // Unknown encoding
+    }
+
+    if (r.error || r.offset != len) {
+        return false;
+    }
+    *dataLen = (uint16_t) (count * elementSize);
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef DP_CODEC_H
+#define DP_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "distributed_protocol.h"
+
+// Encoding of the task data, operands and results of a kernel that declares their element type.
+// The elements are read as they are in memory, little endian like both targets. The data of an
+// entry is empty or starts with an ENCODING byte, the encoder takes the shortest one the element
+// type allows and falls back to RAW:
+//
+//   RAW        : ENCODING + the elements as they are
+//   VARINT     : ENCODING + a zigzag varint per element, up to the end of the data
+//   BITPACK    : ENCODING + COUNT + WIDTH (1 byte) + BASE + COUNT * (element - BASE) in WIDTH bits
+//   DELTA      : ENCODING + COUNT + FIRST + WIDTH (1 byte) + BASE + (COUNT - 1) * (element - previous - BASE) in WIDTH bits
+//   ZERO_RUN   : ENCODING + COUNT + runs of ZEROS + LITERALS + LITERALS * element, the last run may stop after ZEROS
+//
+// COUNT, ZEROS and LITERALS are varints, BASE and FIRST zigzag varints. Packed bits fill each byte
+// from its least significant bit and the last byte is padded with zeros. Floats are only sent RAW
+// or ZERO_RUN, with their literals as they are.
+
+typedef enum eDpEncoding {
+    DP_ENCODING_RAW,
+    DP_ENCODING_VARINT,                 // Small values
+    DP_ENCODING_BITPACK,                // Values in a narrow range
+    DP_ENCODING_DELTA,                  // Values that change slowly, such as counters and samples
+    DP_ENCODING_ZERO_RUN,               // Sparse data
+    DP_ENCODING_MAX
+} eDpEncoding_t;
+
+#define DP_MAX_DECODED_SIZE     AMDTP_MAX_PAYLOAD_SIZE      // Longest task data, operand or result once decoded
+
+// the encoding DpCodecPick found shortest for some data, sizing a packet and writing it then take no second search
+typedef struct {
+    uint8_t     encoding;               // eDpEncoding_t
+    uint16_t    size;                   // Bytes DpCodecEncodePicked writes
+} dpCodecPick_t;
+
+uint8_t DpElementSize(eDpElementType_t type);
+dpCodecPick_t DpCodecPick(eDpElementType_t type, const uint8_t *data, uint16_t len);
+uint16_t DpCodecEncodePicked(eDpElementType_t type, dpCodecPick_t pick, const uint8_t *data, uint16_t len, uint8_t *buf);
+uint16_t DpCodecEncodedSize(eDpElementType_t type, const uint8_t *data, uint16_t len);
+uint16_t DpCodecEncode(eDpElementType_t type, const uint8_t *data, uint16_t len, uint8_t *buf);
+bool DpCodecDecode(eDpElementType_t type, const uint8_t *buf, uint16_t len, uint8_t *data, uint16_t dataSize, uint16_t *dataLen);
+
+#endif // DP_CODEC_H
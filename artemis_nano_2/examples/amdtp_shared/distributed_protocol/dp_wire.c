@@ -0,0 +1,223 @@
+#include "dp_wire.h"
+
+/**
+ * @brief Returns the number of bytes DpWirePutVarint needs for a value
+ */
+uint8_t DpWireVarintSize(uint32_t value) {
+    uint8_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Writes a value as a varint
+ *
+ * @param buf The buffer to write to, needs room for DpWireVarintSize(value) bytes
+ * @param value The value
+ *
+ * @return The number of bytes written
+ */
+uint8_t DpWirePutVarint(uint8_t *buf, uint32_t value) {
+    uint8_t size = 0;
+    while (value >= 0x80) {
+        buf[size++] = (uint8_t) (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buf[size++] = (uint8_t) value;
+    return size;
+}
+
+/**
+ * @brief Reads a varint
+ *
+ * @param buf The buffer to read from
+ * @param len The number of bytes left in the buffer
+ * @param value Set to the value read
+ *
+ * @return The number of bytes read, 0 if the varint is cut off or too long
+ */
+uint8_t DpWireGetVarint(const uint8_t *buf, uint16_t len, uint32_t *value) {
+    uint32_t result = 0;
+
+    for (uint8_t i = 0; i < len && i < DP_WIRE_MAX_VARINT_SIZE; i++) {
+        if (i == DP_WIRE_MAX_VARINT_SIZE - 1 && (buf[i] & 0x70) != 0) {
+            return 0;                       // Bits beyond 32, not a uint32_t
+        }
+        result |= (uint32_t) (buf[i] & 0x7F) << (7 * i);
+        if ((buf[i] & 0x80) == 0) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+uint16_t DpWireEncodeHeader(uint8_t *buf, const dpWireHeader_t *header) {
+    buf[0] = (DP_WIRE_VERSION << 4) | (header->type & 0x0F);
+    buf[1] = header->kernelId;
+    buf[2] = (header->jobId << 2) | (header->priority & 0x03);
+    return DP_WIRE_HEADER_SIZE;
+}
+
+/**
+ * @brief Reads the packet header
+ *
+ * @param header Set to the header, the kernel and the job are not checked against the ones this node knows
+ *
+ * @return The size of the header, 0 if the packet is too short, from another protocol version, of an unknown type
+ *         or without a job
+ */
+uint16_t DpWireDecodeHeader(const uint8_t *buf, uint16_t len, dpWireHeader_t *header) {
+    if (len < DP_WIRE_HEADER_SIZE || (buf[0] >> 4) != DP_WIRE_VERSION) {
+        return 0;
+    }
+
+    header->type = (eDpPktType_t) (buf[0] & 0x0F);
+    if (header->type == DP_PKT_TYPE_UNKNOWN || header->type >= DP_PKT_TYPE_MAX) {
+        return 0;
+    }
+    header->kernelId = buf[1];
+    header->jobId = buf[2] >> 2;
+    header->priority = (eDpPriority_t) (buf[2] & 0x03);
+    if (header->jobId == DP_NO_JOB || header->priority >= DP_PRIORITY_MAX) {
+        return 0;
+    }
+    return DP_WIRE_HEADER_SIZE;
+}
+
+/**
+ * @brief Writes the report a response carries after its header
+ *
+ * @param buf The buffer to write to, needs room for DP_WIRE_MAX_REPORT_SIZE bytes
+ *
+ * @return The number of bytes written
+ */
+uint16_t DpWireEncodeReport(uint8_t *buf, const dpWireReport_t *report) {
+    uint16_t offset = DpWirePutVarint(buf, report->execUs);
+    offset += DpWirePutVarint(buf + offset, report->workers);
+    offset += DpWirePutVarint(buf + offset, report->linkUs);
+    return offset;
+}
+
+/**
+ * @brief Reads the report of a response
+ *
+ * @return The size of the report, 0 if it is cut off or names no worker
+ */
+uint16_t DpWireDecodeReport(const uint8_t *buf, uint16_t len, dpWireReport_t *report) {
+    uint16_t offset = 0;
+    uint8_t size;
+
+    if ((size = DpWireGetVarint(buf, len, &report->execUs)) == 0) {
+        return 0;
+    }
+    offset += size;
+    if ((size = DpWireGetVarint(buf + offset, len - offset, &report->workers)) == 0 || report->workers == 0) {
+        return 0;
+    }
+    offset += size;
+    if ((size = DpWireGetVarint(buf + offset, len - offset, &report->linkUs)) == 0) {
+        return 0;
+    }
+    return offset + size;
+}
+
+/**
+ * @brief Batch packets carry a COUNT after the header, the others a single entry
+ */
+bool DpWireIsBatch(eDpPktType_t type) {
+    return type == DP_PKT_TYPE_NEW_TASK_BATCH || type == DP_PKT_TYPE_RESPONSE_BATCH || type == DP_PKT_TYPE_OPERAND;
+}
+
+static bool hasLen(eDpPktType_t type) {
+    return type != DP_PKT_TYPE_ENQUIRY;
+}
+
+static bool hasStatus(eDpPktType_t type) {
+    return type == DP_PKT_TYPE_RESPONSE || type == DP_PKT_TYPE_RESPONSE_BATCH;
+}
+
+/**
+ * @brief Returns the size of an entry on the wire, including its data
+ *
+ * @param type The type of the packet the entry is in
+ * @param entry The entry
+ */
+uint16_t DpWireEntrySize(eDpPktType_t type, const dpWireEntry_t *entry) {
+    uint16_t size = DpWireVarintSize(entry->id);
+    if (hasLen(type)) {
+        size += DpWireVarintSize(entry->len) + entry->len;
+    }
+    if (hasStatus(type)) {
+        size += DP_WIRE_STATUS_SIZE;
+    }
+    return size;
+}
+
+/**
+ * @brief Writes the header of an entry, the caller writes entry->len bytes of data right after it
+ *
+ * @return The number of bytes written
+ */
+uint16_t DpWireEncodeEntry(uint8_t *buf, eDpPktType_t type, const dpWireEntry_t *entry) {
+    uint16_t offset = DpWirePutVarint(buf, entry->id);
+    if (hasLen(type)) {
+        offset += DpWirePutVarint(buf + offset, entry->len);
+    }
+    if (hasStatus(type)) {
+        buf[offset++] = (uint8_t) entry->status | (entry->folded ? DP_WIRE_STATUS_FOLDED : 0);
+    }
+    return offset;
+}
+
+/**
+ * @brief Reads the header of an entry and checks that its data is in the buffer
+ *
+ * @param buf The start of the entry
+ * @param len The number of bytes left in the packet
+ * @param type The type of the packet the entry is in
+ * @param entry Set to the entry read, its data starts at buf plus the returned size
+ *
+ * @return The size of the entry header, 0 if the entry is malformed or cut off
+ */
+uint16_t DpWireDecodeEntry(const uint8_t *buf, uint16_t len, eDpPktType_t type, dpWireEntry_t *entry) {
+    uint32_t value;
+    uint8_t size;
+    uint16_t offset;
+
+    if ((offset = DpWireGetVarint(buf, len, &entry->id)) == 0) {
+        return 0;
+    }
+
+    entry->len = 0;
+    if (hasLen(type)) {
+        if ((size = DpWireGetVarint(buf + offset, len - offset, &value)) == 0 || value > UINT16_MAX) {
+            return 0;
+        }
+        entry->len = (uint16_t) value;
+        offset += size;
+    }
+
+    entry->status = DP_TASK_STATUS_UNKNOWN;
+    entry->folded = false;
+    if (hasStatus(type)) {
+        if (offset + DP_WIRE_STATUS_SIZE > len) {
+            return 0;
+        }
+        entry->folded = (buf[offset] & DP_WIRE_STATUS_FOLDED) != 0;
+        entry->status = (eDpTaskStatus_t) (buf[offset++] & ~DP_WIRE_STATUS_FOLDED);
+        // only a finished result can be part of another, and it brings no data of its own
+        if (entry->status >= DP_TASK_STATUS_MAX
+            || (entry->folded && (entry->status != DP_TASK_STATUS_COMPLETE || entry->len != 0))) {
+            return 0;
+        }
+    }
+
+    if (offset + entry->len > len) {
+        return 0;
+    }
+    return offset;
+}
@@ -0,0 +1,80 @@
+#ifndef DP_WIRE_H
+#define DP_WIRE_H
+
+#include <stdint.h>
+#include "distributed_protocol.h"
+
+// Wire format of the distributed protocol, independent of compiler and target.
+// Ids, lengths and counts are unsigned LEB128 varints: 7 bits per byte, least significant
+// group first, the top bit set on every byte but the last.
+//
+//   HEADER           : VERSION << 4 | TYPE (1 byte) + KERNEL_ID (1 byte) + JOB_ID << 2 | PRIORITY (1 byte)
+//   NEW_TASK         : HEADER + TASK_ID + LEN + DATA
+//   RESPONSE         : HEADER + REPORT + TASK_ID + LEN + STATUS (1 byte) + DATA
+//   ENQUIRY          : HEADER + TASK_ID
+//   NEW_TASK_BATCH   : HEADER + COUNT + COUNT * (TASK_ID + LEN + DATA)
+//   RESPONSE_BATCH   : HEADER + REPORT + COUNT + COUNT * (TASK_ID + LEN + STATUS + DATA)
+//   OPERAND          : HEADER + COUNT + COUNT * (OPERAND_ID + LEN + DATA)
+//   REPORT           : EXEC_US + WORKERS + LINK_US
+//
+// DATA is encoded as described in dp_codec.h when the kernel declares its element types,
+// LEN is its length on the wire. JOB_ID tells apart the jobs the master runs at once, task
+// and operand ids are per job. PRIORITY is the eDpPriority_t of the job. EXEC_US is the time
+// the slave spent executing the tasks whose results the response carries, 0 if it has none.
+// STATUS is the eDpTaskStatus_t of the task, with DP_WIRE_STATUS_FOLDED set on a COMPLETE
+// result a relay folded into the result of the next entry that carries data, see
+// DpKernel.combineResults. A folded entry carries no data of its own.
+// WORKERS is the number of slaves that compute the tasks sent to it, 1 unless it is a relay,
+// LINK_US how long a packet takes from it to the slowest of them, 0 unless it is a relay.
+
+#define DP_WIRE_VERSION                 6
+#define DP_WIRE_HEADER_SIZE             3
+#define DP_WIRE_MAX_JOB_ID              63      // The 6 bits above the priority
+#define DP_WIRE_STATUS_SIZE             1
+#define DP_WIRE_STATUS_FOLDED           0x80    // Flag in STATUS, the result is part of the next one with data
+#define DP_WIRE_MAX_VARINT_SIZE         5       // uint32_t
+#define DP_WIRE_MAX_LEN_SIZE            3       // uint16_t
+#define DP_WIRE_MAX_ENTRY_HEADER_SIZE   (DP_WIRE_MAX_VARINT_SIZE + DP_WIRE_MAX_LEN_SIZE + DP_WIRE_STATUS_SIZE)
+#define DP_WIRE_MAX_BATCH_HEADER_SIZE   (DP_WIRE_HEADER_SIZE + DP_WIRE_MAX_LEN_SIZE)
+#define DP_WIRE_MAX_REPORT_SIZE         (3 * DP_WIRE_MAX_VARINT_SIZE)
+#define DP_WIRE_MAX_RESPONSE_HEADER_SIZE (DP_WIRE_MAX_BATCH_HEADER_SIZE + DP_WIRE_MAX_REPORT_SIZE)
+
+// The header every packet starts with
+typedef struct {
+    eDpPktType_t        type;
+    uint8_t             kernelId;
+    uint8_t             jobId;                  // 1 to DP_WIRE_MAX_JOB_ID
+    eDpPriority_t       priority;
+} dpWireHeader_t;
+
+// One task, result or operand as it appears on the wire, without its data
+typedef struct {
+    uint32_t            id;                     // Task id, or operand id in OPERAND packets
+    uint16_t            len;                    // Length of the data that follows the entry
+    eDpTaskStatus_t     status;                 // Only sent in responses
+    bool                folded;                 // Only in responses, the result is part of the next entry with data
+} dpWireEntry_t;
+
+// What a slave tells the master about itself in every response
+typedef struct {
+    uint32_t            execUs;                 // Time spent executing the tasks of the response
+    uint32_t            workers;                // Slaves computing the tasks sent to it, itself or a relay's children
+    uint32_t            linkUs;                 // Time a packet takes from it to the slowest of them
+} dpWireReport_t;
+
+uint8_t DpWireVarintSize(uint32_t value);
+uint8_t DpWirePutVarint(uint8_t *buf, uint32_t value);
+uint8_t DpWireGetVarint(const uint8_t *buf, uint16_t len, uint32_t *value);
+
+uint16_t DpWireEncodeHeader(uint8_t *buf, const dpWireHeader_t *header);
+uint16_t DpWireDecodeHeader(const uint8_t *buf, uint16_t len, dpWireHeader_t *header);
+
+uint16_t DpWireEncodeReport(uint8_t *buf, const dpWireReport_t *report);
+uint16_t DpWireDecodeReport(const uint8_t *buf, uint16_t len, dpWireReport_t *report);
+
+bool DpWireIsBatch(eDpPktType_t type);
+uint16_t DpWireEntrySize(eDpPktType_t type, const dpWireEntry_t *entry);
+uint16_t DpWireEncodeEntry(uint8_t *buf, eDpPktType_t type, const dpWireEntry_t *entry);
+uint16_t DpWireDecodeEntry(const uint8_t *buf, uint16_t len, eDpPktType_t type, dpWireEntry_t *entry);
+
+#endif // DP_WIRE_H
@@ -1,71 +1,47 @@
 #include "distributed_sum.h"
 #include "am_util_debug.h"
 #include "am_util_stdio.h"
-#include "FreeRTOS.h"
-#include "task.h"
 
-int randomData[APP_TASK_COUNT];
-int resultData[APP_TASK_COUNT];
+// sums ten times every element, the slaves add up their ranges and only the partial sums come back
+int randomData[DISTRIBUTED_SUM_ELEMENT_COUNT];
+int sumOfAllTasks;                  // Result of the last job
 
 
-void initClientTasks(Task *tasks, size_t *numTasks) {
-    
-    *numTasks = APP_TASK_COUNT;
+static const void *initInput(size_t *numElements) {
+    *numElements = DISTRIBUTED_SUM_ELEMENT_COUNT;
 
-    for (int i = 0; i < APP_TASK_COUNT; i++) {
-        tasks[i].data = &randomData[i];
+    for (int i = 0; i < DISTRIBUTED_SUM_ELEMENT_COUNT; i++) {
         randomData[i] = i;
-        tasks[i].dataLength = sizeof(int);
-        tasks[i].result = &resultData[i];
     }
+    return randomData;
 }
 
-void initServerTask(Task *task) {
-    task->data = &randomData[0];
-    task->dataLength = sizeof(int);
-    task->result = &resultData[0];
+static void identity(void *aggregate) {
+    *(int *) aggregate = 0;
 }
 
-void copyTaskDataToSendBuffer(uint8_t *buffer, Task *task) {
-    am_util_stdio_printf("Copying task data to send buffer\n");
-    memcpy(buffer, task->data, task->dataLength);
+static void map(const void *element, void *value) {
+    *(int *) value = *(const int *) element * 10;
 }
 
-void reassembleTaskResults(Task *tasks, size_t numTasks) {
-    if (numTasks < APP_TASK_COUNT) {
-        am_util_debug_printf("Not all tasks are complete...\n");
-    }
-
-    int sum = 0;
-
-    am_util_stdio_printf("Summing all tasks...\n");
-    for (int i = 0; i < numTasks; i++) {
-        sum += *((int *) tasks[i].result);
-    }
-
-    am_util_stdio_printf("Sum of all tasks: %d\n", sum);
+static void combine(void *aggregate, const void *value) {
+    *(int *) aggregate += *(const int *) value;
 }
 
-void executeTask(Task *task) {
-    am_util_stdio_printf("Executing task %d\n", task->taskId);
-    int *data = (int *) task->data;
-    // am_util_debug_printf("successfully declared *data %x\n", data);
-    am_util_debug_printf("value of *data %d\n", *data);
-
-    int *result = (int *) task->result;
-    // am_util_debug_printf("successfully declared *result  %x\n", result);
-
-
-    *result = 0;
-    // am_util_debug_printf("successfully assigned *result again  %x\n", result);
-
-    *result = *data * 10;
-    // am_util_debug_printf("entering delay\n");
-    vTaskDelay(1000);
+static void onResult(const void *aggregate) {
+    sumOfAllTasks = *(const int *) aggregate;
+    am_util_stdio_printf("Sum of all tasks: %d\n", sumOfAllTasks);
+}
 
-    // am_util_debug_printf("exiting delay\n");
-    task->status = DP_TASK_STATUS_COMPLETE;
-    distributionProtocolTaskHandle = NULL;
-    am_util_stdio_printf("Task complete, result = %d\n", *result);
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+static const DpMapReduce sumJob = {
+    .elementSize = sizeof(int),
+    .aggregateSize = sizeof(int),
+    .initInput = initInput,
+    .onResult = onResult,
+    .identity = identity,
+    .map = map,
+    .combine = combine,
+};
+
+DP_MAP_REDUCE_KERNEL(distributedSumKernel, DISTRIBUTED_SUM_KERNEL_ID, "Distributed sum", sumJob,
+                     DP_ELEMENT_INT32, DP_ELEMENT_INT32);
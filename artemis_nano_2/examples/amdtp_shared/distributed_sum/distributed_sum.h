@@ -1,3 +1,7 @@
-#include "distributed_protocol.h"
+#include "map_reduce.h"
 
-#define APP_TASK_COUNT 3
\ No newline at end of file
+#define DISTRIBUTED_SUM_ELEMENT_COUNT 2048
+
+#define DISTRIBUTED_SUM_KERNEL_ID 2
+
+extern const DpKernel distributedSumKernel;
@@ -0,0 +1,160 @@
+#include "dsp_kernels.h"
+#include "am_mcu_apollo.h"          // CMSIS core of the M4, __SMLAD and the other DSP intrinsics
+#include <string.h>
+
+#define DP_DSP_ONES                 0x00010001  // 1 in both 16-bit lanes, SMLAD with it adds the lanes
+
+/**
+ * @brief Loads two q15 or four q7 elements as one word, compiles to a single LDR
+ */
+static inline uint32_t loadWord(const void *p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+int32_t DpDspDotQ7(const int8_t *a, const int8_t *b, uint32_t len) {
+    uint32_t acc = 0;
+    uint32_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        uint32_t wordA = loadWord(a + i);
+        uint32_t wordB = loadWord(b + i);
+        acc = __SMLAD(__SXTB16(wordA), __SXTB16(wordB), acc);                       // Elements 0 and 2
+        acc = __SMLAD(__SXTB16(__ROR(wordA, 8)), __SXTB16(__ROR(wordB, 8)), acc);   // Elements 1 and 3
+    }
+    for (; i < len; i++) {
+        acc += (uint32_t) (a[i] * b[i]);
+    }
+    return (int32_t) acc;
+}
+
+int32_t DpDspDotQ15(const int16_t *a, const int16_t *b, uint32_t len) {
+    uint32_t acc = 0;
+    uint32_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        acc = __SMLAD(loadWord(a + i), loadWord(b + i), acc);
+        acc = __SMLAD(loadWord(a + i + 2), loadWord(b + i + 2), acc);
+    }
+    for (; i < len; i++) {
+        acc += (uint32_t) (a[i] * b[i]);
+    }
+    return (int32_t) acc;
+}
+
+int64_t DpDspDotQ15Long(const int16_t *a, const int16_t *b, uint32_t len) {
+    uint64_t acc = 0;
+    uint32_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        acc = __SMLALD(loadWord(a + i), loadWord(b + i), acc);
+        acc = __SMLALD(loadWord(a + i + 2), loadWord(b + i + 2), acc);
+    }
+    for (; i < len; i++) {
+        acc += (uint64_t) (int64_t) (a[i] * b[i]);
+    }
+    return (int64_t) acc;
+}
+
+/**
+ * @brief C = A B for q15 matrices, A given by rows and B by columns, so both are read along the depth.
+ *        A tile of 2x2 results shares every load between two SMLADs.
+ *
+ * @param rows Rows of A and C
+ * @param cols Columns of B and C
+ * @param depth Columns of A, rows of B
+ * @param a A, row i starts at a + i * lda
+ * @param bT B, column j starts at bT + j * ldb
+ * @param c C, row i starts at c + i * ldc
+ */
+void DpDspGemmQ15(uint32_t rows, uint32_t cols, uint32_t depth, const int16_t *a, uint32_t lda,
+                  const int16_t *bT, uint32_t ldb, int32_t *c, uint32_t ldc) {
+    uint32_t i = 0;
+
+    for (; i + 2 <= rows; i += 2) {
+        const int16_t *a0 = a + i * lda;
+        const int16_t *a1 = a0 + lda;
+        uint32_t j = 0;
+
+        for (; j + 2 <= cols; j += 2) {
+            const int16_t *b0 = bT + j * ldb;
+            const int16_t *b1 = b0 + ldb;
+            uint32_t c00 = 0, c01 = 0, c10 = 0, c11 = 0;
+            uint32_t p = 0;
+
+            for (; p + 2 <= depth; p += 2) {
+                uint32_t wordA0 = loadWord(a0 + p);
+                uint32_t wordA1 = loadWord(a1 + p);
+                uint32_t wordB0 = loadWord(b0 + p);
+                uint32_t wordB1 = loadWord(b1 + p);
+                c00 = __SMLAD(wordA0, wordB0, c00);
+                c01 = __SMLAD(wordA0, wordB1, c01);
+                c10 = __SMLAD(wordA1, wordB0, c10);
+                c11 = __SMLAD(wordA1, wordB1, c11);
+            }
+            if (p < depth) {
+                c00 += (uint32_t) (a0[p] * b0[p]);
+                c01 += (uint32_t) (a0[p] * b1[p]);
+                c10 += (uint32_t) (a1[p] * b0[p]);
+                c11 += (uint32_t) (a1[p] * b1[p]);
+            }
+            c[i * ldc + j] = (int32_t) c00;
+            c[i * ldc + j + 1] = (int32_t) c01;
+            c[(i + 1) * ldc + j] = (int32_t) c10;
+            c[(i + 1) * ldc + j + 1] = (int32_t) c11;
+        }
+        if (j < cols) {
+            c[i * ldc + j] = DpDspDotQ15(a0, bT + j * ldb, depth);
+            c[(i + 1) * ldc + j] = DpDspDotQ15(a1, bT + j * ldb, depth);
+        }
+    }
+    if (i < rows) {
+        for (uint32_t j = 0; j < cols; j++) {
+            c[i * ldc + j] = DpDspDotQ15(a + i * lda, bT + j * ldb, depth);
+        }
+    }
+}
+
+int32_t DpDspSumQ7(const int8_t *x, uint32_t len) {
+    uint32_t acc = 0;
+    uint32_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        uint32_t word = loadWord(x + i);
+        acc = __SMLAD(__SXTB16(word), DP_DSP_ONES, acc);
+        acc = __SMLAD(__SXTB16(__ROR(word, 8)), DP_DSP_ONES, acc);
+    }
+    for (; i < len; i++) {
+        acc += (uint32_t) x[i];
+    }
+    return (int32_t) acc;
+}
+
+int32_t DpDspSumQ15(const int16_t *x, uint32_t len) {
+    uint32_t acc = 0;
+    uint32_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        acc = __SMLAD(loadWord(x + i), DP_DSP_ONES, acc);
+        acc = __SMLAD(loadWord(x + i + 2), DP_DSP_ONES, acc);
+    }
+    for (; i < len; i++) {
+        acc += (uint32_t) x[i];
+    }
+    return (int32_t) acc;
+}
+
+int64_t DpDspSumSquaresQ15(const int16_t *x, uint32_t len) {
+    uint64_t acc = 0;
+    uint32_t i = 0;
+
+    for (; i + 2 <= len; i += 2) {
+        uint32_t word = loadWord(x + i);
+        acc = __SMLALD(word, word, acc);
+    }
+    if (i < len) {
+        acc += (uint64_t) (int64_t) (x[i] * x[i]);
+    }
+    return (int64_t) acc;
+}
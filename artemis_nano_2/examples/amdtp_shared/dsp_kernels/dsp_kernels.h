@@ -0,0 +1,43 @@
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Inner loops for the slaves' kernels on the Cortex-M4 DSP extension. Two 16-bit lanes go
+// through one SMLAD, so a q15 dot product takes half the multiply-accumulates of a scalar loop,
+// and int8 data is widened four elements at a time with SXTB16. The *Ref versions are plain C,
+// the reference the benchmark checks the others against.
+//
+// Vectors need no alignment, the M4 loads words from any address. Sums into an int32_t wrap
+// like SMLAD does, the *Long versions accumulate in 64 bits.
+
+#ifndef DP_DSP_BENCHMARK
+#define DP_DSP_BENCHMARK            0           // 1: the slave checks and times the kernels at start up
+#endif
+
+#define DP_DSP_BENCHMARK_LEN        256         // Elements of the vectors the benchmark runs on
+#define DP_DSP_BENCHMARK_DIM        16          // Rows, columns and depth of the benchmark's GEMM
+#define DP_DSP_BENCHMARK_RUNS       8           // Timed runs of each kernel, the fastest counts
+
+int32_t DpDspDotQ7(const int8_t *a, const int8_t *b, uint32_t len);
+int32_t DpDspDotQ15(const int16_t *a, const int16_t *b, uint32_t len);
+int64_t DpDspDotQ15Long(const int16_t *a, const int16_t *b, uint32_t len);
+void DpDspGemmQ15(uint32_t rows, uint32_t cols, uint32_t depth, const int16_t *a, uint32_t lda,
+                  const int16_t *bT, uint32_t ldb, int32_t *c, uint32_t ldc);
+int32_t DpDspSumQ7(const int8_t *x, uint32_t len);
+int32_t DpDspSumQ15(const int16_t *x, uint32_t len);
+int64_t DpDspSumSquaresQ15(const int16_t *x, uint32_t len);
+
+int32_t DpDspDotQ7Ref(const int8_t *a, const int8_t *b, uint32_t len);
+int32_t DpDspDotQ15Ref(const int16_t *a, const int16_t *b, uint32_t len);
+int64_t DpDspDotQ15LongRef(const int16_t *a, const int16_t *b, uint32_t len);
+void DpDspGemmQ15Ref(uint32_t rows, uint32_t cols, uint32_t depth, const int16_t *a, uint32_t lda,
+                     const int16_t *bT, uint32_t ldb, int32_t *c, uint32_t ldc);
+int32_t DpDspSumQ7Ref(const int8_t *x, uint32_t len);
+int32_t DpDspSumQ15Ref(const int16_t *x, uint32_t len);
+int64_t DpDspSumSquaresQ15Ref(const int16_t *x, uint32_t len);
+
+bool DpDspBenchmark(void);
+
+#endif // DSP_KERNELS_H
@@ -0,0 +1,94 @@
+#include "dsp_kernels.h"
+#include "am_mcu_apollo.h"          // DWT cycle counter
+#include "am_util_stdio.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LEN     DP_DSP_BENCHMARK_LEN
+#define DIM     DP_DSP_BENCHMARK_DIM
+
+// inputs and outputs of the benchmark, static so the caller's stack stays small
+static int8_t benchQ7[2][LEN];
+static int16_t benchQ15[2][LEN];
+static int32_t benchC[2][DIM * DIM];
+static volatile int64_t benchSink;          // Keeps the timed calls from being optimized away
+
+// the fastest of DP_DSP_BENCHMARK_RUNS runs of call, in cycles of the DWT counter
+#define DP_DSP_TIME(cycles, call)                                                   \
+    do {                                                                            \
+        cycles = UINT32_MAX;                                                        \
+        for (int run = 0; run < DP_DSP_BENCHMARK_RUNS; run++) {                     \
+            uint32_t start = DWT->CYCCNT;                                           \
+            call;                                                                   \
+            uint32_t elapsed = DWT->CYCCNT - start;                                 \
+            cycles = elapsed < cycles ? elapsed : cycles;                           \
+        }                                                                           \
+    } while (0)
+
+// checks a kernel on one vector against its reference, also unaligned and with a tail, then times both
+#define DP_DSP_BENCH_VECTOR(name, kernel, x)                                        \
+    do {                                                                            \
+        bool ok = kernel(x, LEN) == kernel##Ref(x, LEN)                             \
+                  && kernel((x) + 1, LEN - 3) == kernel##Ref((x) + 1, LEN - 3);     \
+        DP_DSP_TIME(refCycles, benchSink = kernel##Ref(x, LEN));                    \
+        DP_DSP_TIME(cycles, benchSink = kernel(x, LEN));                            \
+        allOk &= report(name, refCycles, cycles, ok);                               \
+    } while (0)
+
+#define DP_DSP_BENCH_PAIR(name, kernel, a, b)                                       \
+    do {                                                                            \
+        bool ok = kernel(a, b, LEN) == kernel##Ref(a, b, LEN)                       \
+                  && kernel((a) + 1, (b) + 1, LEN - 3) == kernel##Ref((a) + 1, (b) + 1, LEN - 3);   \
+        DP_DSP_TIME(refCycles, benchSink = kernel##Ref(a, b, LEN));                 \
+        DP_DSP_TIME(cycles, benchSink = kernel(a, b, LEN));                         \
+        allOk &= report(name, refCycles, cycles, ok);                               \
+    } while (0)
+
+static bool report(const char *name, uint32_t refCycles, uint32_t cycles, bool ok) {
+    am_util_stdio_printf("%s: %d cycles, reference %d cycles, %s\n", name, (int) cycles, (int) refCycles,
+                         ok ? "ok" : "MISMATCH");
+    return ok;
+}
+
+/**
+ * @brief Checks every kernel against its reference on random data and prints the cycles both take
+ *
+ * @return false if a kernel computed something else than its reference
+ */
+bool DpDspBenchmark(void) {
+    uint32_t refCycles;
+    uint32_t cycles;
+    bool allOk = true;
+    bool ok;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for (int i = 0; i < LEN; i++) {
+        benchQ7[0][i] = (int8_t) rand();
+        benchQ7[1][i] = (int8_t) rand();
+        benchQ15[0][i] = (int16_t) rand();
+        benchQ15[1][i] = (int16_t) rand();
+    }
+
+    am_util_stdio_printf("DSP kernels on %d elements, GEMM of %dx%d:\n", LEN, DIM, DIM);
+    DP_DSP_BENCH_PAIR("dot q7", DpDspDotQ7, benchQ7[0], benchQ7[1]);
+    DP_DSP_BENCH_PAIR("dot q15", DpDspDotQ15, benchQ15[0], benchQ15[1]);
+    DP_DSP_BENCH_PAIR("dot q15 long", DpDspDotQ15Long, benchQ15[0], benchQ15[1]);
+    DP_DSP_BENCH_VECTOR("sum q7", DpDspSumQ7, benchQ7[0]);
+    DP_DSP_BENCH_VECTOR("sum q15", DpDspSumQ15, benchQ15[0]);
+    DP_DSP_BENCH_VECTOR("sum of squares q15", DpDspSumSquaresQ15, benchQ15[0]);
+
+    // A and B fill the q15 vectors, odd sizes leave a row, a column and a step of the depth to the edge code
+    ok = true;
+    for (uint32_t dim = DIM - 1; dim <= DIM; dim++) {
+        DpDspGemmQ15(dim, dim, dim, benchQ15[0], DIM, benchQ15[1], DIM, benchC[0], DIM);
+        DpDspGemmQ15Ref(dim, dim, dim, benchQ15[0], DIM, benchQ15[1], DIM, benchC[1], DIM);
+        ok &= memcmp(benchC[0], benchC[1], sizeof(benchC[0])) == 0;
+    }
+    DP_DSP_TIME(refCycles, DpDspGemmQ15Ref(DIM, DIM, DIM, benchQ15[0], DIM, benchQ15[1], DIM, benchC[1], DIM));
+    DP_DSP_TIME(cycles, DpDspGemmQ15(DIM, DIM, DIM, benchQ15[0], DIM, benchQ15[1], DIM, benchC[0], DIM));
+    allOk &= report("gemm q15", refCycles, cycles, ok);
+
+    return allOk;
+}
@@ -0,0 +1,56 @@
+#include "dsp_kernels.h"
+
+// one element at a time in 64 bits, the int32_t results wrap like the SIMD versions
+
+int32_t DpDspDotQ7Ref(const int8_t *a, const int8_t *b, uint32_t len) {
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += a[i] * b[i];
+    }
+    return (int32_t) (uint32_t) sum;
+}
+
+int32_t DpDspDotQ15Ref(const int16_t *a, const int16_t *b, uint32_t len) {
+    return (int32_t) (uint32_t) DpDspDotQ15LongRef(a, b, len);
+}
+
+int64_t DpDspDotQ15LongRef(const int16_t *a, const int16_t *b, uint32_t len) {
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void DpDspGemmQ15Ref(uint32_t rows, uint32_t cols, uint32_t depth, const int16_t *a, uint32_t lda,
+                     const int16_t *bT, uint32_t ldb, int32_t *c, uint32_t ldc) {
+    for (uint32_t i = 0; i < rows; i++) {
+        for (uint32_t j = 0; j < cols; j++) {
+            c[i * ldc + j] = DpDspDotQ15Ref(a + i * lda, bT + j * ldb, depth);
+        }
+    }
+}
+
+int32_t DpDspSumQ7Ref(const int8_t *x, uint32_t len) {
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += x[i];
+    }
+    return (int32_t) (uint32_t) sum;
+}
+
+int32_t DpDspSumQ15Ref(const int16_t *x, uint32_t len) {
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += x[i];
+    }
+    return (int32_t) (uint32_t) sum;
+}
+
+int64_t DpDspSumSquaresQ15Ref(const int16_t *x, uint32_t len) {
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += x[i] * x[i];
+    }
+    return sum;
+}
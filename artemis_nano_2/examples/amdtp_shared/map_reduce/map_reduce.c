@@ -0,0 +1,120 @@
+#include "map_reduce.h"
+#include "am_util_debug.h"
+#include "am_util_stdio.h"
+#include <string.h>
+
+// slot memory of the slave, a slot holds one task of any map/reduce kernel at a time
+uint64_t slotRange[DP_MAX_TASKS_PER_CLIENT][DP_MAP_REDUCE_MAX_RANGE_BYTES / sizeof(uint64_t)];
+uint64_t slotAggregate[DP_MAX_TASKS_PER_CLIENT][DP_MAP_REDUCE_MAX_AGGREGATE_SIZE / sizeof(uint64_t)];
+
+/**
+ * @brief First element of a range, the ranges split the input evenly
+ */
+static size_t rangeStart(DpMapReduceState *state, int taskId) {
+    return (state->numElements * taskId) / state->numRanges;
+}
+
+/**
+ * @brief Splits the input of a job into ranges, enough for every client the master can serve
+ *        and small enough for a slot, so the results are one aggregate per range
+ */
+void DpMapReduceInitTasks(const DpMapReduce *job, DpMapReduceState *state, size_t *numTasks) {
+    size_t elementsPerRange = DP_MAP_REDUCE_MAX_RANGE_BYTES / job->elementSize;
+
+    state->input = job->initInput(&state->numElements);
+
+    size_t numRanges = DP_MAX_CLIENTS * DP_MAP_REDUCE_RANGES_PER_CLIENT;
+    if (elementsPerRange > 0 && numRanges * elementsPerRange < state->numElements) {
+        numRanges = (state->numElements + elementsPerRange - 1) / elementsPerRange;
+    }
+    if (numRanges > state->numElements) {
+        numRanges = state->numElements;
+    }
+
+    if (elementsPerRange == 0 || numRanges > DP_MAP_REDUCE_MAX_RANGES || job->aggregateSize > DP_MAP_REDUCE_MAX_AGGREGATE_SIZE) {
+        am_util_stdio_printf("Map/reduce input of %d elements does not fit, increase DP_MAP_REDUCE_MAX_RANGES\n",
+                             (int) state->numElements);
+        while(1);
+    }
+
+    state->numRanges = numRanges;
+    job->identity(state->aggregate);
+    *numTasks = numRanges;
+    am_util_stdio_printf("Mapping %d elements in %d ranges\n", (int) state->numElements, (int) numRanges);
+}
+
+uint16_t DpMapReduceGetTaskDataLength(const DpMapReduce *job, DpMapReduceState *state, int taskId) {
+    return (rangeStart(state, taskId + 1) - rangeStart(state, taskId)) * job->elementSize;
+}
+
+void DpMapReduceCopyTaskData(const DpMapReduce *job, DpMapReduceState *state, uint8_t *buffer, int taskId) {
+    memcpy(buffer, state->input + rangeStart(state, taskId) * job->elementSize,
+           DpMapReduceGetTaskDataLength(job, state, taskId));
+}
+
+void *DpMapReduceGetTaskResult(const DpMapReduce *job, DpMapReduceState *state, int taskId) {
+    return state->partials[taskId];
+}
+
+/**
+ * @brief Folds the partial aggregate of a range into the job's aggregate, each range is reported once
+ */
+void DpMapReduceOnTaskComplete(const DpMapReduce *job, DpMapReduceState *state, int taskId, void *result) {
+    if (result != NULL) {                       // NULL when a relay folded it into the result of another task
+        job->combine(state->aggregate, result);
+    }
+}
+
+/**
+ * @brief Folds the partial aggregate of one range into another's, a relay sends its children's up as one
+ */
+void DpMapReduceCombineResults(const DpMapReduce *job, void *result, const void *other) {
+    job->combine(result, other);
+}
+
+void DpMapReduceReassemble(const DpMapReduce *job, DpMapReduceState *state, size_t numTasksCompleted) {
+    if (numTasksCompleted < state->numRanges) {
+        am_util_debug_printf("Not all ranges are complete...\n");
+    }
+    job->onResult(state->aggregate);
+}
+
+/**
+ * @brief Maps every element of the range and folds the values, the task returns one aggregate
+ */
+void DpMapReduceExecuteTask(const DpMapReduce *job, Task *task) {
+    const uint8_t *element = task->data;
+    const uint8_t *end = element + task->dataLength;
+    uint64_t value[DP_MAP_REDUCE_MAX_AGGREGATE_SIZE / sizeof(uint64_t)];
+
+    am_util_debug_printf("Mapping %d elements of task %d\n", task->dataLength / job->elementSize, task->taskId);
+    job->identity(task->result);
+    for (; element + job->elementSize <= end; element += job->elementSize) {
+        job->map(element, value);
+        job->combine(task->result, value);
+    }
+
+    task->status = DP_TASK_STATUS_COMPLETE;
+    task->dataLength = job->aggregateSize;
+}
+
+// a range carries its own elements, there are no shared operands
+uint8_t DpMapReduceGetTaskOperands(int taskId, uint16_t *operandIds) {
+    return 0;
+}
+
+uint16_t DpMapReduceGetOperandLength(uint16_t operandId) {
+    return 0;
+}
+
+void DpMapReduceCopyOperand(uint8_t *buffer, uint16_t operandId) {
+}
+
+void DpMapReduceStoreOperand(uint16_t operandId, uint8_t *data, uint16_t len) {
+}
+
+void DpMapReduceInitServerTask(Task *task, int slot) {
+    task->data = slotRange[slot];
+    task->dataLength = 0;
+    task->result = slotAggregate[slot];
+}
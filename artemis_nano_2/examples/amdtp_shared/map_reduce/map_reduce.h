@@ -0,0 +1,115 @@
+#ifndef MAP_REDUCE_H
+#define MAP_REDUCE_H
+
+#include "distributed_protocol.h"
+
+// A map/reduce job on the distributed protocol. The master splits an input array into contiguous
+// ranges, one task each. The slave maps every element of its range and folds the values with the
+// combiner, so a task returns one partial aggregate instead of one result per element, and the
+// master combines the partials as they arrive. A relay combines the partials of its children the
+// same way before sending them up.
+
+#ifndef DP_MAP_REDUCE_RANGES_PER_CLIENT
+#define DP_MAP_REDUCE_RANGES_PER_CLIENT     2           // Ranges per client the master can serve, so late and slow clients still balance
+#endif
+
+#ifndef DP_MAP_REDUCE_MAX_RANGE_BYTES
+#define DP_MAP_REDUCE_MAX_RANGE_BYTES       512         // Input bytes in one task, the size of a slave's slot buffer
+#endif
+
+#ifndef DP_MAP_REDUCE_MAX_RANGES
+#define DP_MAP_REDUCE_MAX_RANGES            128         // Tasks of one job, the master keeps a partial aggregate for each
+#endif
+
+#define DP_MAP_REDUCE_MAX_AGGREGATE_SIZE    16          // Bytes of one aggregate, and of one mapped value
+
+typedef struct {
+    uint16_t    elementSize;                            // Bytes of one input element
+    uint16_t    aggregateSize;                          // Bytes of a value and of an aggregate, at most DP_MAP_REDUCE_MAX_AGGREGATE_SIZE
+    // master
+    const void  *(*initInput)(size_t *numElements);     // Prepares the input of a job, it stays in place until onResult
+    void        (*onResult)(const void *aggregate);     // The aggregate of the whole input once every range is in
+    // both
+    void        (*identity)(void *aggregate);           // An aggregate of no elements, the start of every fold
+    void        (*map)(const void *element, void *value);
+    void        (*combine)(void *aggregate, const void *value);     // Folds a value, or a partial aggregate, into an aggregate
+} DpMapReduce;
+
+// what the master keeps of the running job, one per map/reduce kernel
+typedef struct {
+    const uint8_t   *input;
+    size_t          numElements;
+    size_t          numRanges;
+    uint64_t        aggregate[DP_MAP_REDUCE_MAX_AGGREGATE_SIZE / sizeof(uint64_t)];
+    uint64_t        partials[DP_MAP_REDUCE_MAX_RANGES][DP_MAP_REDUCE_MAX_AGGREGATE_SIZE / sizeof(uint64_t)];
+} DpMapReduceState;
+
+void DpMapReduceInitTasks(const DpMapReduce *job, DpMapReduceState *state, size_t *numTasks);
+uint16_t DpMapReduceGetTaskDataLength(const DpMapReduce *job, DpMapReduceState *state, int taskId);
+void DpMapReduceCopyTaskData(const DpMapReduce *job, DpMapReduceState *state, uint8_t *buffer, int taskId);
+void *DpMapReduceGetTaskResult(const DpMapReduce *job, DpMapReduceState *state, int taskId);
+void DpMapReduceOnTaskComplete(const DpMapReduce *job, DpMapReduceState *state, int taskId, void *result);
+void DpMapReduceCombineResults(const DpMapReduce *job, void *result, const void *other);
+void DpMapReduceReassemble(const DpMapReduce *job, DpMapReduceState *state, size_t numTasksCompleted);
+void DpMapReduceExecuteTask(const DpMapReduce *job, Task *task);
+// the same for every map/reduce kernel
+uint8_t DpMapReduceGetTaskOperands(int taskId, uint16_t *operandIds);
+uint16_t DpMapReduceGetOperandLength(uint16_t operandId);
+void DpMapReduceCopyOperand(uint8_t *buffer, uint16_t operandId);
+void DpMapReduceStoreOperand(uint16_t operandId, uint8_t *data, uint16_t len);
+void DpMapReduceInitServerTask(Task *task, int slot);
+
+/**
+ * Defines the DpKernel `kernel` that runs `job`, a DpMapReduce in the same file. The hooks of a
+ * kernel take no context, so each map/reduce kernel gets its own small ones that pass the job on.
+ * `elementType` and `aggregateType` are the eDpElementType_t of the input and of the aggregates.
+ */
+#define DP_MAP_REDUCE_KERNEL(kernel, kernelId, kernelName, job, elementType, aggregateType)         \
+    static DpMapReduceState kernel##State;                                                          \
+    static void kernel##InitClientTasks(size_t *numTasks) {                                         \
+        DpMapReduceInitTasks(&(job), &kernel##State, numTasks);                                     \
+    }                                                                                               \
+    static uint16_t kernel##GetTaskDataLength(int taskId) {                                         \
+        return DpMapReduceGetTaskDataLength(&(job), &kernel##State, taskId);                        \
+    }                                                                                               \
+    static void kernel##CopyTaskData(uint8_t *buffer, int taskId) {                                 \
+        DpMapReduceCopyTaskData(&(job), &kernel##State, buffer, taskId);                            \
+    }                                                                                               \
+    static void *kernel##GetTaskResult(int taskId) {                                                \
+        return DpMapReduceGetTaskResult(&(job), &kernel##State, taskId);                            \
+    }                                                                                               \
+    static void kernel##OnTaskComplete(int taskId, void *result) {                                  \
+        DpMapReduceOnTaskComplete(&(job), &kernel##State, taskId, result);                          \
+    }                                                                                               \
+    static void kernel##CombineResults(void *result, const void *other) {                           \
+        DpMapReduceCombineResults(&(job), result, other);                                           \
+    }                                                                                               \
+    static void kernel##Reassemble(size_t numTasksCompleted) {                                      \
+        DpMapReduceReassemble(&(job), &kernel##State, numTasksCompleted);                           \
+    }                                                                                               \
+    static void kernel##ExecuteTask(Task *task) {                                                   \
+        DpMapReduceExecuteTask(&(job), task);                                                       \
+    }                                                                                               \
+    const DpKernel kernel = {                                                                       \
+        .id = (kernelId),                                                                           \
+        .name = (kernelName),                                                                       \
+        .taskDataType = (elementType),                                                              \
+        .resultType = (aggregateType),                                                              \
+        .taskDataSize = DP_MAP_REDUCE_MAX_RANGE_BYTES,                                              \
+        .resultSize = DP_MAP_REDUCE_MAX_AGGREGATE_SIZE,                                             \
+        .initClientTasks = kernel##InitClientTasks,                                                 \
+        .getTaskDataLength = kernel##GetTaskDataLength,                                             \
+        .copyTaskDataToSendBuffer = kernel##CopyTaskData,                                           \
+        .getTaskResult = kernel##GetTaskResult,                                                     \
+        .getTaskOperands = DpMapReduceGetTaskOperands,                                              \
+        .getOperandLength = DpMapReduceGetOperandLength,                                            \
+        .copyOperandToSendBuffer = DpMapReduceCopyOperand,                                          \
+        .reassembleTaskResults = kernel##Reassemble,                                                \
+        .onTaskComplete = kernel##OnTaskComplete,                                                   \
+        .initServerTask = DpMapReduceInitServerTask,                                                \
+        .storeOperand = DpMapReduceStoreOperand,                                                    \
+        .executeTask = kernel##ExecuteTask,                                                         \
+        .combineResults = kernel##CombineResults,                                                   \
+    }
+
+#endif // MAP_REDUCE_H
@@ -1,4 +1,5 @@
 #include "matrix_mult.h"
+#include "dsp_kernels.h"
 #include "am_util_debug.h"
 #include "am_util_stdio.h"
 #include "FreeRTOS.h"
@@ -23,13 +24,37 @@
 int MATRIX_A[M][P];
 int MATRIX_B[N][P];
 int MATRIX_C[M][N];     // the i,j element of C is C[j][i]
+uint8_t rowResults[M];  // results of each row of C delivered so far, a row is printed once it is complete
+uint16_t nonzerosA[M];  // nonzeros of each row of A, counted once per job to pick dense or sparse
+uint16_t nonzerosB[N];  // nonzeros of each column of B
+int tileC[M * N];        // blocks of C as the tiled tasks deliver them, see getTileStorage
+uint8_t queuedBlocks[(M / MATRIX_MULT_MIN_TILE) * (N / MATRIX_MULT_MIN_TILE) / 8 + 1];   // bit per smallest block, while the tasks are cut anew
 #endif
 
 #ifdef DP_SLAVE
-int matrixData[2*P];
-int result;
+#define ROW_HELD                (2 + P)             // A row as a slave holds it: a pad, its header from the wire, its elements
+#define ROW_ELEMENTS(row)       (&(row)[2])         // Word aligned like the rows, for the DSP kernels
+
+int16_t operandA[M][ROW_HELD];  // rows of A pushed by the master, operand id i, dense or the indices then the values of the nonzeros
+int16_t operandB[N][ROW_HELD];  // columns of B pushed by the master, operand id M + j, same
+int16_t operandNonzerosA[M];    // nonzeros of each sparse row of operandA, ROW_DENSE for a dense one
+int16_t operandNonzerosB[N];
+int result[DP_MAX_TASKS_PER_CLIENT];
+int tileResult[DP_MAX_TASKS_PER_CLIENT][MATRIX_MULT_TILE * MATRIX_MULT_TILE];
 #endif
 
+#define OPERAND_ID_ROW_A(i)     (i)
+#define OPERAND_ID_COL_B(j)     (M + (j))
+
+#define ROW_DENSE               (-1)                // Header of a dense row on the wire, a sparse row's is its count of nonzeros
+#define ROW_IS_SPARSE(nonzeros) ((nonzeros) * 100 <= MATRIX_MULT_SPARSE_DENSITY * P)
+
+#define T                       MATRIX_MULT_TILE
+#define TILES_N                 (N / T)             // Blocks in a row of C, taskId = bj + (bi * TILES_N) in the first cut
+#define MIN_T                   MATRIX_MULT_MIN_TILE
+#define OPERAND_ID_STRIP_A(bi)  (bi)                // Rows bi * T to bi * T + T - 1 of A
+#define OPERAND_ID_STRIP_B(bj)  (M / T + (bj))      // Columns bj * T to bj * T + T - 1 of B
+
 void identityMatrix(int* matrix, int row, int col) {
     for (int i = 0; i < row; i++) {
         for (int j = 0; j < col; j++) {
@@ -42,10 +67,14 @@ void identityMatrix(int* matrix, int row, int col) {
     }
 }
 
-void populateMatrix(int* matrix, int rows, int cols) {
+void populateMatrix(int* matrix, int rows, int cols, int nonzeroPercent) {
     for (int i = 0; i < rows; i++) {
         for (int j = 0; j < cols; j++) {
-            matrix[i * cols + j] = rand() % 10;
+            if (nonzeroPercent >= 100 || rand() % 100 < nonzeroPercent) {
+                matrix[i * cols + j] = rand() % 10;
+            } else {
+                matrix[i * cols + j] = 0;
+            }
         }
     }
 }
@@ -69,19 +98,24 @@ void printMatrix(int* matrix, int rows, int cols) {
     }
 }
 
+static uint16_t countNonzeros(const int *row) {
+    uint16_t nonzeros = 0;
+    for (int p = 0; p < P; p++) {
+        nonzeros += row[p] != 0;
+    }
+    return nonzeros;
+}
+
 /**
- * @brief   Initialize the memory for the tasks and the data to be used in the tasks.
- *          This function is called by the client to set the pointers task[i].data and task[i].result
- *          to point to the memory allocated for the data and result
- * 
- * @param tasks The task array in the distributed protocol
- * @param numTasks Number of tasks
+ * @brief   Fills A and B for a new job of either kernel, prints them and measures the density of their rows
  */
-void initClientTasks(Task *tasks, size_t *numTasks) {
-    
-    *numTasks = M*N;
+static void initMatrices(void) {
+    int sparseA = 0;
+    int sparseB = 0;
+
+    memset(rowResults, 0, sizeof(rowResults));
     
-    populateMatrix((int *)MATRIX_A, M, P);
+    populateMatrix((int *)MATRIX_A, M, P, MATRIX_MULT_A_NONZERO);
     identityMatrix((int *)MATRIX_B, N, P);
 
     printMatrix((int *)MATRIX_A, M, P);
@@ -90,27 +124,240 @@ void initClientTasks(Task *tasks, size_t *numTasks) {
 
     printMatrixTranspose((int *)MATRIX_B, N, P);
 
-    for (int j = 0; j < N; j++) {  // for each col of B
-        for (int i = 0; i < M; i++) {  //for each row of A
-            int taskId = j + (i * N);  // taskId = col + (row * N)
-            tasks[taskId].taskId = taskId;   
-            tasks[taskId].data = NULL;
-            tasks[taskId].dataLength = sizeof(int[P]) * 2;
-            tasks[taskId].result = &(MATRIX_C[i][j]);
+    for (int i = 0; i < M; i++) {
+        nonzerosA[i] = countNonzeros(MATRIX_A[i]);
+        sparseA += ROW_IS_SPARSE(nonzerosA[i]);
+    }
+    for (int j = 0; j < N; j++) {
+        nonzerosB[j] = countNonzeros(MATRIX_B[j]);
+        sparseB += ROW_IS_SPARSE(nonzerosB[j]);
+    }
+    am_util_stdio_printf("Sparse: %d of %d rows of A, %d of %d columns of B\n", sparseA, M, sparseB, N);
+}
+
+static void putElement(uint8_t **buffer, int value) {
+    int16_t element = (int16_t) value;
+    memcpy(*buffer, &element, sizeof(element));
+    *buffer += sizeof(element);
+}
+
+static int16_t getElement(const uint8_t *data, uint16_t *offset) {
+    int16_t element;
+    memcpy(&element, data + *offset, sizeof(element));
+    *offset += sizeof(element);
+    return element;
+}
+
+/**
+ * @brief   Length of count rows on the wire. A row is its header, then its P elements or,
+ *          sparse, the indices and then the values of its nonzeros
+ */
+static uint16_t rowsLength(const uint16_t *nonzeros, int count) {
+    uint16_t elements = 0;
+    for (int r = 0; r < count; r++) {
+        elements += 1 + (ROW_IS_SPARSE(nonzeros[r]) ? 2 * nonzeros[r] : P);
+    }
+    return elements * sizeof(int16_t);
+}
+
+/**
+ * @brief   Narrows count rows of A or columns of B to the int16 the slaves multiply with, each dense
+ *          or sparse by its density. The elements are digits.
+ */
+static void copyRows(uint8_t *buffer, int (*rows)[P], const uint16_t *nonzeros, int count) {
+    for (int r = 0; r < count; r++) {
+        if (!ROW_IS_SPARSE(nonzeros[r])) {
+            putElement(&buffer, ROW_DENSE);
+            for (int p = 0; p < P; p++) {
+                putElement(&buffer, rows[r][p]);
+            }
+            continue;
+        }
+
+        putElement(&buffer, nonzeros[r]);
+        for (int p = 0; p < P; p++) {
+            if (rows[r][p] != 0) {
+                putElement(&buffer, p);
+            }
+        }
+        for (int p = 0; p < P; p++) {
+            if (rows[r][p] != 0) {
+                putElement(&buffer, rows[r][p]);
+            }
         }
     }
 }
 
+/**
+ * @brief   Keeps count rows pushed by the master in the form they came in, each behind its header, a sparse
+ *          row takes its indices and then its values from the start of the row. The protocol decodes them
+ *          straight to &rows[0][1], see getRowStorage, where the first row is in place already. The others
+ *          only move forward, so they are moved the last one first.
+ * 
+ * @return false if the rows do not add up to len, or a sparse row is too long or its indices are not increasing
+ */
+static bool storeRows(int16_t (*rows)[ROW_HELD], int16_t *rowNonzeros, int count, const uint8_t *data, uint16_t len) {
+    uint16_t start[T + 1];
+    uint16_t offset = 0;
 
-void copyTaskDataToSendBuffer(uint8_t *buffer, Task *task) {
+    for (int r = 0; r < count; r++) {
+        if (offset + sizeof(int16_t) > len) {
+            return false;
+        }
+        start[r] = offset;
+        int16_t header = getElement(data, &offset);
+        int elements = header == ROW_DENSE ? P : 2 * header;
+        if (header < ROW_DENSE || header > P / 2 || offset + elements * sizeof(int16_t) > len) {
+            return false;
+        }
 
-    // am_util_stdio_printf("Copying task data to send buffer\n");
-    int taskId = task->taskId;
-    int i = taskId / N;
-    int j = taskId % N;
-    memcpy(buffer, MATRIX_A[i], sizeof(int[P]));
-    memcpy(buffer + sizeof(int[P]), MATRIX_B[j], sizeof(int[P]));
-    // am_util_stdio_printf("Copying task data to send buffer finished\n");
+        for (int k = 0, previous = -1; header != ROW_DENSE && k < header; k++) {
+            uint16_t at = offset + k * sizeof(int16_t);
+            int16_t index = getElement(data, &at);
+            if (index <= previous || index >= P) {
+                return false;
+            }
+            previous = index;
+        }
+        offset += elements * sizeof(int16_t);
+    }
+    if (offset != len) {
+        return false;
+    }
+
+    start[count] = len;
+    for (int r = count - 1; r >= 0; r--) {
+        if ((const uint8_t *) &rows[r][1] != data + start[r]) {
+            memmove(&rows[r][1], data + start[r], start[r + 1] - start[r]);
+        }
+        rowNonzeros[r] = rows[r][1];
+    }
+    return true;
+}
+
+/**
+ * @brief   Where count rows pushed by the master decode to, they take at most their rows once in place
+ */
+static void *getRowStorage(int16_t (*rows)[ROW_HELD], int count, uint16_t *size) {
+    *size = (count * ROW_HELD - 1) * sizeof(int16_t);
+    return &rows[0][1];
+}
+
+/**
+ * @brief   Row of A times column of B in whichever form each is held. Two dense rows go to the DSP
+ *          kernel, a sparse one only visits its nonzeros and two sparse ones merge their indices.
+ */
+static int dotRows(const int16_t *a, int16_t nonzerosA, const int16_t *b, int16_t nonzerosB) {
+    uint32_t acc = 0;       // Wraps like DpDspDotQ15
+
+    if (nonzerosA == ROW_DENSE && nonzerosB == ROW_DENSE) {
+        return DpDspDotQ15(a, b, P);
+    }
+    if (nonzerosA == ROW_DENSE) {
+        const int16_t *dense = a;
+        a = b;
+        b = dense;
+        nonzerosA = nonzerosB;
+        nonzerosB = ROW_DENSE;
+    }
+
+    const int16_t *valuesA = a + nonzerosA;
+    if (nonzerosB == ROW_DENSE) {
+        for (int k = 0; k < nonzerosA; k++) {
+            acc += (uint32_t) (valuesA[k] * b[a[k]]);
+        }
+        return (int) acc;
+    }
+
+    const int16_t *valuesB = b + nonzerosB;
+    for (int k = 0, l = 0; k < nonzerosA && l < nonzerosB;) {
+        if (a[k] < b[l]) {
+            k++;
+        } else if (a[k] > b[l]) {
+            l++;
+        } else {
+            acc += (uint32_t) (valuesA[k++] * valuesB[l++]);
+        }
+    }
+    return (int) acc;
+}
+
+/**
+ * @brief   Initialize the data to be used in the tasks.
+ *          The distributed protocol only keeps the status of each task, the data and result
+ *          locations are derived from the task id by the functions below
+ * 
+ * @param numTasks Number of tasks
+ */
+static void initClientTasks(size_t *numTasks) {
+    *numTasks = M*N;
+    initMatrices();
+}
+
+// taskId = col + (row * N)
+static uint16_t getTaskDataLength(int taskId) {
+    return 0;       // the row and column are sent once as operands, the task id says which
+}
+
+static void *getTaskResult(int taskId) {
+    return &(MATRIX_C[taskId / N][taskId % N]);
+}
+
+static void copyTaskDataToSendBuffer(uint8_t *buffer, int taskId) {
+    // nothing to copy, all task data comes from the operand cache
+}
+
+/**
+ * @brief   Lists the operands a task reads, task i,j needs row i of A and column j of B
+ * 
+ * @param taskId The task id
+ * @param operandIds Filled with the operand ids
+ * @return The number of operands
+ */
+static uint8_t getTaskOperands(int taskId, uint16_t *operandIds) {
+    operandIds[0] = OPERAND_ID_ROW_A(taskId / N);
+    operandIds[1] = OPERAND_ID_COL_B(taskId % N);
+    return 2;
+}
+
+static uint16_t getOperandLength(uint16_t operandId) {
+    // every operand is one row of A or one column of B
+    return operandId < M ? rowsLength(&nonzerosA[operandId], 1) : rowsLength(&nonzerosB[operandId - M], 1);
+}
+
+static void copyOperandToSendBuffer(uint8_t *buffer, uint16_t operandId) {
+    if (operandId < M) {
+        copyRows(buffer, &MATRIX_A[operandId], &nonzerosA[operandId], 1);
+    } else {
+        copyRows(buffer, &MATRIX_B[operandId - M], &nonzerosB[operandId - M], 1);
+    }
+}
+
+static void *getOperandStorage(uint16_t operandId, uint16_t *size) {
+    if (operandId < M) {
+        return getRowStorage(&operandA[operandId], 1, size);
+    }
+    return operandId < M + N ? getRowStorage(&operandB[operandId - M], 1, size) : NULL;
+}
+
+/**
+ * @brief   Keeps an operand pushed by the master for the tasks that use it
+ * 
+ * @param operandId The operand id
+ * @param data The operand data, only valid during the call
+ * @param len The length of the operand data
+ */
+static void storeOperand(uint16_t operandId, uint8_t *data, uint16_t len) {
+    bool stored;
+
+    if (operandId < M) {
+        stored = storeRows(&operandA[operandId], &operandNonzerosA[operandId], 1, data, len);
+    } else {
+        stored = operandId < M + N && storeRows(&operandB[operandId - M], &operandNonzerosB[operandId - M], 1, data, len);
+    }
+    if (!stored) {
+        am_util_stdio_printf("Unexpected operand %d of length %d\n", operandId, len);
+    }
 }
 
 
@@ -122,54 +369,369 @@ void copyTaskDataToSendBuffer(uint8_t *buffer, Task *task) {
  *          This is needed becauses the distributed protocol is not concerned with what task is being executed.
  *          The application defines the size of the task and data and results used.
  * 
- * @param tasks The task array in the distributed protocol
- * @param numTasks Number of tasks
+ * @param task The task slot in the distributed protocol
+ * @param slot Index of the slot, each slot needs its own data and result memory
  */
-void initServerTask(Task *task) {
-    task->data = matrixData;
-    task->dataLength = sizeof(int[P]) * 2;
-    task->result = &result;
+static void initServerTask(Task *task, int slot) {
+    task->data = NULL;
+    task->dataLength = 0;
+    task->result = &result[slot];
 }
 
 
 /**
- * @brief Reassembles the results
+ * @brief Counts the results a task delivered to row i of C and prints the row once it is complete
+ */
+static void addRowResults(int i, int count) {
+    rowResults[i] += count;
+    if (rowResults[i] < N) {
+        return;
+    }
+
+    am_util_stdio_printf("Row %d: ", i);
+    printMatrix((int *)MATRIX_C[i], 1, N);
+}
+
+/**
+ * @brief Streams C out row by row, each row as soon as its last result arrives
+ * 
+ * @param taskId The task that completed
+ * @param result Its element of C
+ */
+static void onTaskComplete(int taskId, void *result) {
+    addRowResults(taskId / N, 1);
+}
+
+/**
+ * @brief Reassembles the results, the rows were already printed as they completed
  * 
- * @param tasks 
  * @param numTasks 
  */
-void reassembleTaskResults(Task *tasks, size_t numTasks) {
-    if (numTasks < APP_TASK_COUNT) {
+static void reassembleTaskResults(size_t numTasks) {
+    if (numTasks < MATRIX_MULT_TASK_COUNT) {
         am_util_debug_printf("Not all tasks are complete...\n");
     }
 
-    am_util_stdio_printf("Printing matrix..\n");
-    printMatrix((int *)MATRIX_C, M, N);
-
+    am_util_stdio_printf("All %d rows of the matrix are done\n", M);
 }
 
 /**
- * @brief executes the results
+ * @brief Multiplies row i of A with column j of B, two elements per SMLAD when both are dense
  * 
  * @param task 
  */
-void executeTask(Task *task) {
-    am_util_stdio_printf("Executing task %d\n", task->taskId);
+static void executeTask(Task *task) {
     int taskId = task->taskId;
     int i = taskId / N;
     int j = taskId % N;
-    am_util_stdio_printf("Multiplying row %d of A with column %d of B\n", i, j);
-    
-    result = 0;
 
-    for (int p = 0; p < P; p++) {
-        result += matrixData[p] * matrixData[P + p];
-    }
+    *(int *) task->result = dotRows(ROW_ELEMENTS(operandA[i]), operandNonzerosA[i], ROW_ELEMENTS(operandB[j]),
+                                    operandNonzerosB[j]);
 
     task->status = DP_TASK_STATUS_COMPLETE;
     task->dataLength = sizeof(int);
-    distributionProtocolTaskHandle = NULL;
-    am_util_stdio_printf("Task complete, result = %d\n", result);
+}
+
+const DpKernel matrixMultKernel = {
+    .id = MATRIX_MULT_KERNEL_ID,
+    .name = "Matrix multiplication",
+    .operandType = DP_ELEMENT_INT16,        // Digits, and the indices of the sparse rows, they pack into a few bits
+    .resultType = DP_ELEMENT_INT32,
+    .resultSize = sizeof(int),
+    .initClientTasks = initClientTasks,
+    .getTaskDataLength = getTaskDataLength,
+    .copyTaskDataToSendBuffer = copyTaskDataToSendBuffer,
+    .getTaskResult = getTaskResult,
+    .getTaskOperands = getTaskOperands,
+    .getOperandLength = getOperandLength,
+    .copyOperandToSendBuffer = copyOperandToSendBuffer,
+    .reassembleTaskResults = reassembleTaskResults,
+    .onTaskComplete = onTaskComplete,
+    .initServerTask = initServerTask,
+    .storeOperand = storeOperand,
+    .getOperandStorage = getOperandStorage,
+    .executeTask = executeTask,
+};
+
+// The tiled kernel: task bi,bj computes the block of C at rows bi * T and columns bj * T with one GEMM,
+// from the strips of A and B the master pushes once per slave. A task carries T * T results for 2 * T
+// operand rows, where the per element kernel pays a packet entry and a dispatch for every single result.
+// The master may cut the blocks into smaller ones, each size down to MIN_T has ids of its own after those
+// of the larger sizes, row by row.
+
+/**
+ * @brief Finds the block of C a tiled task computes
+ * 
+ * @param taskId The task id
+ * @param tile Set to the size of the block
+ * @param row Set to its first row
+ * @param col Set to its first column
+ */
+static void getTile(int taskId, int *tile, int *row, int *col) {
+    int t = T;
+
+    while (t > MIN_T && taskId >= (M / t) * (N / t)) {
+        taskId -= (M / t) * (N / t);
+        t /= 2;
+    }
+    *tile = t;
+    *row = taskId / (N / t) * t;
+    *col = taskId % (N / t) * t;
+}
+
+static int getTileTaskId(int tile, int row, int col) {
+    int taskId = 0;
+
+    for (int t = T; t > tile; t /= 2) {
+        taskId += (M / t) * (N / t);
+    }
+    return taskId + (row / tile) * (N / tile) + col / tile;
+}
+
+/**
+ * @brief Where the master keeps the result of a block until it is copied into C. Every T block of C has
+ *        T * T elements of tileC in Z order, so a smaller block gets a range that no other block overlaps,
+ *        whichever sizes the job is cut into.
+ */
+static int *getTileStorage(int row, int col) {
+    int offset = ((row / T) * TILES_N + col / T) * T * T;
+
+    for (int bit = 0; (1 << bit) < T; bit++) {
+        offset += (((col >> bit) & 1) << (2 * bit)) | (((row >> bit) & 1) << (2 * bit + 1));
+    }
+    return &tileC[offset];
+}
+
+static void initTiledClientTasks(size_t *numTasks) {
+    *numTasks = MATRIX_MULT_TILED_TASK_COUNT;
+    initMatrices();
+}
+
+static void *getTiledTaskResult(int taskId) {
+    int tile, row, col;
+
+    getTile(taskId, &tile, &row, &col);
+    return getTileStorage(row, col);
+}
+
+static uint16_t getTiledResultSize(int taskId) {
+    int tile, row, col;
+
+    getTile(taskId, &tile, &row, &col);
+    return sizeof(int) * tile * tile;
+}
+
+static uint8_t getTiledTaskOperands(int taskId, uint16_t *operandIds) {
+    int tile, row, col;
+
+    getTile(taskId, &tile, &row, &col);
+    operandIds[0] = OPERAND_ID_STRIP_A(row / T);
+    operandIds[1] = OPERAND_ID_STRIP_B(col / T);
+    return 2;
+}
+
+static uint32_t getTiledTaskWork(int taskId) {
+    int tile, row, col;
+
+    getTile(taskId, &tile, &row, &col);
+    return (tile / MIN_T) * (tile / MIN_T);
+}
+
+static bool isBlockQueued(int row, int col) {
+    int i = (row / MIN_T) * (N / MIN_T) + col / MIN_T;
+    return (queuedBlocks[i / 8] & (1 << (i % 8))) != 0;
+}
+
+static void setBlockQueued(int row, int col) {
+    int i = (row / MIN_T) * (N / MIN_T) + col / MIN_T;
+    queuedBlocks[i / 8] |= 1 << (i % 8);
+}
+
+/**
+ * @brief Covers the queued part of a block with as few blocks of at most the given size as fit it
+ * 
+ * @return The number of tasks in taskIds
+ */
+static size_t cutQueuedBlock(int size, int row, int col, int tile, uint16_t *taskIds, size_t numTasks, size_t maxTasks) {
+    int queued = 0;
+
+    for (int r = row; r < row + size; r += MIN_T) {
+        for (int c = col; c < col + size; c += MIN_T) {
+            queued += isBlockQueued(r, c);
+        }
+    }
+
+    if (queued == 0) {
+        return numTasks;
+    }
+    if (size <= tile && queued == (size / MIN_T) * (size / MIN_T)) {
+        if (numTasks == maxTasks) {
+            am_util_stdio_printf("No room for the tiled tasks, this should not happen\n");
+            while(1);
+        }
+        taskIds[numTasks++] = getTileTaskId(size, row, col);
+        return numTasks;
+    }
+
+    int half = size / 2;       // Never below MIN_T, a smallest block is either queued or not
+    numTasks = cutQueuedBlock(half, row, col, tile, taskIds, numTasks, maxTasks);
+    numTasks = cutQueuedBlock(half, row, col + half, tile, taskIds, numTasks, maxTasks);
+    numTasks = cutQueuedBlock(half, row + half, col, tile, taskIds, numTasks, maxTasks);
+    return cutQueuedBlock(half, row + half, col + half, tile, taskIds, numTasks, maxTasks);
+}
+
+/**
+ * @brief Cuts the blocks of queued tasks into the smallest size with at least taskWork smallest blocks in it.
+ *        A part of a T block that is partly done or sent goes out in the largest blocks that fit it.
+ */
+static size_t regroupTiledTasks(uint32_t taskWork, uint16_t *taskIds, size_t numTasks, size_t maxTasks) {
+    int tile = MIN_T;
+    int size, row, col;
+
+    while (tile < T && (uint32_t) ((tile / MIN_T) * (tile / MIN_T)) < taskWork) {
+        tile *= 2;
+    }
+
+    memset(queuedBlocks, 0, sizeof(queuedBlocks));
+    for (size_t i = 0; i < numTasks; i++) {
+        getTile(taskIds[i], &size, &row, &col);
+        for (int r = row; r < row + size; r += MIN_T) {
+            for (int c = col; c < col + size; c += MIN_T) {
+                setBlockQueued(r, c);
+            }
+        }
+    }
+
+    numTasks = 0;
+    for (row = 0; row < M; row += T) {
+        for (col = 0; col < N; col += T) {
+            numTasks = cutQueuedBlock(T, row, col, tile, taskIds, numTasks, maxTasks);
+        }
+    }
+    return numTasks;
+}
+
+// every operand is T rows of A or T columns of B, each row dense or sparse on its own
+
+static uint16_t getStripLength(uint16_t operandId) {
+    if (operandId < M / T) {
+        return rowsLength(&nonzerosA[operandId * T], T);
+    }
+    return rowsLength(&nonzerosB[(operandId - M / T) * T], T);
+}
+
+static void copyStripToSendBuffer(uint8_t *buffer, uint16_t operandId) {
+    if (operandId < M / T) {
+        copyRows(buffer, &MATRIX_A[operandId * T], &nonzerosA[operandId * T], T);
+    } else {
+        copyRows(buffer, &MATRIX_B[(operandId - M / T) * T], &nonzerosB[(operandId - M / T) * T], T);
+    }
+}
+
+static void storeStrip(uint16_t operandId, uint8_t *data, uint16_t len) {
+    bool stored;
+
+    if (operandId < M / T) {
+        stored = storeRows(&operandA[operandId * T], &operandNonzerosA[operandId * T], T, data, len);
+    } else {
+        int j = (operandId - M / T) * T;
+        stored = operandId < M / T + TILES_N && storeRows(&operandB[j], &operandNonzerosB[j], T, data, len);
+    }
+    if (!stored) {
+        am_util_stdio_printf("Unexpected strip %d of length %d\n", operandId, len);
+    }
+}
+
+static void *getStripStorage(uint16_t operandId, uint16_t *size) {
+    if (operandId < M / T) {
+        return getRowStorage(&operandA[operandId * T], T, size);
+    }
+    return operandId < M / T + TILES_N ? getRowStorage(&operandB[(operandId - M / T) * T], T, size) : NULL;
+}
+
+static void initTiledServerTask(Task *task, int slot) {
+    task->data = NULL;
+    task->dataLength = 0;
+    task->result = tileResult[slot];
+}
+
+/**
+ * @brief Copies a block into C and prints the rows it completed
+ * 
+ * @param taskId The task that completed
+ * @param result Its block of C, row by row
+ */
+static void onTiledTaskComplete(int taskId, void *result) {
+    int tile, row, col;
+
+    getTile(taskId, &tile, &row, &col);
+    for (int i = 0; i < tile; i++) {
+        memcpy(&MATRIX_C[row + i][col], (int *) result + i * tile, sizeof(int) * tile);
+        addRowResults(row + i, tile);
+    }
+}
+
+static void reassembleTiledTaskResults(size_t numTasks) {
+    am_util_stdio_printf("All %d rows of the matrix are done, in %d blocks of %dx%d or smaller\n", M, (int) numTasks, T, T);
+}
+
+/**
+ * @brief Multiplies the rows of A and the columns of B of a block, out of their strips, into the block of C,
+ *        with one GEMM when all of them are dense
+ * 
+ * @param task 
+ */
+static void executeTiledTask(Task *task) {
+    int tile, row, col;
+    int *block = task->result;
+    bool dense = true;
+
+    getTile(task->taskId, &tile, &row, &col);
+    if (row >= M) {
+        task->status = DP_TASK_STATUS_UNKNOWN;      // Not an id of any block size
+        return;
+    }
+
+    for (int r = 0; r < tile; r++) {
+        dense &= operandNonzerosA[row + r] == ROW_DENSE && operandNonzerosB[col + r] == ROW_DENSE;
+    }
+
+    if (dense) {
+        DpDspGemmQ15(tile, tile, P, ROW_ELEMENTS(operandA[row]), ROW_HELD, ROW_ELEMENTS(operandB[col]), ROW_HELD,
+                     (int32_t *) block, tile);
+    } else {
+        for (int i = row; i < row + tile; i++) {
+            for (int j = col; j < col + tile; j++) {
+                *block++ = dotRows(ROW_ELEMENTS(operandA[i]), operandNonzerosA[i], ROW_ELEMENTS(operandB[j]),
+                                   operandNonzerosB[j]);
+            }
+        }
+    }
+
+    task->status = DP_TASK_STATUS_COMPLETE;
+    task->dataLength = sizeof(int) * tile * tile;
+}
 
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+const DpKernel matrixMultTiledKernel = {
+    .id = MATRIX_MULT_TILED_KERNEL_ID,
+    .name = "Tiled matrix multiplication",
+    .operandType = DP_ELEMENT_INT16,
+    .resultType = DP_ELEMENT_INT32,
+    .resultSize = sizeof(int) * T * T,       // A slot holds the largest block, the master's smaller ones have getTiledResultSize
+    .initClientTasks = initTiledClientTasks,
+    .getTaskDataLength = getTaskDataLength,
+    .copyTaskDataToSendBuffer = copyTaskDataToSendBuffer,
+    .getTaskResult = getTiledTaskResult,
+    .getTaskOperands = getTiledTaskOperands,
+    .getOperandLength = getStripLength,
+    .copyOperandToSendBuffer = copyStripToSendBuffer,
+    .reassembleTaskResults = reassembleTiledTaskResults,
+    .onTaskComplete = onTiledTaskComplete,
+    .getResultSize = getTiledResultSize,
+    .getTaskWork = getTiledTaskWork,
+    .regroupTasks = regroupTiledTasks,
+    .initServerTask = initTiledServerTask,
+    .storeOperand = storeStrip,
+    .getOperandStorage = getStripStorage,
+    .executeTask = executeTiledTask,
+};
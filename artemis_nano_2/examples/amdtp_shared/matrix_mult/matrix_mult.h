@@ -1,7 +1,75 @@
 #include "distributed_protocol.h"
+#include "dp_wire.h"
 
 #define M 64
 #define N 64
 #define P 64
 
-#define APP_TASK_COUNT (M * N)
\ No newline at end of file
+#define MATRIX_MULT_TASK_COUNT (M * N)
+
+// both work on the same A, B and C, so only one of them runs at a time
+#define MATRIX_MULT_KERNEL_ID 1
+#define MATRIX_MULT_TILED_KERNEL_ID 3
+
+// Every row of A and column of B goes out dense or as its nonzeros with their indices, whichever its
+// density calls for, and the slave multiplies it in the form it arrived in.
+
+#ifndef MATRIX_MULT_SPARSE_DENSITY
+#define MATRIX_MULT_SPARSE_DENSITY  25      // Percent of nonzeros up to which a row is sent sparse, at most 50
+#endif
+#ifndef MATRIX_MULT_A_NONZERO
+#define MATRIX_MULT_A_NONZERO       100     // Percent of the elements of A the demo fills in, lower it for sparse rows
+#endif
+
+#if MATRIX_MULT_SPARSE_DENSITY > 50
+#error "MATRIX_MULT_SPARSE_DENSITY above 50, a sparse row would not fit in the slave's row"
+#endif
+
+// The tiled kernel computes a block of TILE x TILE elements of C per task, from a strip of TILE rows
+// of A and one of TILE columns of B. A task is TILE * TILE dot products for 2 * TILE operand rows.
+
+#ifndef MATRIX_MULT_TILE_RAM
+#define MATRIX_MULT_TILE_RAM    8192    // Bytes of a slave for the blocks of all its DP_MAX_TASKS_PER_CLIENT slots
+#endif
+
+// a dense strip, with the header of each row, and a block each fit in one packet, and the blocks of every slot in MATRIX_MULT_TILE_RAM
+#define MATRIX_MULT_TILE_FITS(tile)                                                             \
+    (M % (tile) == 0 && N % (tile) == 0                                                         \
+     && (tile) * (tile) * 4 * DP_MAX_TASKS_PER_CLIENT <= MATRIX_MULT_TILE_RAM                   \
+     && DP_WIRE_MAX_BATCH_HEADER_SIZE + DP_WIRE_MAX_ENTRY_HEADER_SIZE + 1 + (tile) * (P + 1) * 2 <= AMDTP_MAX_PAYLOAD_SIZE  \
+     && DP_WIRE_MAX_RESPONSE_HEADER_SIZE + DP_WIRE_MAX_ENTRY_HEADER_SIZE + 1 + (tile) * (tile) * 4 <= AMDTP_MAX_PAYLOAD_SIZE)
+
+#ifndef MATRIX_MULT_TILE
+#if MATRIX_MULT_TILE_FITS(16)
+#define MATRIX_MULT_TILE        16
+#elif MATRIX_MULT_TILE_FITS(8)
+#define MATRIX_MULT_TILE        8
+#elif MATRIX_MULT_TILE_FITS(4)
+#define MATRIX_MULT_TILE        4
+#elif MATRIX_MULT_TILE_FITS(2)
+#define MATRIX_MULT_TILE        2
+#else
+#define MATRIX_MULT_TILE        1
+#endif
+#endif
+
+#if !MATRIX_MULT_TILE_FITS(MATRIX_MULT_TILE)
+#error "MATRIX_MULT_TILE does not divide C, or its strips or blocks do not fit"
+#endif
+
+// The master may cut the job into smaller blocks as it runs, halving TILE down to MATRIX_MULT_MIN_TILE, see
+// DP_TUNE_TASK_SIZE. The operands stay the strips of TILE rows, a smaller block reads its part of them.
+
+#ifndef MATRIX_MULT_MIN_TILE
+#define MATRIX_MULT_MIN_TILE    (MATRIX_MULT_TILE < 2 ? MATRIX_MULT_TILE : 2)  // 1 x 1 blocks pay a packet entry per element
+#endif
+
+#if (MATRIX_MULT_TILE & (MATRIX_MULT_TILE - 1)) != 0 || (MATRIX_MULT_MIN_TILE & (MATRIX_MULT_MIN_TILE - 1)) != 0 \
+    || MATRIX_MULT_MIN_TILE > MATRIX_MULT_TILE
+#error "MATRIX_MULT_TILE and MATRIX_MULT_MIN_TILE have to be powers of two, the smaller one the minimum"
+#endif
+
+#define MATRIX_MULT_TILED_TASK_COUNT ((M / MATRIX_MULT_TILE) * (N / MATRIX_MULT_TILE))
+
+extern const DpKernel matrixMultKernel;
+extern const DpKernel matrixMultTiledKernel;
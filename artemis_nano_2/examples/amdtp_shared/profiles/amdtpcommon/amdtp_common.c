@@ -53,6 +53,7 @@
 #include <stdlib.h>
 #include "amdtp_common.h"
 #include "wsf_assert.h"
+#include "wsf_cs.h"
 #include "wsf_trace.h"
 #include "bstream.h"
 #include "att_api.h"
@@ -197,8 +198,8 @@ AmdtpPacketHandler(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, uint16_t len, uint8
             }
 
             amdtpCb->rxState = AMDTP_STATE_RX_IDLE;
+            // txPkt may hold a packet of our own in flight, only the receive side is done
             resetPkt(&amdtpCb->rxPkt);
-            resetPkt(&amdtpCb->txPkt);
             break;
 
         case AMDTP_PKT_TYPE_ACK:
@@ -208,7 +209,7 @@ AmdtpPacketHandler(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, uint16_t len, uint8
             WsfTimerStop(&amdtpCb->timeoutTimer);
             APP_TRACE_INFO0("AmdtpPacketHandler: ACK received\n");
 
-            if (amdtpCb->txState != AMDTP_STATE_TX_IDLE)
+            if (amdtpCb->txState != AMDTP_STATE_TX_IDLE && amdtpCb->txState != AMDTP_STATE_TX_RESERVED)
             {
                 // APP_TRACE_INFO1("set txState back to idle, state = %d\n", amdtpCb->txState);
                 amdtpCb->txState = AMDTP_STATE_TX_IDLE;
@@ -281,22 +282,21 @@ AmdtpPacketHandler(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, uint16_t len, uint8
     }
 }
 
-void
-AmdtpBuildPkt(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8_t *buf, uint16_t len)
+//*****************************************************************************
+//
+// Write length, header and checksum around a payload that is already in place
+//
+//*****************************************************************************
+static void
+amdtpFramePkt(amdtpCb_t *amdtpCb, amdtpPacket_t *pkt, eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint16_t len)
 {
     uint16_t header = 0;
     uint32_t calDataCrc;
-    amdtpPacket_t *pkt;
 
     if (type == AMDTP_PKT_TYPE_DATA)
     {
-        pkt = &amdtpCb->txPkt;
         header = amdtpCb->txPktSn << PACKET_SN_BIT_OFFSET;
     }
-    else
-    {
-        pkt = &amdtpCb->ackPkt;
-    }
 
     //
     // Prepare header frame to be sent first
@@ -319,9 +319,7 @@ AmdtpBuildPkt(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, bool_t encrypted, bool_t
     pkt->data[2] = (header & 0xff);
     pkt->data[3] = (header >> 8);
 
-    // copy data
-    memcpy(&(pkt->data[AMDTP_PREFIX_SIZE_IN_PKT]), buf, len);
-    calDataCrc = CalcCrc32(0xFFFFFFFFU, len, buf);
+    calDataCrc = CalcCrc32(0xFFFFFFFFU, len, &(pkt->data[AMDTP_PREFIX_SIZE_IN_PKT]));
 
     // add checksum
     pkt->data[AMDTP_PREFIX_SIZE_IN_PKT + len] = (calDataCrc & 0xff);
@@ -330,6 +328,81 @@ AmdtpBuildPkt(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, bool_t encrypted, bool_t
     pkt->data[AMDTP_PREFIX_SIZE_IN_PKT + len + 3] = ((calDataCrc >> 24) & 0xff);
 }
 
+void
+AmdtpBuildPkt(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8_t *buf, uint16_t len)
+{
+    amdtpPacket_t *pkt;
+
+    if (type == AMDTP_PKT_TYPE_DATA)
+    {
+        pkt = &amdtpCb->txPkt;
+    }
+    else
+    {
+        pkt = &amdtpCb->ackPkt;
+    }
+
+    // copy data
+    memcpy(&(pkt->data[AMDTP_PREFIX_SIZE_IN_PKT]), buf, len);
+    amdtpFramePkt(amdtpCb, pkt, type, encrypted, enableACK, len);
+}
+
+//*****************************************************************************
+//
+// Reserve the tx packet so the application can write its payload in place.
+// Returns the payload area, room for AMDTP_MAX_PAYLOAD_SIZE bytes, or NULL
+// if a packet is still being sent. Can be called from any task.
+//
+//*****************************************************************************
+uint8_t *
+AmdtpReserveTxPkt(amdtpCb_t *amdtpCb)
+{
+    uint8_t *payload = NULL;
+
+    WSF_CS_INIT(cs);
+    WSF_CS_ENTER(cs);
+    if (amdtpCb->txState == AMDTP_STATE_TX_IDLE)
+    {
+        amdtpCb->txState = AMDTP_STATE_TX_RESERVED;
+        payload = &(amdtpCb->txPkt.data[AMDTP_PREFIX_SIZE_IN_PKT]);
+    }
+    WSF_CS_EXIT(cs);
+
+    return payload;
+}
+
+//*****************************************************************************
+//
+// Give back a reserved tx packet without sending it
+//
+//*****************************************************************************
+void
+AmdtpReleaseTxPkt(amdtpCb_t *amdtpCb)
+{
+    if (amdtpCb->txState == AMDTP_STATE_TX_RESERVED)
+    {
+        amdtpCb->txState = AMDTP_STATE_TX_IDLE;
+    }
+}
+
+//*****************************************************************************
+//
+// Send the data packet written into a reserved tx packet, len is the payload length
+//
+//*****************************************************************************
+void
+AmdtpSendReservedPkt(amdtpCb_t *amdtpCb, bool_t encrypted, bool_t enableACK, uint16_t len)
+{
+    WSF_ASSERT(amdtpCb->txState == AMDTP_STATE_TX_RESERVED);
+
+    amdtpFramePkt(amdtpCb, &amdtpCb->txPkt, AMDTP_PKT_TYPE_DATA, encrypted, enableACK, len);
+
+    // go straight to sending, the packet must not fall back to idle where another task could reserve it
+    amdtpCb->txPkt.offset = 0;
+    amdtpCb->txState = AMDTP_STATE_SENDING;
+    AmdtpSendPacketHandler(amdtpCb);
+}
+
 //*****************************************************************************
 //
 // Send Reply to Sender
@@ -388,6 +461,12 @@ AmdtpSendPacketHandler(amdtpCb_t *amdtpCb)
     uint16_t remainingBytes = 0;
     amdtpPacket_t *txPkt = &amdtpCb->txPkt;
 
+    if ( amdtpCb->txState == AMDTP_STATE_TX_RESERVED )
+    {
+        // still being filled in, AmdtpSendReservedPkt starts it
+        return;
+    }
+
     if ( amdtpCb->txState == AMDTP_STATE_TX_IDLE )
     {
         txPkt->offset = 0;
@@ -93,6 +93,7 @@ typedef enum eAmdtpState
     AMDTP_STATE_SENDING,
     AMDTP_STATE_GETTING_DATA,
     AMDTP_STATE_WAITING_ACK,
+    AMDTP_STATE_TX_RESERVED,                // tx packet handed to the application to fill in
     AMDTP_STATE_MAX
 }eAmdtpState_t;
 
@@ -201,6 +202,15 @@ amdtpCb_t;
 void
 AmdtpBuildPkt(amdtpCb_t *amdtpCb, eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8_t *buf, uint16_t len);
 
+uint8_t *
+AmdtpReserveTxPkt(amdtpCb_t *amdtpCb);
+
+void
+AmdtpReleaseTxPkt(amdtpCb_t *amdtpCb);
+
+void
+AmdtpSendReservedPkt(amdtpCb_t *amdtpCb, bool_t encrypted, bool_t enableACK, uint16_t len);
+
 eAmdtpStatus_t
 AmdtpReceivePkt(amdtpCb_t *amdtpCb, amdtpPacket_t *pkt, uint16_t len, uint8_t *pValue);
 
@@ -0,0 +1,315 @@
+#!/usr/bin/python3
+#
+# Turns the dp_trace dumps of the distributed protocol into per-client timelines.
+#
+# The master prints its timeline after every job, each slave once its worker was
+# idle for DP_TRACE_IDLE_MS. Pass the logs of the master and of every slave, in
+# any order, or one log holding all of them such as the output of dp_sim -v.
+# Only the last run of the master is shown, from the start of a job while none
+# was running to the end of the last job that overlapped with it. A full
+# timeline drops the events of the tasks after it, the starts and ends of the
+# jobs still go in, and the begin line counts what was dropped.
+#
+#   dp_timeline.py master.log slave1.log slave2.log
+#   dp_timeline.py --png timeline.png master.log slave*.log
+#   ../../dp_sim/build/dp_sim -v | dp_timeline.py -
+#
+
+import sys
+import argparse
+from collections import defaultdict
+
+TRACE_PREFIX = 'dp_trace,'
+WRAP = 1 << 32                                          # Timestamps are 32 bit counters
+
+
+class Dump:
+    def __init__(self, role, clockHz, lost):
+        self.role = role
+        self.clockHz = clockHz
+        self.lost = lost
+        self.events = []                                # (seconds, event, (job, task), client)
+
+    def add(self, raw, event, task, client):
+        # the counter wraps, the events are in the order they were recorded
+        if self.events and raw + self.base < self.last:
+            self.base += WRAP
+        self.last = raw + self.base
+        self.events.append((self.last / self.clockHz, event, task, client))
+
+    def start(self):
+        self.base = 0
+        self.last = 0
+
+
+def read_dumps(files):
+    dumps = []
+    dump = None
+
+    for name in files:
+        stream = sys.stdin if name == '-' else open(name, errors='replace')
+        for line in stream:
+            pos = line.find(TRACE_PREFIX)
+            if pos < 0:
+                continue
+            fields = line[pos + len(TRACE_PREFIX):].strip().split(',')
+            try:
+                if fields[0] == 'begin':
+                    dump = Dump(fields[1], int(fields[2]), int(fields[3]))
+                    dump.start()
+                elif fields[0] == 'end':
+                    if dump is not None:
+                        dumps.append(dump)
+                    dump = None
+                elif dump is not None:
+                    # task ids are per job, dumps without a job id hold a single one
+                    job = int(fields[4]) if len(fields) > 4 else 0
+                    dump.add(int(fields[0]), fields[1], (job, int(fields[2])), int(fields[3]))
+            except (IndexError, ValueError):
+                dump = None                             # Garbled line, drop the dump it belongs to
+        if stream is not sys.stdin:
+            stream.close()
+    return dumps
+
+
+class Client:
+    def __init__(self, connId):
+        self.connId = connId
+        self.dispatched = {}                            # Task id to first dispatch time
+        self.responses = {}                             # Task id to last response time
+        self.requeues = []                              # (time, task)
+        self.transfers = []                             # (start, end) of the link carrying a batch
+        self.compute = []                               # (start, end, task) on the master's clock
+        self.hasCompute = False
+        self.local = False                              # The master's own lane, it records its tasks itself
+
+    def name(self):
+        return 'local' if self.local else 'client %d' % self.connId
+
+
+def last_run(master):
+    # the master dumps whatever it recorded since the previous dump, find the last run of jobs in it
+    start = None
+    end = None
+    lastEnd = None
+    running = set()
+    for i, (time, event, (job, task), client) in enumerate(master.events):
+        if event == 'job_start':
+            if not running:
+                start = i
+                end = None
+            running.add(job)
+        elif event == 'job_end':
+            lastEnd = time
+            if job in running:
+                running.discard(job)
+                if not running:
+                    end = time
+    if start is None:
+        if not master.lost or not master.events:
+            return None
+        # the start of the run is missing from this log, show what is left of it
+        print('warning: the timeline holds no job start, it begins with the oldest event kept', file=sys.stderr)
+        return master.events, master.events[0][0], lastEnd
+    events = master.events[start:]
+    return events, events[0][0], end
+
+
+def build_clients(events):
+    clients = {}
+    pending = defaultdict(lambda: None)                 # Client to the start of a transfer not acknowledged yet
+    running = {}
+
+    for time, event, task, connId in events:
+        if connId == 0:
+            continue
+        client = clients.setdefault(connId, Client(connId))
+        if event == 'dispatch':
+            client.dispatched.setdefault(task, time)
+            if pending[connId] is None:
+                pending[connId] = time
+        elif event == 'tx_done':
+            if pending[connId] is not None:
+                client.transfers.append((pending[connId], time))
+                pending[connId] = None
+        elif event == 'response':
+            client.responses[task] = time
+        elif event == 'requeue':
+            client.requeues.append((time, task))
+        elif event == 'start':
+            running[task] = time
+            client.local = client.hasCompute = True
+        elif event == 'end' and task in running:
+            client.compute.append((running.pop(task), time, task))
+    return clients
+
+
+def align_slave(dump, clients):
+    """
+    Finds the client a slave dump belongs to and the offset of its clock: a task starts on the
+    slave after the master dispatched it and ends before the master has its result.
+    """
+    starts = {}
+    ends = {}
+    for time, event, task, client in dump.events:
+        if event == 'start':
+            starts.setdefault(task, time)
+        elif event == 'end':
+            ends[task] = time
+
+    # speculative copies put a task on several clients, the times tell them apart
+    best = None
+    for client in clients.values():
+        common = [task for task in starts if task in client.dispatched]
+        if not common or client.local:
+            continue
+        low = max(client.dispatched[task] - starts[task] for task in common)
+        highs = [client.responses[task] - ends[task] for task in common if task in client.responses and task in ends]
+        high = min(highs) if highs else low
+        key = (max(0.0, low - high), -len(common))
+        if best is None or key < best[0]:
+            best = (key, client, low, high)
+    if best is None:
+        return None, 0.0
+
+    key, client, low, high = best
+    if low > high:
+        print('warning: slave timeline for client %d does not line up, clocks drifted by %.3f ms'
+              % (client.connId, (low - high) * 1000), file=sys.stderr)
+    return client, (low + high) / 2
+
+
+def add_compute(dump, client, offset):
+    running = {}
+    for time, event, task, connId in dump.events:
+        if event == 'start':
+            running[task] = time + offset
+        elif event == 'end' and task in running:
+            client.compute.append((running.pop(task), time + offset, task))
+    client.hasCompute = True
+
+
+def busy_time(spans, start, end):
+    return sum(max(0.0, min(e, end) - max(s, start)) for s, e, *rest in spans)
+
+
+def print_report(clients, start, end, lost):
+    makespan = end - start
+    print('makespan        %.3f ms' % (makespan * 1000))
+    if lost:
+        print('lost events     %d, increase DP_TRACE_LEN for a full timeline' % lost)
+    print()
+    print(' client  tasks  results  requeues  link_ms  link_util  busy_ms  busy_util  first_ms  last_ms')
+    for connId in sorted(clients):
+        client = clients[connId]
+        link = busy_time(client.transfers, start, end)
+        if client.hasCompute:
+            busy = busy_time(client.compute, start, end)
+            busyText = '%7.1f  %8.1f%%' % (busy * 1000, 100 * busy / makespan)
+        else:
+            busyText = '%7s  %9s' % ('-', '-')
+        first = min(client.dispatched.values(), default=start) - start
+        last = max(client.responses.values(), default=start) - start
+        print('%7s  %5d  %7d  %8d  %7.1f  %8.1f%%  %s  %8.1f  %7.1f' % (
+            'local' if client.local else connId, len(client.dispatched), len(client.responses), len(client.requeues),
+            link * 1000, 100 * link / makespan, busyText, first * 1000, last * 1000))
+
+
+def print_gantt(clients, start, end, width):
+    scale = width / (end - start)
+    shades = ' .:+#'                                    # Share of each column that is busy, in quarters
+
+    def row(spans):
+        busy = [0.0] * width
+        for s, e, *rest in spans:
+            s = (s - start) * scale
+            e = (e - start) * scale
+            for i in range(max(0, int(s)), min(width, int(e) + 1)):
+                busy[i] += max(0.0, min(e, i + 1) - max(s, i))
+        cells = [shades[min(4, int(b * 4 + 0.999))] for b in busy]
+        return cells
+
+    print()
+    print('%-13s|%s| %.1f ms' % ('', '-' * width, (end - start) * 1000))
+    for connId in sorted(clients):
+        client = clients[connId]
+        link = row(client.transfers)
+        for time, task in client.requeues:
+            link[min(width - 1, max(0, int((time - start) * scale)))] = 'x'
+        if not client.local:
+            print('%-13s|%s|' % (client.name() + ' tx', ''.join(link)))
+        if client.hasCompute:
+            print('%-13s|%s|' % (client.name() + ' cpu', ''.join(row(client.compute))))
+    print('%-13s  %s busy for up to a quarter of the column ... %s all of it, x requeued' % ('', shades[1], shades[4]))
+
+
+def plot_gantt(clients, start, end, path):
+    try:
+        import matplotlib
+    except ImportError:
+        sys.exit('--png needs matplotlib')
+    matplotlib.use('Agg')
+    import matplotlib.pyplot as plt
+
+    rows = []
+    for connId in sorted(clients):
+        client = clients[connId]
+        if not client.local:
+            rows.append((client.name() + ' tx', client.transfers, 'tab:blue', connId))
+        if client.hasCompute:
+            rows.append((client.name() + ' cpu', client.compute, 'tab:green', connId))
+
+    fig, ax = plt.subplots(figsize=(12, 0.5 * len(rows) + 1))
+    for y, (label, spans, color, connId) in enumerate(rows):
+        bars = [((s - start) * 1000, max((e - s) * 1000, 0.01)) for s, e, *rest in spans]
+        ax.broken_barh(bars, (y - 0.4, 0.8), facecolors=color)
+    for y, (label, spans, color, connId) in enumerate(rows):
+        for time, task in clients[connId].requeues:
+            ax.plot((time - start) * 1000, y, 'rx')
+    ax.set_yticks(range(len(rows)))
+    ax.set_yticklabels([row[0] for row in rows])
+    ax.invert_yaxis()
+    ax.set_xlabel('ms since job start')
+    ax.set_xlim(0, (end - start) * 1000)
+    fig.tight_layout()
+    fig.savefig(path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-client timelines from dp_trace dumps')
+    parser.add_argument('logs', nargs='+', help='logs of the master and the slaves, - for stdin')
+    parser.add_argument('--width', type=int, default=100, help='columns of the text chart')
+    parser.add_argument('--png', help='also draw the chart into this file, needs matplotlib')
+    args = parser.parse_args()
+
+    dumps = read_dumps(args.logs)
+    masters = [dump for dump in dumps if dump.role == 'master']
+    if not masters:
+        sys.exit('no master timeline found, is DP_TRACE enabled?')
+
+    run = last_run(masters[-1])
+    if run is None:
+        sys.exit('the master timeline holds no job start, increase DP_TRACE_LEN')
+    events, start, end = run
+    if end is None:
+        end = events[-1][0]
+        print('warning: a job did not finish in this timeline', file=sys.stderr)
+
+    clients = build_clients(events)
+    lost = masters[-1].lost
+    for dump in dumps:
+        if dump.role != 'slave':
+            continue
+        client, offset = align_slave(dump, clients)
+        if client is not None:
+            add_compute(dump, client, offset)
+            lost += dump.lost
+
+    print_report(clients, start, end, lost)
+    print_gantt(clients, start, end, args.width)
+    if args.png:
+        plot_gantt(clients, start, end, args.png)
+
+
+if __name__ == '__main__':
+    main()
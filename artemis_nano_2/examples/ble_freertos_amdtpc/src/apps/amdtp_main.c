@@ -719,6 +719,10 @@ void amdtpDtpTransCback(eAmdtpStatus_t status, dmConnId_t connId)
     {
         AmdtpcSendTestData(connId);
     }
+
+  if (distributionProtocolTaskHandle != NULL) {
+    DpTransCb(status, connId);
+  }
 }
 
 /*************************************************************************************************/
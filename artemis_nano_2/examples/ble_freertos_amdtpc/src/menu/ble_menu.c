@@ -266,9 +266,23 @@ static void handleSelection(void)
             handleAMDTPSlection();
             break;
         case BLE_MENU_ID_DISTRIBUTED:
-            am_menu_printf("Starting distributed tasks...\n");
-            xTaskCreate(doDistributedTask, "Distributed Task", 1024, NULL, 1, &distributionProtocolTaskHandle);
+        {
+            // a '!' after the id starts an urgent job, a '-' a batch job
+            eDpPriority_t priority = DP_PRIORITY_NORMAL;
+            if (menuRxDataLen > 1 && menuRxData[1] == '!')
+            {
+                priority = DP_PRIORITY_URGENT;
+            }
+            else if (menuRxDataLen > 1 && menuRxData[1] == '-')
+            {
+                priority = DP_PRIORITY_BATCH;
+            }
+            if (DpStartJobWithPriority(menuRxData[0] - '0', priority))
+            {
+                am_menu_printf("Starting distributed tasks...\n");
+            }
             break;
+        }
         default:
             am_menu_printf("handleSelection() unknown input\n");
             break;
@@ -353,7 +367,8 @@ BleMenuShowMenu(void)
             BLEMenuShowAMDTPMenu();
             break;
         case BLE_MENU_ID_DISTRIBUTED:
-            am_menu_printf("Press any key to start!\n");
+            am_menu_printf("Select a job to start, add ! to run it urgently or - as a batch job:\n");
+            DpPrintKernels();
             break;
         default:
             break;
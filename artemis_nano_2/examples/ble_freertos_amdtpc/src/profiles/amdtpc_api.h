@@ -104,6 +104,15 @@ amdtpc_proc_msg(wsfMsgHdr_t *pMsg);
 eAmdtpStatus_t
 AmdtpcSendPacket(eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8_t *buf, uint16_t len, dmConnId_t connId);
 
+uint8_t *
+AmdtpcReserveTxBuf(dmConnId_t connId);
+
+void
+AmdtpcReleaseTxBuf(dmConnId_t connId);
+
+eAmdtpStatus_t
+AmdtpcSendTxBuf(bool_t encrypted, bool_t enableACK, uint16_t len, dmConnId_t connId);
+
 #ifdef __cplusplus
 };
 #endif
@@ -66,9 +66,9 @@ static void amdtpcHandleWriteResponse(attEvt_t *pMsg);
 //
 //*****************************************************************************
 
-uint8_t rxPktBuf[AMDTP_PACKET_SIZE][DM_CONN_MAX];
-uint8_t txPktBuf[AMDTP_PACKET_SIZE][DM_CONN_MAX];
-uint8_t ackPktBuf[20][DM_CONN_MAX];
+static uint8_t rxPktBuf[DM_CONN_MAX][AMDTP_PACKET_SIZE];
+static uint8_t txPktBuf[DM_CONN_MAX][AMDTP_PACKET_SIZE];
+static uint8_t ackPktBuf[DM_CONN_MAX][20];
 
 
 /**************************************************************************************************
@@ -371,12 +371,13 @@ amdtpcValueNtf(attEvt_t *pMsg)
         if ( g_requestServerSendStop ) //double check this
         {
             // if issuing "Request Server to send command" while receiving notification data, ignore the notification data
-            amdtpcCb[connId - 1].core.txPkt.header.pktType = AMDTP_PKT_TYPE_DATA;
+            amdtpcCb[connId - 1].core.rxPkt.header.pktType = AMDTP_PKT_TYPE_DATA;
             status = AMDTP_STATUS_RECEIVE_DONE;
         }
         else
         {
-            status = AmdtpReceivePkt(&amdtpcCb[connId - 1].core, &amdtpcCb[connId - 1].core.txPkt, pMsg->valueLen, pMsg->pValue);
+            // server data has its own buffer so it can arrive while our packet is being built or sent
+            status = AmdtpReceivePkt(&amdtpcCb[connId - 1].core, &amdtpcCb[connId - 1].core.rxPkt, pMsg->valueLen, pMsg->pValue);
         }
     }
 
@@ -392,7 +393,7 @@ amdtpcValueNtf(attEvt_t *pMsg)
         }
         else if ( pMsg->handle == amdtpcCb[connId - 1].attTxHdl )
         {
-            pkt = &amdtpcCb[connId - 1].core.txPkt;
+            pkt = &amdtpcCb[connId - 1].core.rxPkt;
         }
 
         AmdtpPacketHandler(&amdtpcCb[connId - 1].core, (eAmdtpPktType_t)pkt->header.pktType, pkt->len - AMDTP_CRC_SIZE_IN_PKT, pkt->data);
@@ -494,3 +495,77 @@ AmdtpcSendPacket(eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8
 
     return AMDTP_STATUS_SUCCESS;
 }
+
+//*****************************************************************************
+//
+//! @brief Reserve the tx packet of a connection so the payload can be written
+//! straight into it, send it with AmdtpcSendTxBuf
+//!
+//! @param connId - connection to send on
+//!
+//! @return room for AMDTP_MAX_PAYLOAD_SIZE bytes, NULL if not ready to send
+//
+//*****************************************************************************
+uint8_t *
+AmdtpcReserveTxBuf(dmConnId_t connId)
+{
+    uint8_t *buf;
+
+    //
+    // Check if ready to send notification
+    //
+    if ( !amdtpcCb[connId - 1].txReady )
+    {
+        APP_TRACE_INFO1("data sending failed, not ready for notification.", NULL);
+        return NULL;
+    }
+
+    buf = AmdtpReserveTxPkt(&amdtpcCb[connId - 1].core);
+    if ( buf == NULL )
+    {
+        APP_TRACE_INFO1("data sending failed, tx state = %d", amdtpcCb[connId - 1].core.txState);
+    }
+    return buf;
+}
+
+//*****************************************************************************
+//
+//! @brief Give back a reserved tx packet without sending it
+//
+//*****************************************************************************
+void
+AmdtpcReleaseTxBuf(dmConnId_t connId)
+{
+    AmdtpReleaseTxPkt(&amdtpcCb[connId - 1].core);
+}
+
+//*****************************************************************************
+//
+//! @brief Send a data packet written into the buffer from AmdtpcReserveTxBuf
+//!
+//! @param encrypted - is packet encrypted
+//! @param enableACK - does client need to response
+//! @param len - data length
+//! @param connId - connection to send on
+//!
+//! @return status
+//
+//*****************************************************************************
+eAmdtpStatus_t
+AmdtpcSendTxBuf(bool_t encrypted, bool_t enableACK, uint16_t len, dmConnId_t connId)
+{
+    //
+    // Check if data length is valid
+    //
+    if ( len > AMDTP_MAX_PAYLOAD_SIZE )
+    {
+        APP_TRACE_INFO1("data sending failed, exceed maximum payload, len = %d.", len);
+        AmdtpReleaseTxPkt(&amdtpcCb[connId - 1].core);
+        return AMDTP_STATUS_INVALID_PKT_LENGTH;
+    }
+
+    APP_TRACE_INFO0("AmdtpcSendTxBuf()");
+    AmdtpSendReservedPkt(&amdtpcCb[connId - 1].core, encrypted, enableACK, len);
+
+    return AMDTP_STATUS_SUCCESS;
+}
@@ -96,6 +96,7 @@
 #include "amdtpc_api.h"
 #include "app_ui.h"
 #include "distributed_sum.h"
+#include "matrix_mult.h"
 
 #ifdef BLE_MENU
 #include "ble_menu.h"
@@ -349,6 +350,9 @@ RadioTask(void *pvParameters)
 
     // initialize and clear all existing clients in distributed protocol
     initializeDistributedProtocol();
+    DpRegisterKernel(&matrixMultKernel);
+    DpRegisterKernel(&matrixMultTiledKernel);
+    DpRegisterKernel(&distributedSumKernel);
 
     //
     // Start the "Amdtp" profile.
@@ -102,6 +102,15 @@ void amdtps_stop(dmConnId_t connId);
 eAmdtpStatus_t
 AmdtpsSendPacket(eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8_t *buf, uint16_t len, dmConnId_t connId);
 
+uint8_t *
+AmdtpsReserveTxBuf(dmConnId_t connId);
+
+void
+AmdtpsReleaseTxBuf(dmConnId_t connId);
+
+eAmdtpStatus_t
+AmdtpsSendTxBuf(bool_t encrypted, bool_t enableACK, uint16_t len, dmConnId_t connId);
+
 #ifdef __cplusplus
 }
 #endif
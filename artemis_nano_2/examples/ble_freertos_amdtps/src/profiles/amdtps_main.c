@@ -74,9 +74,9 @@
 //
 //*****************************************************************************
 
-uint8_t rxPktBuf[AMDTP_PACKET_SIZE];
-uint8_t txPktBuf[AMDTP_PACKET_SIZE];
-uint8_t ackPktBuf[20];
+static uint8_t rxPktBuf[AMDTP_PACKET_SIZE];
+static uint8_t txPktBuf[AMDTP_PACKET_SIZE];
+static uint8_t ackPktBuf[20];
 
 #if defined(AMDTPS_RXONLY) || defined(AMDTPS_RX2TX)
 static int totalLen = 0;
@@ -160,9 +160,10 @@ static void amdtpsSetupToSend(void)
 //
 //*****************************************************************************
 static amdtpsConn_t*
-amdtps_find_next2send(void)
+amdtps_find_next2send(dmConnId_t connId)
 {
-    amdtpsConn_t *pConn = amdtpsCb.conn;
+    // the connection the packet belongs to, a relay's master is not necessarily the first one
+    amdtpsConn_t *pConn = &amdtpsCb.conn[connId - 1];
     return pConn;
 }
 
@@ -175,7 +176,7 @@ static void
 amdtpsSendData(uint8_t *buf, uint16_t len, dmConnId_t connId)
 {
     amdtpsSetupToSend();
-    amdtpsConn_t *pConn = amdtps_find_next2send();
+    amdtpsConn_t *pConn = amdtps_find_next2send(connId);
     /* send notification */
 #ifdef AMDTP_DEBUG_ON
         APP_TRACE_INFO1("amdtpsSendData(), Send to connId = %d\n", pConn->connId);
@@ -192,7 +193,7 @@ amdtpsSendAck(eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8_t
     AmdtpBuildPkt(&amdtpsCb.core[connId - 1], type, encrypted, enableACK, buf, len);
     // send packet
     amdtpsSetupToSend();
-    amdtpsConn_t *pConn = amdtps_find_next2send();
+    amdtpsConn_t *pConn = amdtps_find_next2send(connId);
     /* send notification */
 #ifdef AMDTP_DEBUG_ON
         APP_TRACE_INFO1("amdtpsSendAck(), Send to connId = %d\n", pConn->connId);
@@ -516,3 +517,76 @@ AmdtpsSendPacket(eAmdtpPktType_t type, bool_t encrypted, bool_t enableACK, uint8
 
     return AMDTP_STATUS_SUCCESS;
 }
+
+//*****************************************************************************
+//
+//! @brief Reserve the tx packet of a connection so the payload can be written
+//! straight into it, send it with AmdtpsSendTxBuf
+//!
+//! @param connId - connection handle
+//!
+//! @return room for AMDTP_MAX_PAYLOAD_SIZE bytes, NULL if not ready to send
+//
+//*****************************************************************************
+uint8_t *
+AmdtpsReserveTxBuf(dmConnId_t connId)
+{
+    uint8_t *buf;
+
+    //
+    // Check if ready to send notification
+    //
+    if ( !amdtpsCb.txReady[connId - 1] )
+    {
+        APP_TRACE_INFO1("data sending failed, not ready for notification.", NULL);
+        return NULL;
+    }
+
+    buf = AmdtpReserveTxPkt(&amdtpsCb.core[connId - 1]);
+    if ( buf == NULL )
+    {
+        APP_TRACE_INFO1("data sending failed, tx state = %d", amdtpsCb.core[connId - 1].txState);
+    }
+    return buf;
+}
+
+//*****************************************************************************
+//
+//! @brief Give back a reserved tx packet without sending it
+//
+//*****************************************************************************
+void
+AmdtpsReleaseTxBuf(dmConnId_t connId)
+{
+    AmdtpReleaseTxPkt(&amdtpsCb.core[connId - 1]);
+}
+
+//*****************************************************************************
+//
+//! @brief Send a data packet written into the buffer from AmdtpsReserveTxBuf
+//!
+//! @param encrypted - is packet encrypted
+//! @param enableACK - does client need to response
+//! @param len - data length
+//! @param connId - connection handle
+//!
+//! @return status
+//
+//*****************************************************************************
+eAmdtpStatus_t
+AmdtpsSendTxBuf(bool_t encrypted, bool_t enableACK, uint16_t len, dmConnId_t connId)
+{
+    //
+    // Check if data length is valid
+    //
+    if ( len > AMDTP_MAX_PAYLOAD_SIZE )
+    {
+        APP_TRACE_INFO1("data sending failed, exceed maximum payload, len = %d.", len);
+        AmdtpReleaseTxPkt(&amdtpsCb.core[connId - 1]);
+        return AMDTP_STATUS_INVALID_PKT_LENGTH;
+    }
+
+    AmdtpSendReservedPkt(&amdtpsCb.core[connId - 1], encrypted, enableACK, len);
+
+    return AMDTP_STATUS_SUCCESS;
+}
@@ -85,6 +85,9 @@
 #include "am_bsp.h"
 
 #include "distributed_protocol.h"
+#include "distributed_sum.h"
+#include "matrix_mult.h"
+#include "dsp_kernels.h"
 
 #include "hci_apollo_config.h"
 #include "wsf_msg.h"
@@ -305,7 +308,14 @@ RadioTask(void *pvParameters)
         HciVscSetCustom_BDAddr(&bd_addr[0]);
     }
 
+#if DP_DSP_BENCHMARK
+    DpDspBenchmark();
+#endif
+
     initializeDistributedProtocol();
+    DpRegisterKernel(&matrixMultKernel);
+    DpRegisterKernel(&matrixMultTiledKernel);
+    DpRegisterKernel(&distributedSumKernel);
 
     //
     // Start the "Amdtp" profile.
@@ -0,0 +1,37 @@
+#
+# Reads the report of a dp_sim run for the check target of the Makefile and
+# passes it through. Fails unless the run ended with a correct result, within
+# max_ms of simulated time, and every slave ran at least min_tasks tasks.
+#
+#   ./build/dp_sim -k 3 | awk -v max_ms=600 -v min_tasks=8 -f check.awk
+#
+
+{ print }
+
+$1 == "result" { result = $2 }
+$1 == "makespan_ms" { makespan = $2 }
+
+# the client table, relays run no tasks of their own
+$1 ~ /^[0-9]+$/ && $3 == "slave" {
+    slaves++
+    if ($5 < min_tasks) {
+        printf "check: slave %d ran %d tasks, expected at least %d\n", $1, $5, min_tasks
+        failed = 1
+    }
+}
+
+END {
+    if (result != "ok") {
+        printf "check: result %s\n", result == "" ? "missing" : result
+        failed = 1
+    }
+    if (makespan == "" || makespan > max_ms) {
+        printf "check: makespan %s ms, expected at most %d\n", makespan == "" ? "missing" : makespan, max_ms
+        failed = 1
+    }
+    if (slaves == 0) {
+        print "check: no slave in the report"
+        failed = 1
+    }
+    exit failed
+}
@@ -0,0 +1,25 @@
+//*****************************************************************************
+//
+// Host run of the DSP kernel benchmark: checks the SIMD kernels, with the
+// intrinsics of src/shim/am_mcu_apollo.h, against their plain C reference.
+// The host's nanoseconds stand in for cycles, the numbers that count are the
+// ones a slave prints with DP_DSP_BENCHMARK.
+//
+//*****************************************************************************
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "am_util_stdio.h"
+#include "dsp_kernels.h"
+
+uint32_t am_util_stdio_printf(const char *pcFmt, ...) {
+    va_list args;
+    va_start(args, pcFmt);
+    int len = vprintf(pcFmt, args);
+    va_end(args);
+    return (uint32_t) len;
+}
+
+int main(void) {
+    return DpDspBenchmark() ? 0 : 1;
+}
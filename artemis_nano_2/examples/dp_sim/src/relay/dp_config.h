@@ -0,0 +1,3 @@
+// relay nodes of the simulator, a slave to their parent and a master to their own slaves
+#define DP_MASTER 1
+#define DP_SLAVE 1
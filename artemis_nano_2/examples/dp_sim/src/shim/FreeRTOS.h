@@ -0,0 +1,41 @@
+//*****************************************************************************
+//
+// Host shim of the FreeRTOS kernel API used by the distributed protocol.
+// Tasks run on the deterministic scheduler in sim_rtos.c, in virtual time.
+//
+//*****************************************************************************
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define configTICK_RATE_HZ          1000        // Same as the firmware FreeRTOSConfig.h
+#define configSUPPORT_STATIC_ALLOCATION 1
+#define configSTACK_DEPTH_TYPE      uint16_t
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define portMAX_DELAY               ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS          ((TickType_t) 1000 / configTICK_RATE_HZ)
+
+#define pdFALSE                     ((BaseType_t) 0)
+#define pdTRUE                      ((BaseType_t) 1)
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+
+#define pdMS_TO_TICKS(xTimeInMs)    ((TickType_t) (((TickType_t) (xTimeInMs) * (TickType_t) configTICK_RATE_HZ) / (TickType_t) 1000U))
+
+// the scheduler is cooperative, nothing can interrupt a task between two kernel calls
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskYIELD()                 vTaskDelay(0)
+
+// the kernel keeps its own control blocks, the static buffers are only there for the firmware's sake
+typedef struct { uint8_t reserved; } StaticTask_t;
+typedef struct { uint8_t reserved; } StaticQueue_t;
+
+#endif // FREERTOS_H
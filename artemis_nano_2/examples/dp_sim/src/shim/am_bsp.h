@@ -0,0 +1,6 @@
+#ifndef AM_BSP_H
+#define AM_BSP_H
+
+// nothing of it is used on the host
+
+#endif // AM_BSP_H
@@ -0,0 +1,63 @@
+#ifndef AM_MCU_APOLLO_H
+#define AM_MCU_APOLLO_H
+
+#include <stdint.h>
+#include <time.h>
+
+// STIMER counter at 32768 Hz, the clock of the distributed protocol's timeline
+uint32_t am_hal_stimer_counter_get(void);
+
+// the DSP intrinsics of CMSIS in plain C, bit exact, so the packed code paths of the kernels run on the host
+
+static inline uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3) {
+    int32_t low = (int16_t) op1 * (int16_t) op2;
+    int32_t high = (int16_t) (op1 >> 16) * (int16_t) (op2 >> 16);
+    return op3 + (uint32_t) low + (uint32_t) high;
+}
+
+static inline uint64_t __SMLALD(uint32_t op1, uint32_t op2, uint64_t acc) {
+    int64_t low = (int16_t) op1 * (int16_t) op2;
+    int64_t high = (int16_t) (op1 >> 16) * (int16_t) (op2 >> 16);
+    return acc + (uint64_t) low + (uint64_t) high;
+}
+
+static inline uint32_t __SXTB16(uint32_t op1) {
+    return ((uint32_t) (int16_t) (int8_t) op1 & 0xFFFF) | ((uint32_t) (int16_t) (int8_t) (op1 >> 16) << 16);
+}
+
+static inline uint32_t __ROR(uint32_t op1, uint32_t op2) {
+    op2 %= 32;
+    return op2 == 0 ? op1 : (op1 >> op2) | (op1 << (32 - op2));
+}
+
+// the DWT cycle counter, counting the host's nanoseconds
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} simDwt_t;
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} simCoreDebug_t;
+
+static inline simDwt_t *simDwtRead(void) {
+    static simDwt_t dwt;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dwt.CYCCNT = (uint32_t) ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec);
+    return &dwt;
+}
+
+static inline simCoreDebug_t *simCoreDebug(void) {
+    static simCoreDebug_t coreDebug;
+    return &coreDebug;
+}
+
+#define DWT                         (simDwtRead())
+#define CoreDebug                   (simCoreDebug())
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+#endif // AM_MCU_APOLLO_H
@@ -0,0 +1,7 @@
+#ifndef AM_UTIL_H
+#define AM_UTIL_H
+
+#include "am_util_stdio.h"
+#include "am_util_debug.h"
+
+#endif // AM_UTIL_H
@@ -0,0 +1,6 @@
+#ifndef AM_UTIL_DEBUG_H
+#define AM_UTIL_DEBUG_H
+
+#include "am_util_stdio.h"
+
+#endif // AM_UTIL_DEBUG_H
@@ -0,0 +1,10 @@
+#ifndef AM_UTIL_STDIO_H
+#define AM_UTIL_STDIO_H
+
+#include <stdint.h>
+
+// printed with the virtual time and the node in front, filtered by the simulator's verbosity
+uint32_t am_util_stdio_printf(const char *pcFmt, ...);
+uint32_t am_util_debug_printf(const char *pcFmt, ...);
+
+#endif // AM_UTIL_STDIO_H
@@ -0,0 +1,11 @@
+#ifndef APP_API_H
+#define APP_API_H
+
+#include "dm_api.h"
+#include "att_api.h"
+
+uint8_t AppConnOpenList(dmConnId_t *pConnIdList);
+void AppDiscFindService(dmConnId_t connId, uint8_t uuidLen, uint8_t *pUuid, uint8_t listLen,
+                        attcDiscChar_t **pCharList, uint16_t *pHdlList);
+
+#endif // APP_API_H
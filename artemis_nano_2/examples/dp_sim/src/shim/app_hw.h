@@ -0,0 +1,6 @@
+#ifndef APP_HW_H
+#define APP_HW_H
+
+// nothing of it is used on the host
+
+#endif // APP_HW_H
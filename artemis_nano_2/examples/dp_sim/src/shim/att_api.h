@@ -0,0 +1,55 @@
+#ifndef ATT_API_H
+#define ATT_API_H
+
+#include "wsf_timer.h"
+#include "dm_api.h"
+
+#define ATT_SUCCESS                 0x00
+#define ATT_HANDLE_NONE             0x0000
+#define ATT_DEFAULT_MTU             23
+#define ATT_DEFAULT_PAYLOAD_LEN     20
+#define ATT_MAX_MTU                 247
+#define ATT_16_UUID_LEN             2
+#define ATT_128_UUID_LEN            16
+
+#define ATTC_SET_REQUIRED           0x01
+#define ATTC_SET_UUID_128           0x02
+#define ATTC_SET_DESCRIPTOR         0x04
+
+enum
+{
+    ATTC_WRITE_CMD_RSP = 0x0D,
+    ATTC_HANDLE_VALUE_NTF,
+    ATTS_HANDLE_VALUE_CNF = 0x11,
+};
+
+typedef struct
+{
+    wsfMsgHdr_t     hdr;
+    uint8_t         *pValue;
+    uint16_t        valueLen;
+    uint16_t        handle;
+    bool_t          continuing;
+    uint16_t        mtu;
+} attEvt_t;
+
+typedef struct
+{
+    const uint8_t   *pUuid;
+    uint8_t         settings;
+} attcDiscChar_t;
+
+typedef struct attsAttr_tag attsAttr_t;
+
+typedef uint8_t (*attsReadCback_t)(dmConnId_t connId, uint16_t handle, uint8_t operation,
+                                   uint16_t offset, attsAttr_t *pAttr);
+typedef uint8_t (*attsWriteCback_t)(dmConnId_t connId, uint16_t handle, uint8_t operation,
+                                    uint16_t offset, uint16_t len, uint8_t *pValue, attsAttr_t *pAttr);
+
+extern const uint8_t attCliChCfgUuid[ATT_16_UUID_LEN];
+
+void AttcWriteCmd(dmConnId_t connId, uint16_t handle, uint16_t valueLen, uint8_t *pValue);
+void AttsHandleValueNtf(dmConnId_t connId, uint16_t handle, uint16_t valueLen, uint8_t *pValue);
+uint16_t AttGetMtu(dmConnId_t connId);
+
+#endif // ATT_API_H
@@ -0,0 +1,12 @@
+#ifndef BSTREAM_H
+#define BSTREAM_H
+
+#include <stdint.h>
+
+#define UINT16_TO_BYTES(n)          ((uint8_t) (n)), ((uint8_t)((n) >> 8))
+
+#define BYTES_TO_UINT16(n, p)       {n = ((uint16_t)(p)[0] + ((uint16_t)(p)[1] << 8));}
+#define BYTES_TO_UINT32(n, p)       {n = ((uint32_t)(p)[0] + ((uint32_t)(p)[1] << 8) + \
+                                        ((uint32_t)(p)[2] << 16) + ((uint32_t)(p)[3] << 24));}
+
+#endif // BSTREAM_H
@@ -0,0 +1,8 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+uint32_t CalcCrc32(uint32_t crcInit, uint32_t len, uint8_t *pBuf);
+
+#endif // CRC32_H
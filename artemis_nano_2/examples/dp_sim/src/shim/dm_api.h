@@ -0,0 +1,30 @@
+#ifndef DM_API_H
+#define DM_API_H
+
+#include "wsf_os.h"
+#include "hci_api.h"
+
+#ifndef DM_CONN_MAX
+#define DM_CONN_MAX                 8           // Also the most slaves the simulator runs
+#endif
+
+#define DM_CONN_ID_NONE             0
+
+enum
+{
+    DM_CONN_OPEN_IND = 0x27,
+    DM_CONN_CLOSE_IND,
+    DM_CONN_UPDATE_IND,
+};
+
+typedef uint8_t dmConnId_t;
+
+typedef union
+{
+    wsfMsgHdr_t                 hdr;
+    hciLeConnCmplEvt_t          connOpen;
+    hciLeConnUpdateCmplEvt_t    connUpdate;
+    hciDisconnectCmplEvt_t      connClose;
+} dmEvt_t;
+
+#endif // DM_API_H
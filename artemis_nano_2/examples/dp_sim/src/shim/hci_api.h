@@ -0,0 +1,38 @@
+#ifndef HCI_API_H
+#define HCI_API_H
+
+#include "wsf_os.h"
+
+typedef struct
+{
+    wsfMsgHdr_t     hdr;
+    uint8_t         status;
+    uint16_t        handle;
+    uint8_t         role;
+    uint8_t         addrType;
+    uint8_t         peerAddr[6];
+    uint16_t        connInterval;
+    uint16_t        connLatency;
+    uint16_t        supTimeout;
+    uint8_t         clockAccuracy;
+} hciLeConnCmplEvt_t;
+
+typedef struct
+{
+    wsfMsgHdr_t     hdr;
+    uint8_t         status;
+    uint16_t        handle;
+    uint16_t        connInterval;
+    uint16_t        connLatency;
+    uint16_t        supTimeout;
+} hciLeConnUpdateCmplEvt_t;
+
+typedef struct
+{
+    wsfMsgHdr_t     hdr;
+    uint8_t         status;
+    uint16_t        handle;
+    uint8_t         reason;
+} hciDisconnectCmplEvt_t;
+
+#endif // HCI_API_H
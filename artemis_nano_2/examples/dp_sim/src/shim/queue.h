@@ -0,0 +1,20 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "FreeRTOS.h"
+#include "task.h"                   // As in FreeRTOS, queue.h pulls in task.h
+
+typedef struct SimQueue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize);
+QueueHandle_t xQueueCreateStatic(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize,
+                                 uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue);
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueueReset(QueueHandle_t xQueue);
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue);
+
+#define xQueueSendToBack(xQueue, pvItemToQueue, xTicksToWait)   xQueueSend((xQueue), (pvItemToQueue), (xTicksToWait))
+#define xQueueSendFromISR(xQueue, pvItemToQueue, pxWoken)       xQueueSend((xQueue), (pvItemToQueue), 0)
+
+#endif // QUEUE_H
@@ -0,0 +1,6 @@
+#ifndef SVC_CH_H
+#define SVC_CH_H
+
+// nothing of it is used on the host
+
+#endif // SVC_CH_H
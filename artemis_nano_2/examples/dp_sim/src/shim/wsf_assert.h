@@ -0,0 +1,9 @@
+#ifndef WSF_ASSERT_H
+#define WSF_ASSERT_H
+
+void simAssertFailed(const char *expr, const char *file, int line);
+
+// the firmware hangs on a failed assertion, the simulator stops so CI notices
+#define WSF_ASSERT(expr)            do { if (!(expr)) { simAssertFailed(#expr, __FILE__, __LINE__); } } while (0)
+
+#endif // WSF_ASSERT_H
@@ -0,0 +1,6 @@
+#ifndef WSF_BUF_H
+#define WSF_BUF_H
+
+#include "wsf_types.h"
+
+#endif // WSF_BUF_H
@@ -0,0 +1,9 @@
+#ifndef WSF_CS_H
+#define WSF_CS_H
+
+// the scheduler is cooperative, nothing can interrupt a critical section
+#define WSF_CS_INIT(cs)
+#define WSF_CS_ENTER(cs)
+#define WSF_CS_EXIT(cs)
+
+#endif // WSF_CS_H
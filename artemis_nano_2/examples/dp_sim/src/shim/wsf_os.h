@@ -0,0 +1,17 @@
+#ifndef WSF_OS_H
+#define WSF_OS_H
+
+#include "wsf_types.h"
+
+typedef uint8_t wsfHandlerId_t;
+typedef uint8_t wsfEventMask_t;
+
+// common message structure passed to event handlers
+typedef struct
+{
+    uint16_t        param;
+    uint8_t         event;
+    uint8_t         status;
+} wsfMsgHdr_t;
+
+#endif // WSF_OS_H
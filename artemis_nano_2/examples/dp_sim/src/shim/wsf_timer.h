@@ -0,0 +1,22 @@
+#ifndef WSF_TIMER_H
+#define WSF_TIMER_H
+
+#include "wsf_os.h"
+
+typedef uint32_t wsfTimerTicks_t;
+
+// the message is handed to the proc_msg function of the node that started the timer
+typedef struct wsfTimer_tag
+{
+    wsfHandlerId_t  handlerId;
+    wsfMsgHdr_t     msg;
+    bool_t          isStarted;
+    int             simNode;                // Node the timer was started on
+    uint32_t        simGeneration;          // Bumped on every start and stop, stale expiries are ignored
+} wsfTimer_t;
+
+void WsfTimerStartMs(wsfTimer_t *pTimer, wsfTimerTicks_t ms);
+void WsfTimerStartSec(wsfTimer_t *pTimer, wsfTimerTicks_t sec);
+void WsfTimerStop(wsfTimer_t *pTimer);
+
+#endif // WSF_TIMER_H
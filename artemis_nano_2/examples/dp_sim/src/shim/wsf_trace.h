@@ -0,0 +1,16 @@
+#ifndef WSF_TRACE_H
+#define WSF_TRACE_H
+
+void simTrace(const char *fmt, ...);
+
+#define APP_TRACE_INFO0(msg)                    simTrace(msg)
+#define APP_TRACE_INFO1(msg, var1)              simTrace(msg, var1)
+#define APP_TRACE_INFO2(msg, var1, var2)        simTrace(msg, var1, var2)
+#define APP_TRACE_INFO3(msg, var1, var2, var3)  simTrace(msg, var1, var2, var3)
+#define APP_TRACE_WARN0(msg)                    simTrace(msg)
+#define APP_TRACE_WARN1(msg, var1)              simTrace(msg, var1)
+#define APP_TRACE_WARN2(msg, var1, var2)        simTrace(msg, var1, var2)
+#define APP_TRACE_ERR0(msg)                     simTrace(msg)
+#define APP_TRACE_ERR1(msg, var1)               simTrace(msg, var1)
+
+#endif // WSF_TRACE_H
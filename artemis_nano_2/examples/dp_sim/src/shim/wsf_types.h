@@ -0,0 +1,17 @@
+#ifndef WSF_TYPES_H
+#define WSF_TYPES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef TRUE
+#define TRUE                        1
+#endif
+#ifndef FALSE
+#define FALSE                       0
+#endif
+
+typedef uint8_t bool_t;
+
+#endif // WSF_TYPES_H
@@ -0,0 +1,566 @@
+//*****************************************************************************
+//
+// Command line of the distributed protocol simulator, see README.txt.
+//
+// Sets up one master and N slaves on virtual links, the first of them relays to
+// the others if asked, runs its jobs to completion and reports the makespan, the
+// bytes on air and how busy every client was.
+//
+//*****************************************************************************
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define SIM_DRAIN_US                5000000     // Longer than DP_TRACE_IDLE_MS
+#define SIM_MAX_LINK_CHANGES        (2 * SIM_MAX_SLAVES)
+#define SIM_MAX_JOBS                4           // One per kernel, the master refuses a kernel that is still running
+#define SIM_PRIORITY_NORMAL         1           // DP_PRIORITY_NORMAL
+#define SIM_NUM_PRIORITIES          3
+
+extern SimNode simMasterNode;
+extern SimNode simSlaveNode0, simSlaveNode1, simSlaveNode2, simSlaveNode3,
+               simSlaveNode4, simSlaveNode5, simSlaveNode6, simSlaveNode7;
+extern SimNode simRelayNode0, simRelayNode1, simRelayNode2, simRelayNode3;
+
+// one copy of the slave objects each, see the Makefile
+static SimNode *slaveNodes[] = {
+    &simSlaveNode0, &simSlaveNode1, &simSlaveNode2, &simSlaveNode3,
+    &simSlaveNode4, &simSlaveNode5, &simSlaveNode6, &simSlaveNode7,
+};
+_Static_assert(sizeof(slaveNodes) / sizeof(slaveNodes[0]) == SIM_MAX_SLAVES, "one slave copy per connection");
+
+static SimNode *relayNodes[] = { &simRelayNode0, &simRelayNode1, &simRelayNode2, &simRelayNode3 };
+_Static_assert(sizeof(relayNodes) / sizeof(relayNodes[0]) == SIM_MAX_RELAYS, "one relay copy per relay");
+
+// command line names of the job priorities, eDpPriority_t
+static const char *priorityNames[] = { "batch", "normal", "urgent" };
+
+// the node at the slave end of each link and the node at the other end, see buildTree
+static SimNode *childNodes[SIM_MAX_SLAVES];
+static int parentNodes[SIM_MAX_SLAVES];
+
+// a link that goes down or comes up while the job runs
+typedef struct
+{
+    int             slave;
+    uint64_t        atUs;                       // Since the start of the job
+    bool            up;
+    uint16_t        mtu;
+} SimLinkChange;
+
+// a job the master starts, the first one when the run starts
+typedef struct
+{
+    uint8_t         kernelId;
+    uint8_t         priority;
+    uint64_t        atUs;                       // Since the start of the first job
+    bool            started;
+    bool            refused;                    // The master did not take it, see DpStartJobWithPriority
+    bool            finished;
+    uint64_t        startUs;
+    uint64_t        endUs;
+} SimJob;
+
+typedef struct
+{
+    int             numSlaves;
+    int             numRelays;                  // The first numRelays slaves
+    SimJob          jobs[SIM_MAX_JOBS];         // The one of --kernel first
+    int             numJobs;
+    double          speeds[SIM_MAX_SLAVES];
+    double          masterSpeed;
+    uint32_t        taskUs;
+    double          maxTimeS;
+    unsigned        wallTimeoutS;
+    int             verbosity;
+    SimLinkConfig   link;
+    SimLinkChange   linkChanges[SIM_MAX_LINK_CHANGES];
+    int             numLinkChanges;
+    bool            joinsLate[SIM_MAX_SLAVES];  // Not connected when the job starts
+} SimOptions;
+
+static const struct option longOptions[] = {
+    { "slaves",         required_argument,  NULL,   'n' },
+    { "relays",         required_argument,  NULL,   'R' },
+    { "kernel",         required_argument,  NULL,   'k' },
+    { "priority",       required_argument,  NULL,   'P' },
+    { "job",            required_argument,  NULL,   'J' },
+    { "mtu",            required_argument,  NULL,   'm' },
+    { "interval",       required_argument,  NULL,   'i' },
+    { "pdus",           required_argument,  NULL,   'p' },
+    { "loss",           required_argument,  NULL,   'l' },
+    { "phy",            required_argument,  NULL,   'y' },
+    { "speed",          required_argument,  NULL,   's' },
+    { "master-speed",   required_argument,  NULL,   'M' },
+    { "task-us",        required_argument,  NULL,   't' },
+    { "seed",           required_argument,  NULL,   'r' },
+    { "max-time",       required_argument,  NULL,   'T' },
+    { "wall-timeout",   required_argument,  NULL,   'w' },
+    { "drop",           required_argument,  NULL,   'd' },
+    { "join",           required_argument,  NULL,   'j' },
+    { "verbose",        no_argument,        NULL,   'v' },
+    { "help",           no_argument,        NULL,   'h' },
+    { NULL,             0,                  NULL,   0 },
+};
+
+static void usage(const char *name) {
+    printf("usage: %s [options]\n"
+           "  -n, --slaves N         virtual slaves, 1 to %d (3)\n"
+           "  -R, --relays N         the first N slaves relay to the others, which are dealt out among them (0)\n"
+           "  -k, --kernel ID        kernel to run, 1 matrix multiplication, 2 distributed sum,\n"
+           "                         3 tiled matrix multiplication (1)\n"
+           "  -P, --priority N       priority of that job, 0 batch, 1 normal, 2 urgent (1)\n"
+           "  -J, --job K:MS[:N]     also starts a job of kernel K MS after the first one, at priority N (2)\n"
+           "  -m, --mtu BYTES        ATT MTU of every link (247)\n"
+           "  -i, --interval MS      connection interval (50)\n"
+           "  -p, --pdus N           ATT PDUs per direction in one connection event (4)\n"
+           "  -l, --loss RATE        chance that a PDU is lost and sent again, 0 to 0.9 (0)\n"
+           "  -y, --phy MBPS         1 or 2 (1)\n"
+           "  -s, --speed LIST       compute speed of each slave, comma separated, the last one repeats (1)\n"
+           "  -M, --master-speed X   compute speed of the master's local lane (1)\n"
+           "  -t, --task-us US       compute time of one element of a result at speed 1, a whole task of\n"
+           "                         kernels 1 and 2 (200)\n"
+           "  -r, --seed N           seed of the link losses and the job data (1)\n"
+           "  -T, --max-time S       virtual time after which the job counts as failed (600)\n"
+           "  -w, --wall-timeout S   real time after which the simulator gives up, 0 for none (120)\n"
+           "  -d, --drop N:MS[:MS]   slave N disconnects MS after the job started, and reconnects at the second MS\n"
+           "  -j, --join N:MS        slave N only connects MS after the job started\n"
+           "  -v, --verbose          firmware log, repeat for debug output and AMDTP traces\n",
+           name, SIM_MAX_SLAVES);
+}
+
+static bool parseSpeeds(const char *list, double *speeds) {
+    char *copy = strdup(list);
+    char *save = NULL;
+    int count = 0;
+    double speed = 1.0;
+
+    for (char *item = strtok_r(copy, ",", &save); item != NULL && count < SIM_MAX_SLAVES; item = strtok_r(NULL, ",", &save)) {
+        speed = atof(item);
+        if (speed <= 0) {
+            free(copy);
+            return false;
+        }
+        speeds[count++] = speed;
+    }
+    while (count < SIM_MAX_SLAVES) {
+        speeds[count++] = speed;
+    }
+    free(copy);
+    return true;
+}
+
+/**
+ * @brief Adds the job of a --job option
+ */
+static bool parseJob(const char *arg, SimOptions *options) {
+    int kernelId;
+    double atMs;
+    int priority = SIM_NUM_PRIORITIES - 1;
+    int fields = sscanf(arg, "%d:%lf:%d", &kernelId, &atMs, &priority);
+
+    if (fields < 2 || kernelId < 1 || kernelId > UINT8_MAX || atMs < 0 || priority < 0 || priority >= SIM_NUM_PRIORITIES
+        || options->numJobs == SIM_MAX_JOBS) {
+        return false;
+    }
+    options->jobs[options->numJobs++] = (SimJob) { .kernelId = (uint8_t) kernelId, .priority = (uint8_t) priority,
+                                                   .atUs = (uint64_t) (atMs * 1000) };
+    return true;
+}
+
+/**
+ * @brief Adds the link changes of a --drop or --join option
+ */
+static bool parseLinkChange(const char *arg, bool join, SimOptions *options) {
+    int slave;
+    double downMs, upMs;
+    int fields = sscanf(arg, "%d:%lf:%lf", &slave, &downMs, &upMs);
+
+    if (fields < 2 || (join && fields > 2) || slave < 1 || slave > SIM_MAX_SLAVES || downMs < 0
+        || (fields == 3 && upMs <= downMs) || options->numLinkChanges + fields - 1 > SIM_MAX_LINK_CHANGES) {
+        return false;
+    }
+
+    if (join) {
+        options->joinsLate[slave - 1] = true;
+        options->linkChanges[options->numLinkChanges++] = (SimLinkChange) { slave - 1, (uint64_t) (downMs * 1000), true };
+        return true;
+    }
+    options->linkChanges[options->numLinkChanges++] = (SimLinkChange) { slave - 1, (uint64_t) (downMs * 1000), false };
+    if (fields == 3) {
+        options->linkChanges[options->numLinkChanges++] = (SimLinkChange) { slave - 1, (uint64_t) (upMs * 1000), true };
+    }
+    return true;
+}
+
+static bool parseOptions(int argc, char **argv, SimOptions *options) {
+    int opt;
+
+    *options = (SimOptions) {
+        .numSlaves = 3,
+        .masterSpeed = 1.0,
+        .jobs = { { .kernelId = 1, .priority = SIM_PRIORITY_NORMAL } },
+        .numJobs = 1,
+        .taskUs = 200,
+        .maxTimeS = 600,
+        .wallTimeoutS = 120,
+        .link = { .mtu = 247, .intervalUs = 50000, .pdusPerEvent = 4, .loss = 0, .phyMbps = 1, .seed = 1 },
+    };
+    parseSpeeds("1", options->speeds);
+
+    while ((opt = getopt_long(argc, argv, "n:R:k:P:J:m:i:p:l:y:s:M:t:r:T:w:d:j:vh", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'n': options->numSlaves = atoi(optarg); break;
+        case 'R': options->numRelays = atoi(optarg); break;
+        case 'k': options->jobs[0].kernelId = (uint8_t) atoi(optarg); break;
+        case 'P':
+            options->jobs[0].priority = (uint8_t) atoi(optarg);
+            if (options->jobs[0].priority >= SIM_NUM_PRIORITIES) {
+                fprintf(stderr, "priority must be 0 to %d\n", SIM_NUM_PRIORITIES - 1);
+                return false;
+            }
+            break;
+        case 'J':
+            if (!parseJob(optarg, options)) {
+                fprintf(stderr, "bad job %s\n", optarg);
+                return false;
+            }
+            break;
+        case 'm': options->link.mtu = (uint16_t) atoi(optarg); break;
+        case 'i': options->link.intervalUs = (uint32_t) (atof(optarg) * 1000); break;
+        case 'p': options->link.pdusPerEvent = (uint32_t) atoi(optarg); break;
+        case 'l': options->link.loss = atof(optarg); break;
+        case 'y': options->link.phyMbps = atof(optarg); break;
+        case 's':
+            if (!parseSpeeds(optarg, options->speeds)) {
+                fprintf(stderr, "speeds must be positive\n");
+                return false;
+            }
+            break;
+        case 'M': options->masterSpeed = atof(optarg); break;
+        case 't': options->taskUs = (uint32_t) atoi(optarg); break;
+        case 'r': options->link.seed = (uint32_t) atoi(optarg); break;
+        case 'T': options->maxTimeS = atof(optarg); break;
+        case 'w': options->wallTimeoutS = (unsigned) atoi(optarg); break;
+        case 'd':
+        case 'j':
+            if (!parseLinkChange(optarg, opt == 'j', options)) {
+                fprintf(stderr, "bad link change %s\n", optarg);
+                return false;
+            }
+            break;
+        case 'v': options->verbosity++; break;
+        default: return false;
+        }
+    }
+
+    if (options->masterSpeed <= 0) {
+        fprintf(stderr, "master speed must be positive\n");
+        return false;
+    }
+    if (options->numSlaves < 1 || options->numSlaves > SIM_MAX_SLAVES) {
+        fprintf(stderr, "slaves must be 1 to %d\n", SIM_MAX_SLAVES);
+        return false;
+    }
+    if (options->numRelays < 0 || options->numRelays > options->numSlaves - options->numRelays) {
+        fprintf(stderr, "relays must be 0 to half the slaves, each needs a slave of its own\n");
+        return false;
+    }
+    for (int i = 0; i < options->numLinkChanges; i++) {
+        if (options->linkChanges[i].slave >= options->numSlaves) {
+            fprintf(stderr, "link change for slave %d, there are only %d\n", options->linkChanges[i].slave + 1, options->numSlaves);
+            return false;
+        }
+    }
+    for (int i = 0; i < options->numJobs; i++) {
+        for (int j = 0; j < i; j++) {
+            uint8_t a = options->jobs[i].kernelId, b = options->jobs[j].kernelId;
+            // both matrix multiplications work on the same A, B and C
+            if (a == b || (a != 2 && b != 2)) {
+                fprintf(stderr, "kernels %d and %d cannot run at the same time\n", b, a);
+                return false;
+            }
+        }
+    }
+    // AMDTP sends MTU - 3 bytes per PDU and needs the 4 byte prefix in the first one
+    if (options->link.mtu < 23 || options->link.mtu > 517) {
+        fprintf(stderr, "mtu must be 23 to 517\n");
+        return false;
+    }
+    if (options->link.intervalUs < 7500 || options->link.pdusPerEvent < 1) {
+        fprintf(stderr, "interval must be at least 7.5 ms and pdus at least 1\n");
+        return false;
+    }
+    if (options->link.loss < 0 || options->link.loss > 0.9) {
+        fprintf(stderr, "loss must be 0 to 0.9\n");
+        return false;
+    }
+    if (options->link.phyMbps != 1 && options->link.phyMbps != 2) {
+        fprintf(stderr, "phy must be 1 or 2\n");
+        return false;
+    }
+    return true;
+}
+
+static void wallTimeout(int sig) {
+    // a fatal error in the firmware spins in while(1), which never gives the scheduler back
+    static const char msg[] = "status           hung, wall clock timeout\n";
+    (void) sig;
+    (void) !write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+    _exit(1);
+}
+
+static SimJob *simJobs;
+static int numSimJobs;
+
+static void startJob(void *arg) {
+    SimJob *job = arg;
+
+    job->started = true;
+    job->startUs = simNowUs();
+    job->refused = !simMasterNode.startJob(job->kernelId, job->priority);
+    simLog(SIM_LOG_INFO, "job of kernel %d %s\n", job->kernelId, job->refused ? "refused" : "started");
+}
+
+/**
+ * @brief Notes the jobs that finished since the last step, done once all of them are
+ */
+static bool jobDone(void) {
+    bool done = true;
+
+    for (int i = 0; i < numSimJobs; i++) {
+        SimJob *job = &simJobs[i];
+        if (job->started && !job->refused && !job->finished && !simMasterNode.jobRunning(job->kernelId)) {
+            job->finished = true;
+            job->endUs = simNowUs();
+        }
+        done &= job->refused || job->finished;
+    }
+    return done;
+}
+
+static bool never(void) {
+    return false;
+}
+
+/**
+ * @brief Calls into a node the way its radio task would
+ */
+static void initNode(SimNode *node, int id) {
+    node->id = id;
+    simRegisterNode(node);
+    int previous = simSetCurrentNode(id);
+    node->init(node);
+    simSetCurrentNode(previous);
+}
+
+/**
+ * @brief Puts the relays right below the master and deals the other slaves out among them
+ */
+static void buildTree(const SimOptions *options) {
+    for (int i = 0; i < options->numSlaves; i++) {
+        if (i < options->numRelays) {
+            childNodes[i] = relayNodes[i];
+            parentNodes[i] = SIM_MASTER;
+        } else {
+            childNodes[i] = slaveNodes[i];
+            parentNodes[i] = options->numRelays > 0 ? (i - options->numRelays) % options->numRelays + 1 : SIM_MASTER;
+        }
+    }
+}
+
+/**
+ * @brief Opens the link of a slave and starts AMDTP on both ends, as after service discovery
+ */
+static void connectSlave(int slave, uint16_t mtu) {
+    int previous = simSetCurrentNode(parentNodes[slave]);
+
+    simLinkConnect(slave);
+    simNode(parentNodes[slave])->connect(slave + 1, mtu);
+    simSetCurrentNode(slave + 1);
+    childNodes[slave]->attach(slave + 1, mtu);
+    simSetCurrentNode(previous);
+}
+
+/**
+ * @brief Closes the link of a slave, both ends get the disconnect indication at once
+ */
+static void disconnectSlave(int slave) {
+    int previous = simSetCurrentNode(parentNodes[slave]);
+
+    simLinkDisconnect(slave);
+    simNode(parentNodes[slave])->disconnect(slave + 1);
+    simSetCurrentNode(slave + 1);
+    childNodes[slave]->detach(slave + 1);
+    simSetCurrentNode(previous);
+}
+
+static void changeLink(void *arg) {
+    SimLinkChange *change = arg;
+
+    simLog(SIM_LOG_INFO, "link to slave %d %s\n", change->slave + 1, change->up ? "up" : "down");
+    if (change->up) {
+        connectSlave(change->slave, change->mtu);
+    } else {
+        disconnectSlave(change->slave);
+    }
+}
+
+static bool jobResultOk(const SimJob *job) {
+    return job->finished && simMasterNode.checkResult(job->kernelId);
+}
+
+static void report(const SimOptions *options, bool finished, uint64_t makespanUs) {
+    SimLinkStats toSlave, toMaster;
+    uint64_t bytesToSlaves = 0, bytesToMaster = 0;
+    uint32_t pdus = 0, retransmissions = 0;
+    const SimJob *first = &options->jobs[0];
+    bool resultOk = finished;
+
+    for (int i = 0; i < options->numJobs; i++) {
+        resultOk &= jobResultOk(&options->jobs[i]);
+    }
+
+    for (int i = 0; i < options->numSlaves; i++) {
+        simLinkStats(i, &toSlave, &toMaster);
+        bytesToSlaves += toSlave.bytesOnAir;
+        bytesToMaster += toMaster.bytesOnAir;
+        pdus += toSlave.pdus + toMaster.pdus;
+        retransmissions += toSlave.retransmissions + toMaster.retransmissions;
+    }
+
+    printf("kernel           %s (%d)\n", simMasterNode.kernelName(first->kernelId), first->kernelId);
+    printf("slaves           %d\n", options->numSlaves);
+    printf("link             mtu %d, interval %.2f ms, %d pdus per event, loss %.3f, %gM phy\n",
+           options->link.mtu, options->link.intervalUs / 1000.0, options->link.pdusPerEvent,
+           options->link.loss, options->link.phyMbps);
+    printf("status           %s\n", finished ? "complete" : "not complete");
+    printf("result           %s\n", resultOk ? "ok" : "wrong");
+    printf("makespan_ms      %.3f\n", makespanUs / 1000.0);
+    printf("bytes_on_air     %llu\n", (unsigned long long) (bytesToSlaves + bytesToMaster));
+    printf("bytes_to_slaves  %llu\n", (unsigned long long) bytesToSlaves);
+    printf("bytes_to_master  %llu\n", (unsigned long long) bytesToMaster);
+    printf("pdus             %u\n", pdus);
+    printf("retransmissions  %u\n", retransmissions);
+    printf("\n");
+
+    if (options->numJobs > 1) {
+        printf("job  kernel                      priority  start_ms  latency_ms  result\n");
+        for (int i = 0; i < options->numJobs; i++) {
+            const SimJob *job = &options->jobs[i];
+            const char *result = job->refused ? "refused" : !job->finished ? "-" : jobResultOk(job) ? "ok" : "wrong";
+            char latencyMs[16] = "-";
+            if (job->finished) {
+                snprintf(latencyMs, sizeof(latencyMs), "%.3f", (job->endUs - job->startUs) / 1000.0);
+            }
+            printf("%3d  %-26s  %-8s  %8.1f  %10s  %s\n", i + 1, simMasterNode.kernelName(job->kernelId),
+                   priorityNames[job->priority], job->atUs / 1000.0, latencyMs, result);
+        }
+        printf("\n");
+    }
+    printf("client  via  role   speed  tasks  busy_ms  utilization  service_us  to_slave_bytes  to_master_bytes  airtime_ms\n");
+
+    for (int i = 0; i < options->numSlaves; i++) {
+        SimNode *slave = childNodes[i];
+        char via[8] = "-", serviceUs[16] = "-";
+        simLinkStats(i, &toSlave, &toMaster);
+        // only the master measures service times, a relay keeps its own for its slaves
+        if (parentNodes[i] == SIM_MASTER) {
+            snprintf(serviceUs, sizeof(serviceUs), "%u", simMasterNode.serviceTimeUs(i + 1));
+        } else {
+            snprintf(via, sizeof(via), "%d", parentNodes[i]);
+        }
+        printf("%6d  %3s  %-5s  %5.2f  %5u  %7.1f  %10.1f%%  %10s  %14llu  %15llu  %10.1f\n", i + 1, via,
+               i < options->numRelays ? "relay" : "slave", slave->speed,
+               slave->tasksExecuted, slave->busyUs / 1000.0,
+               makespanUs > 0 ? 100.0 * slave->busyUs / makespanUs : 0.0, serviceUs,
+               (unsigned long long) toSlave.bytesOnAir, (unsigned long long) toMaster.bytesOnAir,
+               (toSlave.airtimeUs + toMaster.airtimeUs) / 1000.0);
+    }
+
+    if (simMasterNode.tasksExecuted > 0) {
+        printf("%6s  %3s  %-5s  %5.2f  %5u  %7.1f  %10.1f%%  %10u  %14s  %15s  %10s\n", "local", "-", "local", simMasterNode.speed,
+               simMasterNode.tasksExecuted, simMasterNode.busyUs / 1000.0,
+               makespanUs > 0 ? 100.0 * simMasterNode.busyUs / makespanUs : 0.0,
+               simMasterNode.serviceTimeUs(SIM_LOCAL_LANE), "-", "-", "-");
+    }
+}
+
+int main(int argc, char **argv) {
+    SimOptions options;
+
+    if (!parseOptions(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    simSetLogLevel(options.verbosity);
+    srand(options.link.seed);                   // The job data of the kernels comes from rand()
+    if (options.wallTimeoutS > 0) {
+        signal(SIGALRM, wallTimeout);
+        alarm(options.wallTimeoutS);
+    }
+
+    buildTree(&options);
+    simLinkInit(&options.link, options.numSlaves, parentNodes);
+    simMasterNode.speed = options.masterSpeed;
+    simMasterNode.taskUs = options.taskUs;
+    initNode(&simMasterNode, SIM_MASTER);
+    for (int i = 0; i < options.numSlaves; i++) {
+        childNodes[i]->speed = options.speeds[i];
+        childNodes[i]->taskUs = options.taskUs;
+        initNode(childNodes[i], i + 1);
+    }
+
+    for (int i = 0; i < options.numJobs; i++) {
+        if (simMasterNode.kernelName(options.jobs[i].kernelId) == NULL) {
+            fprintf(stderr, "no kernel with id %d\n", options.jobs[i].kernelId);
+            return 2;
+        }
+    }
+
+    // connection set up is not part of the measurement
+    for (int i = 0; i < options.numSlaves; i++) {
+        if (!options.joinsLate[i]) {
+            connectSlave(i, options.link.mtu);
+        }
+    }
+
+    simLinkResetStats();
+    simSetCurrentNode(SIM_MASTER);
+    uint64_t startUs = simNowUs();
+    simJobs = options.jobs;
+    numSimJobs = options.numJobs;
+    startJob(&options.jobs[0]);
+    if (options.jobs[0].refused) {
+        return 2;
+    }
+    simSetCurrentNode(SIM_NO_NODE);
+    for (int i = 1; i < options.numJobs; i++) {
+        simSchedule(startUs + options.jobs[i].atUs, SIM_MASTER, startJob, &options.jobs[i]);
+    }
+    for (int i = 0; i < options.numLinkChanges; i++) {
+        options.linkChanges[i].mtu = options.link.mtu;
+        simSchedule(startUs + options.linkChanges[i].atUs, SIM_NO_NODE, changeLink, &options.linkChanges[i]);
+    }
+
+    bool finished = simRun(jobDone, startUs + (uint64_t) (options.maxTimeS * 1000000));
+    uint64_t makespanUs = simNowUs() - startUs;
+    for (int i = 0; i < options.numJobs; i++) {
+        finished &= !options.jobs[i].refused;
+    }
+    if (options.verbosity >= SIM_LOG_INFO) {
+        simRun(never, simNowUs() + SIM_DRAIN_US);   // Lets the slaves go idle and print their timelines
+    }
+    report(&options, finished, makespanUs);
+
+    for (int i = 0; i < options.numJobs; i++) {
+        finished &= jobResultOk(&options.jobs[i]);
+    }
+    return finished ? 0 : 1;
+}
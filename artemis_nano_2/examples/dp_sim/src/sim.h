@@ -0,0 +1,114 @@
+//*****************************************************************************
+//
+// Host simulator of the distributed protocol.
+//
+// The master and every slave are separate copies of the firmware objects in one
+// process, see the Makefile. They run on a cooperative scheduler in virtual time
+// and talk over virtual BLE links, so a run is fully deterministic for a seed.
+//
+//*****************************************************************************
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "wsf_os.h"
+#include "dm_api.h"
+
+#define SIM_MAX_SLAVES              DM_CONN_MAX
+#define SIM_MAX_RELAYS              (SIM_MAX_SLAVES / 2)    // Each relay needs a slave of its own
+#define SIM_MAX_NODES               (SIM_MAX_SLAVES + 1)
+#define SIM_MASTER                  0           // Node id of the master, slave i is node i + 1
+#define SIM_NO_NODE                 -1
+#define SIM_FOREVER                 UINT64_MAX
+#define SIM_US_PER_TICK             (1000000 / configTICK_RATE_HZ)
+#define SIM_HANDLER_ID              1           // WSF handler of the AMDTP profile on every node
+#define SIM_AMDTP_TIMER_IND         0xC0        // Timer event of the AMDTP profile, as in the firmware apps
+#define SIM_LOCAL_LANE              (DM_CONN_MAX + 1)   // Client id of the master's own lane, DP_LOCAL_CONN_ID
+
+// the one symbol a node object exports, everything else in it is localized by the Makefile
+#define SIM_EXPORT                  __attribute__((visibility("default")))
+
+enum
+{
+    SIM_LOG_REPORT,                 // Only the final report
+    SIM_LOG_INFO,                   // am_util_stdio_printf of the firmware
+    SIM_LOG_DEBUG,                  // am_util_debug_printf
+    SIM_LOG_TRACE,                  // APP_TRACE_* of the AMDTP profiles
+};
+
+typedef struct SimNode SimNode;
+
+// Entry points of one node object. The simulator only reaches into a node through these,
+// always with the node set as the current one so its timers and log lines are attributed to it.
+struct SimNode
+{
+    int             id;                         // Set by the simulator
+    double          speed;                      // Compute speed, task time is divided by it
+    uint32_t        taskUs;                     // Compute time of one element of a task's result at speed 1
+
+    void            (*init)(SimNode *node);
+    void            (*connect)(dmConnId_t connId, uint16_t mtu);        // A slave connected to this node
+    void            (*disconnect)(dmConnId_t connId);
+    void            (*attach)(dmConnId_t connId, uint16_t mtu);         // This node connected to its parent
+    void            (*detach)(dmConnId_t connId);
+    void            (*receive)(dmConnId_t connId, uint16_t handle, uint8_t *buf, uint16_t len);
+    void            (*sent)(dmConnId_t connId, uint16_t handle);
+    void            (*procMsg)(wsfMsgHdr_t *pMsg);
+
+    // master only
+    bool            (*startJob)(uint8_t kernelId, uint8_t priority);
+    bool            (*jobRunning)(uint8_t kernelId);
+    bool            (*checkResult)(uint8_t kernelId);
+    const char      *(*kernelName)(uint8_t kernelId);
+    uint32_t        (*serviceTimeUs)(dmConnId_t connId);
+
+    // since the last reset
+    uint64_t        busyUs;                     // Virtual time spent in executeTask
+    uint32_t        tasksExecuted;
+};
+
+// sim_rtos.c
+uint64_t simNowUs(void);
+int simCurrentNode(void);
+int simSetCurrentNode(int node);
+void simSchedule(uint64_t atUs, int node, void (*fn)(void *arg), void *arg);
+bool simRun(bool (*done)(void), uint64_t limitUs);
+void simBusy(uint64_t us);
+uint64_t simTaskUs(const SimNode *node, uint16_t resultLength);
+void simRegisterNode(SimNode *node);
+SimNode *simNode(int node);
+void simSetLogLevel(int level);
+void simLog(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// sim_link.c
+typedef struct
+{
+    uint16_t        mtu;                        // ATT MTU of every link
+    uint32_t        intervalUs;                 // Connection interval
+    uint32_t        pdusPerEvent;               // ATT PDUs per direction in one connection event
+    double          loss;                       // Chance that a PDU is lost and retransmitted by the link layer
+    double          phyMbps;                    // 1 or 2
+    uint32_t        seed;
+} SimLinkConfig;
+
+typedef struct
+{
+    uint64_t        bytesOnAir;                 // L2CAP and ATT headers included, every retransmission counted
+    uint64_t        airtimeUs;
+    uint32_t        pdus;
+    uint32_t        retransmissions;
+} SimLinkStats;
+
+void simLinkInit(const SimLinkConfig *config, int numSlaves, const int *parents);
+void simLinkConnect(int slave);
+void simLinkDisconnect(int slave);
+bool simLinkIsOpen(int node, dmConnId_t connId);
+void simLinkSend(int node, dmConnId_t connId, uint16_t handle, const uint8_t *buf, uint16_t len);
+uint16_t simLinkMtu(void);
+void simLinkStats(int slave, SimLinkStats *toSlave, SimLinkStats *toMaster);
+void simLinkResetStats(void);
+
+#endif // SIM_H
@@ -0,0 +1,250 @@
+//*****************************************************************************
+//
+// Virtual BLE links between the master and the slaves.
+//
+// Slave i hangs off its parent, the master or a relay, by link i. Both ends know the link as
+// connection i + 1. Each ATT PDU goes out in a connection event of its link. Within an event
+// PDUs follow each other as long as the sender has the next one ready when the previous is
+// delivered, up to pdusPerEvent and up to the link's share of the connection interval, since
+// a node serves all of its links with one radio. A lost PDU is retransmitted by the link layer
+// in the next slot, so the AMDTP layer only sees it arrive later, never out of order.
+// PDUs still on the air when a link closes are lost with it.
+//
+//*****************************************************************************
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_DIR_TO_SLAVE            0           // From the parent to the slave
+#define SIM_DIR_TO_MASTER           1
+#define SIM_L2CAP_ATT_OVERHEAD      7           // L2CAP header plus ATT opcode and handle
+#define SIM_LL_OVERHEAD             10          // Preamble, access address, LL header and CRC
+#define SIM_T_IFS_US                150
+#define SIM_EMPTY_PDU_US            80          // Empty reply of the peer at 1M PHY
+
+// one direction of a link
+typedef struct
+{
+    uint64_t        eventStart;                 // Start of the connection event the last PDU went out in
+    uint64_t        busyUntil;                  // End of the last PDU
+    uint32_t        used;                       // PDUs sent in that event
+    bool            inEvent;                    // At least one PDU went out on this direction
+    SimLinkStats    stats;
+} SimLinkDir;
+
+typedef struct
+{
+    bool            open;
+    uint32_t        generation;                 // Bumped on every disconnect, PDUs of an older connection are dropped
+    int             parent;                     // Node at the other end from the slave
+    uint64_t        eventUs;                    // Share of the interval, the busier radio of the two ends decides
+    uint64_t        anchorUs;                   // Offset of the first connection event
+    SimLinkDir      dir[2];
+} SimLink;
+
+typedef struct
+{
+    int             from;
+    int             to;
+    int             slave;
+    uint32_t        generation;
+    dmConnId_t      connId;
+    uint16_t        handle;
+    uint16_t        len;
+    uint8_t         data[];
+} SimPdu;
+
+static SimLinkConfig config;
+static SimLink links[SIM_MAX_SLAVES];
+static int numLinks;
+static uint64_t rngState;
+
+static double randomUniform(void) {
+    // xorshift64*, the same sequence for the same seed on every host
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return ((rngState * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @param parents The node each slave is connected to, SIM_MASTER or the node of a relay
+ */
+void simLinkInit(const SimLinkConfig *linkConfig, int numSlaves, const int *parents) {
+    int degree[SIM_MAX_NODES] = { 0 };
+
+    config = *linkConfig;
+    numLinks = numSlaves;
+    rngState = config.seed * 0x9E3779B97F4A7C15ULL + 1;
+    memset(links, 0, sizeof(links));
+
+    for (int i = 0; i < numLinks; i++) {
+        links[i].parent = parents[i];
+        degree[parents[i]]++;
+        degree[i + 1]++;
+    }
+    for (int i = 0; i < numLinks; i++) {
+        int busiest = degree[parents[i]] > degree[i + 1] ? degree[parents[i]] : degree[i + 1];
+        links[i].eventUs = config.intervalUs / busiest;
+    }
+}
+
+void simLinkConnect(int slave) {
+    SimLink *link = &links[slave];
+
+    link->open = true;
+    link->anchorUs = simNowUs() + (uint64_t) slave * config.intervalUs / numLinks;
+    link->dir[SIM_DIR_TO_SLAVE].inEvent = false;
+    link->dir[SIM_DIR_TO_MASTER].inEvent = false;
+    link->dir[SIM_DIR_TO_SLAVE].busyUntil = 0;
+    link->dir[SIM_DIR_TO_MASTER].busyUntil = 0;
+}
+
+void simLinkDisconnect(int slave) {
+    links[slave].open = false;
+    links[slave].generation++;
+}
+
+uint16_t simLinkMtu(void) {
+    return config.mtu;
+}
+
+/**
+ * @brief Finds the link and direction a node sends on
+ *
+ * @return The link, NULL if the connection does not exist
+ */
+static SimLink *findLink(int node, dmConnId_t connId, int *dir) {
+    int slave = connId - 1;
+
+    if (slave < 0 || slave >= numLinks || !links[slave].open) {
+        return NULL;
+    }
+    if (node == slave + 1) {
+        *dir = SIM_DIR_TO_MASTER;
+    } else if (node == links[slave].parent) {
+        *dir = SIM_DIR_TO_SLAVE;
+    } else {
+        return NULL;
+    }
+    return &links[slave];
+}
+
+bool simLinkIsOpen(int node, dmConnId_t connId) {
+    int dir;
+    return findLink(node, connId, &dir) != NULL;
+}
+
+static uint32_t airtimeUs(uint16_t len) {
+    uint32_t bits = (len + SIM_L2CAP_ATT_OVERHEAD + SIM_LL_OVERHEAD) * 8;
+    return (uint32_t) (bits / config.phyMbps) + 2 * SIM_T_IFS_US + SIM_EMPTY_PDU_US;
+}
+
+/**
+ * @brief Finds the next slot for one transmission of a PDU and takes it
+ *
+ * @return The time the transmission ends
+ */
+static uint64_t takeSlot(SimLink *link, SimLinkDir *dir, uint64_t readyUs, uint32_t airtime) {
+    uint64_t eventLength = link->eventUs;
+
+    // the event goes on while the sender keeps the next PDU ready and there is room left
+    if (dir->inEvent && readyUs <= dir->busyUntil && dir->used < config.pdusPerEvent
+        && dir->busyUntil + airtime <= dir->eventStart + eventLength) {
+        dir->used++;
+        dir->busyUntil += airtime;
+        return dir->busyUntil;
+    }
+
+    // otherwise wait for the next connection event
+    uint64_t start = readyUs > dir->busyUntil ? readyUs : dir->busyUntil;
+    uint64_t eventStart = link->anchorUs;
+    if (start > link->anchorUs) {
+        eventStart += (start - link->anchorUs + config.intervalUs - 1) / config.intervalUs * config.intervalUs;
+    }
+    if (dir->inEvent && eventStart <= dir->eventStart) {
+        eventStart = dir->eventStart + config.intervalUs;
+    }
+
+    dir->inEvent = true;
+    dir->eventStart = eventStart;
+    dir->used = 1;
+    dir->busyUntil = eventStart + airtime;
+    return dir->busyUntil;
+}
+
+static void deliverPdu(void *arg) {
+    SimPdu *pdu = arg;
+    SimNode *receiver = simNode(pdu->to);
+    SimNode *sender = simNode(pdu->from);
+    SimLink *link = &links[pdu->slave];
+
+    if (!link->open || link->generation != pdu->generation) {
+        free(pdu);                              // The connection it was sent on is gone
+        return;
+    }
+
+    simSetCurrentNode(pdu->to);
+    receiver->receive(pdu->connId, pdu->handle, pdu->data, pdu->len);
+    simSetCurrentNode(pdu->from);
+    sender->sent(pdu->connId, pdu->handle);
+    free(pdu);
+}
+
+/**
+ * @brief Sends an ATT PDU, the receiver gets it and the sender its confirmation once it is on the other side
+ *
+ * @param node The sending node
+ * @param connId The connection as the sending node knows it
+ */
+void simLinkSend(int node, dmConnId_t connId, uint16_t handle, const uint8_t *buf, uint16_t len) {
+    int dirIndex;
+    SimLink *link = findLink(node, connId, &dirIndex);
+
+    if (link == NULL) {
+        return;                                 // Like the stack, a PDU on a closed connection is dropped
+    }
+
+    SimLinkDir *dir = &link->dir[dirIndex];
+    uint32_t airtime = airtimeUs(len);
+    uint64_t readyUs = simNowUs();
+    uint64_t doneUs;
+
+    // every attempt takes a slot, the link layer retries until the PDU gets through
+    while (true) {
+        doneUs = takeSlot(link, dir, readyUs, airtime);
+        dir->stats.bytesOnAir += len + SIM_L2CAP_ATT_OVERHEAD;
+        dir->stats.airtimeUs += airtime;
+        dir->stats.pdus++;
+        if (config.loss <= 0 || randomUniform() >= config.loss) {
+            break;
+        }
+        dir->stats.retransmissions++;
+        readyUs = doneUs;
+    }
+
+    SimPdu *pdu = malloc(sizeof(SimPdu) + len);
+    int slave = link - links;
+    pdu->from = node;
+    pdu->to = (dirIndex == SIM_DIR_TO_SLAVE) ? slave + 1 : link->parent;
+    pdu->slave = slave;
+    pdu->generation = link->generation;
+    pdu->connId = connId;
+    pdu->handle = handle;
+    pdu->len = len;
+    memcpy(pdu->data, buf, len);
+    simSchedule(doneUs, pdu->to, deliverPdu, pdu);
+}
+
+void simLinkStats(int slave, SimLinkStats *toSlave, SimLinkStats *toMaster) {
+    *toSlave = links[slave].dir[SIM_DIR_TO_SLAVE].stats;
+    *toMaster = links[slave].dir[SIM_DIR_TO_MASTER].stats;
+}
+
+void simLinkResetStats(void) {
+    for (int i = 0; i < numLinks; i++) {
+        memset(&links[i].dir[SIM_DIR_TO_SLAVE].stats, 0, sizeof(SimLinkStats));
+        memset(&links[i].dir[SIM_DIR_TO_MASTER].stats, 0, sizeof(SimLinkStats));
+    }
+}
@@ -0,0 +1,162 @@
+//*****************************************************************************
+//
+// Master node of the simulator: the Cordio calls of the AMDTP client, mapped
+// onto the virtual links, and what the firmware's radio task does at start up.
+//
+//*****************************************************************************
+#include <string.h>
+
+#include "sim.h"
+#include "bstream.h"
+#include "app_api.h"
+#include "amdtpc_api.h"
+#include "svc_amdtp.h"
+#include "distributed_protocol.h"
+#include "matrix_mult.h"
+#include "distributed_sum.h"
+
+extern int MATRIX_A[M][P];
+extern int MATRIX_B[N][P];
+extern int MATRIX_C[M][N];
+extern int randomData[DISTRIBUTED_SUM_ELEMENT_COUNT];
+extern int sumOfAllTasks;
+
+bool g_requestServerSendStop = false;
+const uint8_t attCliChCfgUuid[ATT_16_UUID_LEN] = {UINT16_TO_BYTES(0x2902)};
+
+static const DpKernel *appKernels[] = { &matrixMultKernel, &distributedSumKernel, &matrixMultTiledKernel };
+static DpKernel timedKernels[sizeof(appKernels) / sizeof(appKernels[0])];
+static SimNode *self;
+
+// --------------------------------------------------------------------------------------------
+// Cordio
+
+void AttcWriteCmd(dmConnId_t connId, uint16_t handle, uint16_t valueLen, uint8_t *pValue) {
+    simLinkSend(self->id, connId, handle, pValue, valueLen);
+}
+
+uint16_t AttGetMtu(dmConnId_t connId) {
+    return simLinkMtu();
+}
+
+uint8_t AppConnOpenList(dmConnId_t *pConnIdList) {
+    uint8_t numConn = 0;
+
+    for (dmConnId_t connId = 1; connId <= DM_CONN_MAX; connId++) {
+        if (simLinkIsOpen(self->id, connId)) {
+            pConnIdList[numConn++] = connId;
+        }
+    }
+    return numConn;
+}
+
+void AppDiscFindService(dmConnId_t connId, uint8_t uuidLen, uint8_t *pUuid, uint8_t listLen,
+                        attcDiscChar_t **pCharList, uint16_t *pHdlList) {
+    // the handles are known, see masterConnect
+}
+
+// --------------------------------------------------------------------------------------------
+// Node
+
+/**
+ * @brief Runs a task of the local lane, then holds it for the time the task takes on the master
+ */
+static void executeTimedTask(Task *task) {
+    for (size_t i = 0; i < sizeof(appKernels) / sizeof(appKernels[0]); i++) {
+        if (appKernels[i]->id == task->kernelId) {
+            uint64_t start = simNowUs();
+
+            appKernels[i]->executeTask(task);
+            simBusy(simTaskUs(self, task->dataLength));
+            self->busyUs += simNowUs() - start;
+            self->tasksExecuted++;
+            return;
+        }
+    }
+}
+
+static void masterInit(SimNode *node) {
+    self = node;
+    amdtpc_init(SIM_HANDLER_ID, DpRecvCb, DpTransCb);
+    initializeDistributedProtocol();
+
+    for (size_t i = 0; i < sizeof(appKernels) / sizeof(appKernels[0]); i++) {
+        timedKernels[i] = *appKernels[i];
+        timedKernels[i].executeTask = executeTimedTask;
+        DpRegisterKernel(&timedKernels[i]);
+    }
+}
+
+static void masterConnect(dmConnId_t connId, uint16_t mtu) {
+    // what discovery finds on the slave
+    amdtpc_start(connId, AMDTPS_RX_HDL, AMDTPS_ACK_HDL, AMDTPS_TX_HDL, SIM_AMDTP_TIMER_IND);
+}
+
+static void masterDisconnect(dmConnId_t connId) {
+    dmEvt_t evt = { .hdr = { .param = connId, .event = DM_CONN_CLOSE_IND } };
+    amdtpc_proc_msg(&evt.hdr);
+}
+
+static void masterReceive(dmConnId_t connId, uint16_t handle, uint8_t *buf, uint16_t len) {
+    attEvt_t evt = { .hdr = { .param = connId, .event = ATTC_HANDLE_VALUE_NTF, .status = ATT_SUCCESS },
+                     .pValue = buf, .valueLen = len, .handle = handle };
+    amdtpc_proc_msg(&evt.hdr);
+}
+
+static void masterSent(dmConnId_t connId, uint16_t handle) {
+    attEvt_t evt = { .hdr = { .param = connId, .event = ATTC_WRITE_CMD_RSP, .status = ATT_SUCCESS },
+                     .handle = handle };
+    amdtpc_proc_msg(&evt.hdr);
+}
+
+static bool masterStartJob(uint8_t kernelId, uint8_t priority) {
+    return DpStartJobWithPriority(kernelId, (eDpPriority_t) priority);
+}
+
+/**
+ * @brief Recomputes the result of a finished job on the host
+ */
+static bool masterCheckResult(uint8_t kernelId) {
+    if (kernelId == MATRIX_MULT_KERNEL_ID || kernelId == MATRIX_MULT_TILED_KERNEL_ID) {
+        for (int i = 0; i < M; i++) {
+            for (int j = 0; j < N; j++) {
+                int expected = 0;
+                for (int p = 0; p < P; p++) {
+                    expected += MATRIX_A[i][p] * MATRIX_B[j][p];
+                }
+                if (MATRIX_C[i][j] != expected) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    if (kernelId == DISTRIBUTED_SUM_KERNEL_ID) {
+        int expected = 0;
+        for (int i = 0; i < DISTRIBUTED_SUM_ELEMENT_COUNT; i++) {
+            expected += randomData[i] * 10;
+        }
+        return sumOfAllTasks == expected;
+    }
+    return false;
+}
+
+static const char *masterKernelName(uint8_t kernelId) {
+    const DpKernel *kernel = DpFindKernel(kernelId);
+    return kernel != NULL ? kernel->name : NULL;
+}
+
+SIM_EXPORT SimNode simMasterNode = {
+    .init = masterInit,
+    .connect = masterConnect,
+    .disconnect = masterDisconnect,
+    .receive = masterReceive,
+    .sent = masterSent,
+    .procMsg = amdtpc_proc_msg,
+    .startJob = masterStartJob,
+    .jobRunning = DpJobRunning,
+    .checkResult = masterCheckResult,
+    .kernelName = masterKernelName,
+    .serviceTimeUs = getClientServiceTimeUs,
+};
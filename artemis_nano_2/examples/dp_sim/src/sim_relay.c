@@ -0,0 +1,137 @@
+//*****************************************************************************
+//
+// Relay node of the simulator: the distributed protocol built as master and
+// slave at once, with the AMDTP server towards its parent and the AMDTP client
+// towards its own slaves. The Makefile links one copy of this node per relay.
+//
+//*****************************************************************************
+#include <string.h>
+
+#include "sim.h"
+#include "bstream.h"
+#include "app_api.h"
+#include "att_api.h"
+#include "amdtpc_api.h"
+#include "amdtps_api.h"
+#include "svc_amdtp.h"
+#include "distributed_protocol.h"
+#include "matrix_mult.h"
+#include "distributed_sum.h"
+
+bool g_requestServerSendStop = false;
+const uint8_t attCliChCfgUuid[ATT_16_UUID_LEN] = {UINT16_TO_BYTES(0x2902)};
+
+// the relay only forwards, the kernels give it the slot memory and the operand ids of a task
+static const DpKernel *appKernels[] = { &matrixMultKernel, &distributedSumKernel, &matrixMultTiledKernel };
+static AmdtpsCfg_t amdtpsCfg;
+static SimNode *self;
+static dmConnId_t parentConnId = DM_CONN_ID_NONE;
+
+// --------------------------------------------------------------------------------------------
+// Cordio
+
+void AttcWriteCmd(dmConnId_t connId, uint16_t handle, uint16_t valueLen, uint8_t *pValue) {
+    simLinkSend(self->id, connId, handle, pValue, valueLen);
+}
+
+void AttsHandleValueNtf(dmConnId_t connId, uint16_t handle, uint16_t valueLen, uint8_t *pValue) {
+    simLinkSend(self->id, connId, handle, pValue, valueLen);
+}
+
+uint16_t AttGetMtu(dmConnId_t connId) {
+    return simLinkMtu();
+}
+
+uint8_t AppConnOpenList(dmConnId_t *pConnIdList) {
+    uint8_t numConn = 0;
+
+    for (dmConnId_t connId = 1; connId <= DM_CONN_MAX; connId++) {
+        if (simLinkIsOpen(self->id, connId)) {
+            pConnIdList[numConn++] = connId;
+        }
+    }
+    return numConn;
+}
+
+void AppDiscFindService(dmConnId_t connId, uint8_t uuidLen, uint8_t *pUuid, uint8_t listLen,
+                        attcDiscChar_t **pCharList, uint16_t *pHdlList) {
+    // the handles are known, see relayConnect
+}
+
+// --------------------------------------------------------------------------------------------
+// Node
+
+static void relayInit(SimNode *node) {
+    self = node;
+    amdtps_init(SIM_HANDLER_ID, &amdtpsCfg, DpRecvCb, NULL);
+    amdtpc_init(SIM_HANDLER_ID, DpRecvCb, DpTransCb);
+    initializeDistributedProtocol();
+
+    for (size_t i = 0; i < sizeof(appKernels) / sizeof(appKernels[0]); i++) {
+        DpRegisterKernel(appKernels[i]);
+    }
+}
+
+static void relayConnect(dmConnId_t connId, uint16_t mtu) {
+    amdtpc_start(connId, AMDTPS_RX_HDL, AMDTPS_ACK_HDL, AMDTPS_TX_HDL, SIM_AMDTP_TIMER_IND);
+}
+
+static void relayDisconnect(dmConnId_t connId) {
+    dmEvt_t evt = { .hdr = { .param = connId, .event = DM_CONN_CLOSE_IND } };
+    amdtpc_proc_msg(&evt.hdr);
+}
+
+static void relayAttach(dmConnId_t connId, uint16_t mtu) {
+    parentConnId = connId;
+    amdtps_start(connId, SIM_AMDTP_TIMER_IND, 0);
+}
+
+static void relayDetach(dmConnId_t connId) {
+    dmEvt_t evt = { .hdr = { .param = connId, .event = DM_CONN_CLOSE_IND } };
+    amdtps_proc_msg(&evt.hdr);
+}
+
+static void relayReceive(dmConnId_t connId, uint16_t handle, uint8_t *buf, uint16_t len) {
+    if (connId == parentConnId) {
+        amdtps_write_cback(connId, handle, 0, 0, len, buf, NULL);
+    } else {
+        attEvt_t evt = { .hdr = { .param = connId, .event = ATTC_HANDLE_VALUE_NTF, .status = ATT_SUCCESS },
+                         .pValue = buf, .valueLen = len, .handle = handle };
+        amdtpc_proc_msg(&evt.hdr);
+    }
+}
+
+static void relaySent(dmConnId_t connId, uint16_t handle) {
+    if (connId == parentConnId) {
+        attEvt_t evt = { .hdr = { .param = connId, .event = ATTS_HANDLE_VALUE_CNF, .status = ATT_SUCCESS },
+                         .handle = handle };
+        amdtps_proc_msg(&evt.hdr);
+    } else {
+        attEvt_t evt = { .hdr = { .param = connId, .event = ATTC_WRITE_CMD_RSP, .status = ATT_SUCCESS },
+                         .handle = handle };
+        amdtpc_proc_msg(&evt.hdr);
+    }
+}
+
+/**
+ * @brief Hands the AMDTP timers to the profile of their connection
+ */
+static void relayProcMsg(wsfMsgHdr_t *pMsg) {
+    if (pMsg->param == parentConnId) {
+        amdtps_proc_msg(pMsg);
+    } else {
+        amdtpc_proc_msg(pMsg);
+    }
+}
+
+SIM_EXPORT SimNode simRelayNode = {
+    .speed = 1.0,
+    .init = relayInit,
+    .connect = relayConnect,
+    .disconnect = relayDisconnect,
+    .attach = relayAttach,
+    .detach = relayDetach,
+    .receive = relayReceive,
+    .sent = relaySent,
+    .procMsg = relayProcMsg,
+};
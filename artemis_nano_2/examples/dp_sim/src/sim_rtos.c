@@ -0,0 +1,566 @@
+//*****************************************************************************
+//
+// Deterministic FreeRTOS and WSF shim of the simulator.
+//
+// Every task runs on its own ucontext stack until it blocks, there is no preemption.
+// Kernel calls take no virtual time, only delays, timeouts and simBusy do. When no task
+// can run the clock jumps to the next timed event or wake up, so the radio events of
+// the virtual links are handled between task switches like interrupts would be.
+//
+//*****************************************************************************
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "sim.h"
+#include "am_mcu_apollo.h"
+#include "queue.h"
+#include "wsf_timer.h"
+#include "crc32.h"
+
+#define SIM_STACK_SIZE              (256 * 1024)
+#define SIM_MAX_SPINS               1000        // Failed polls at one instant before a task is made to sleep a tick
+
+typedef enum
+{
+    SIM_TASK_READY,
+    SIM_TASK_BLOCKED,
+    SIM_TASK_DELETED,
+} eSimTaskState_t;
+
+struct SimTask
+{
+    ucontext_t          ctx;
+    TaskFunction_t      fn;
+    void                *param;
+    const char          *name;
+    int                 node;
+    UBaseType_t         priority;
+    eSimTaskState_t     state;
+    uint64_t            wakeUs;                 // When a blocked task times out, SIM_FOREVER if it does not
+    uint64_t            lastRunUs;              // For round robin between tasks of the same priority
+    uint32_t            notifyValue;
+    bool                waitingNotify;
+    struct SimQueue     *waitingQueue;
+    uint64_t            spinUs;
+    uint32_t            spins;
+    uint8_t             *stack;
+    struct SimTask      *next;
+};
+
+struct SimQueue
+{
+    uint8_t             *storage;
+    UBaseType_t         length;
+    UBaseType_t         itemSize;
+    UBaseType_t         count;
+    UBaseType_t         head;
+};
+
+typedef struct SimEvent
+{
+    uint64_t            atUs;
+    uint64_t            seq;                    // Events at the same time fire in the order they were scheduled
+    int                 node;
+    void                (*fn)(void *arg);
+    void                *arg;
+    struct SimEvent     *next;
+} SimEvent;
+
+static uint64_t nowUs;
+static uint64_t eventSeq;
+static SimEvent *events;
+static struct SimTask *tasks;
+static struct SimTask *currentTask;
+static ucontext_t schedulerCtx;
+static int currentNode = SIM_NO_NODE;
+static SimNode *nodes[SIM_MAX_NODES];
+static int logLevel = SIM_LOG_REPORT;
+static bool atLineStart = true;
+
+// --------------------------------------------------------------------------------------------
+
+uint64_t simNowUs(void) {
+    return nowUs;
+}
+
+uint32_t am_hal_stimer_counter_get(void) {
+    return (uint32_t) (nowUs * 32768 / 1000000);
+}
+
+int simCurrentNode(void) {
+    return currentNode;
+}
+
+/**
+ * @brief Makes a node the current one, for calls into it from outside a task
+ *
+ * @return The node that was current before
+ */
+int simSetCurrentNode(int node) {
+    int previous = currentNode;
+    currentNode = node;
+    return previous;
+}
+
+void simRegisterNode(SimNode *node) {
+    nodes[node->id] = node;
+}
+
+SimNode *simNode(int node) {
+    return (node >= 0 && node < SIM_MAX_NODES) ? nodes[node] : NULL;
+}
+
+void simSetLogLevel(int level) {
+    logLevel = level;
+}
+
+static void simVLog(int level, const char *fmt, va_list args, bool newline) {
+    if (level > logLevel) {
+        return;
+    }
+
+    if (level > SIM_LOG_REPORT && atLineStart) {
+        if (currentNode == SIM_MASTER) {
+            printf("[%10.3f ms] M  ", nowUs / 1000.0);
+        } else if (currentNode != SIM_NO_NODE) {
+            printf("[%10.3f ms] S%d ", nowUs / 1000.0, currentNode);
+        } else {
+            printf("[%10.3f ms]    ", nowUs / 1000.0);
+        }
+    }
+    vprintf(fmt, args);
+    if (newline) {
+        putchar('\n');
+    }
+    atLineStart = newline || (fmt[0] != '\0' && fmt[strlen(fmt) - 1] == '\n');
+}
+
+void simLog(int level, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    simVLog(level, fmt, args, false);
+    va_end(args);
+}
+
+uint32_t am_util_stdio_printf(const char *pcFmt, ...) {
+    va_list args;
+    va_start(args, pcFmt);
+    simVLog(SIM_LOG_INFO, pcFmt, args, false);
+    va_end(args);
+    return 0;
+}
+
+uint32_t am_util_debug_printf(const char *pcFmt, ...) {
+    va_list args;
+    va_start(args, pcFmt);
+    simVLog(SIM_LOG_DEBUG, pcFmt, args, false);
+    va_end(args);
+    return 0;
+}
+
+void simTrace(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    simVLog(SIM_LOG_TRACE, fmt, args, true);
+    va_end(args);
+}
+
+void simAssertFailed(const char *expr, const char *file, int line) {
+    fprintf(stderr, "%.3f ms, node %d: assertion %s failed at %s:%d\n", nowUs / 1000.0, currentNode, expr, file, line);
+    exit(2);
+}
+
+uint32_t CalcCrc32(uint32_t crcInit, uint32_t len, uint8_t *pBuf) {
+    uint32_t crc = crcInit;
+
+    while (len--) {
+        crc ^= *pBuf++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1)));
+        }
+    }
+    return crc;
+}
+
+// --------------------------------------------------------------------------------------------
+// Events
+
+void simSchedule(uint64_t atUs, int node, void (*fn)(void *arg), void *arg) {
+    SimEvent *event = malloc(sizeof(SimEvent));
+    SimEvent **pos = &events;
+
+    event->atUs = atUs < nowUs ? nowUs : atUs;
+    event->seq = eventSeq++;
+    event->node = node;
+    event->fn = fn;
+    event->arg = arg;
+
+    while (*pos != NULL && (*pos)->atUs <= event->atUs) {
+        pos = &(*pos)->next;
+    }
+    event->next = *pos;
+    *pos = event;
+}
+
+static void fireEvent(void) {
+    SimEvent *event = events;
+    events = event->next;
+
+    int previous = simSetCurrentNode(event->node);
+    event->fn(event->arg);
+    simSetCurrentNode(previous);
+    free(event);
+}
+
+// --------------------------------------------------------------------------------------------
+// Tasks
+
+static void wakeTask(struct SimTask *task) {
+    if (task->state == SIM_TASK_BLOCKED) {
+        task->state = SIM_TASK_READY;
+        task->waitingQueue = NULL;
+        task->waitingNotify = false;
+    }
+}
+
+/**
+ * @brief Gives up the processor until woken or until the timeout, only from a task
+ */
+static void blockCurrentTask(uint64_t wakeUs) {
+    struct SimTask *task = currentTask;
+
+    task->state = SIM_TASK_BLOCKED;
+    task->wakeUs = wakeUs;
+    swapcontext(&task->ctx, &schedulerCtx);
+}
+
+static uint64_t ticksToWakeUs(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return SIM_FOREVER;
+    }
+    // FreeRTOS counts whole ticks from the current one
+    return (nowUs / SIM_US_PER_TICK + ticks) * SIM_US_PER_TICK;
+}
+
+/**
+ * @brief Called when a non blocking poll of a task fails. A task that keeps polling without
+ *        time moving on would never let go of the processor, after a while it sleeps one tick.
+ */
+static void spinCurrentTask(void) {
+    struct SimTask *task = currentTask;
+
+    if (task == NULL) {
+        return;
+    }
+    if (task->spinUs != nowUs) {
+        task->spinUs = nowUs;
+        task->spins = 0;
+    }
+    if (++task->spins >= SIM_MAX_SPINS) {
+        task->spins = 0;
+        blockCurrentTask(ticksToWakeUs(1));
+    }
+}
+
+static void taskEntry(void) {
+    struct SimTask *task = currentTask;
+
+    task->fn(task->param);
+    // a FreeRTOS task must not return, treat it as deleting itself
+    vTaskDelete(NULL);
+}
+
+static struct SimTask *createTask(TaskFunction_t fn, const char *name, void *param, UBaseType_t priority) {
+    struct SimTask *task = calloc(1, sizeof(struct SimTask));
+
+    task->fn = fn;
+    task->param = param;
+    task->name = name;
+    task->node = currentNode;
+    task->priority = priority;
+    task->state = SIM_TASK_READY;
+    task->lastRunUs = nowUs;
+    task->stack = malloc(SIM_STACK_SIZE);
+
+    getcontext(&task->ctx);
+    task->ctx.uc_stack.ss_sp = task->stack;
+    task->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+    task->ctx.uc_link = &schedulerCtx;
+    makecontext(&task->ctx, taskEntry, 0);
+
+    task->next = tasks;
+    tasks = task;
+    return task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * const pcName, const configSTACK_DEPTH_TYPE usStackDepth,
+                       void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask) {
+    TaskHandle_t task = createTask(pxTaskCode, pcName, pvParameters, uxPriority);
+    if (pxCreatedTask != NULL) {
+        *pxCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t ulStackDepth,
+                               void * const pvParameters, UBaseType_t uxPriority, StackType_t * const puxStackBuffer,
+                               StaticTask_t * const pxTaskBuffer) {
+    return createTask(pxTaskCode, pcName, pvParameters, uxPriority);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+    struct SimTask *task = (xTaskToDelete == NULL) ? currentTask : xTaskToDelete;
+
+    task->state = SIM_TASK_DELETED;
+    if (task == currentTask) {
+        swapcontext(&task->ctx, &schedulerCtx);     // Never comes back, the scheduler frees the stack
+    } else {
+        free(task->stack);
+        task->stack = NULL;
+    }
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay) {
+    blockCurrentTask(xTicksToDelay == 0 ? nowUs : ticksToWakeUs(xTicksToDelay));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t) (nowUs / SIM_US_PER_TICK);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return currentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    xTaskToNotify->notifyValue++;
+    if (xTaskToNotify->waitingNotify) {
+        wakeTask(xTaskToNotify);
+    }
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    struct SimTask *task = currentTask;
+
+    if (task->notifyValue == 0 && xTicksToWait > 0) {
+        task->waitingNotify = true;
+        blockCurrentTask(ticksToWakeUs(xTicksToWait));
+        task->waitingNotify = false;
+    }
+
+    uint32_t value = task->notifyValue;
+    if (value > 0) {
+        task->notifyValue = xClearCountOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+/**
+ * @brief Busy time of a task, the node does nothing else meanwhile
+ */
+void simBusy(uint64_t us) {
+    blockCurrentTask(nowUs + us);
+}
+
+/**
+ * @brief Compute time of a task that just executed on a node, taskUs for each element of its result.
+ *        A kernel that cuts its work into larger or smaller tasks is charged for the work, not per task.
+ */
+uint64_t simTaskUs(const SimNode *node, uint16_t resultLength) {
+    uint32_t elements = resultLength / sizeof(int32_t);
+
+    return (uint64_t) (node->taskUs * (double) (elements > 0 ? elements : 1) / node->speed);
+}
+
+// --------------------------------------------------------------------------------------------
+// Queues
+
+QueueHandle_t xQueueCreate(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize) {
+    return xQueueCreateStatic(uxQueueLength, uxItemSize, malloc(uxQueueLength * uxItemSize), NULL);
+}
+
+QueueHandle_t xQueueCreateStatic(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize,
+                                 uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue) {
+    struct SimQueue *queue = calloc(1, sizeof(struct SimQueue));
+
+    queue->storage = pucQueueStorage;
+    queue->length = uxQueueLength;
+    queue->itemSize = uxItemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait) {
+    // nobody in the firmware waits for room, a full queue fails straight away
+    if (xQueue->count == xQueue->length) {
+        return pdFALSE;
+    }
+
+    memcpy(xQueue->storage + ((xQueue->head + xQueue->count) % xQueue->length) * xQueue->itemSize,
+           pvItemToQueue, xQueue->itemSize);
+    xQueue->count++;
+
+    for (struct SimTask *task = tasks; task != NULL; task = task->next) {
+        if (task->waitingQueue == xQueue) {
+            wakeTask(task);
+            break;
+        }
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait) {
+    if (xQueue->count == 0) {
+        if (xTicksToWait == 0) {
+            spinCurrentTask();
+            return pdFALSE;
+        }
+        currentTask->waitingQueue = xQueue;
+        blockCurrentTask(ticksToWakeUs(xTicksToWait));
+        currentTask->waitingQueue = NULL;
+        if (xQueue->count == 0) {
+            return pdFALSE;
+        }
+    }
+
+    memcpy(pvBuffer, xQueue->storage + xQueue->head * xQueue->itemSize, xQueue->itemSize);
+    xQueue->head = (xQueue->head + 1) % xQueue->length;
+    xQueue->count--;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue) {
+    xQueue->head = 0;
+    xQueue->count = 0;
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue) {
+    return xQueue->count;
+}
+
+// --------------------------------------------------------------------------------------------
+// WSF timers
+
+typedef struct
+{
+    wsfTimer_t          *timer;
+    uint32_t            generation;
+} SimTimerExpiry;
+
+static void timerExpired(void *arg) {
+    SimTimerExpiry *expiry = arg;
+    wsfTimer_t *timer = expiry->timer;
+
+    if (timer->isStarted && timer->simGeneration == expiry->generation) {
+        timer->isStarted = FALSE;
+        simNode(timer->simNode)->procMsg(&timer->msg);
+    }
+    free(expiry);
+}
+
+void WsfTimerStartMs(wsfTimer_t *pTimer, wsfTimerTicks_t ms) {
+    SimTimerExpiry *expiry = malloc(sizeof(SimTimerExpiry));
+
+    pTimer->isStarted = TRUE;
+    pTimer->simNode = currentNode;
+    expiry->timer = pTimer;
+    expiry->generation = ++pTimer->simGeneration;
+    simSchedule(nowUs + (uint64_t) ms * 1000, currentNode, timerExpired, expiry);
+}
+
+void WsfTimerStartSec(wsfTimer_t *pTimer, wsfTimerTicks_t sec) {
+    WsfTimerStartMs(pTimer, sec * 1000);
+}
+
+void WsfTimerStop(wsfTimer_t *pTimer) {
+    pTimer->isStarted = FALSE;
+    pTimer->simGeneration++;
+}
+
+// --------------------------------------------------------------------------------------------
+// Scheduler
+
+/**
+ * @brief Highest priority task that can run, the one that waited longest among equals
+ */
+static struct SimTask *pickTask(void) {
+    struct SimTask *best = NULL;
+
+    for (struct SimTask *task = tasks; task != NULL; task = task->next) {
+        if (task->state == SIM_TASK_BLOCKED && task->wakeUs <= nowUs) {
+            wakeTask(task);
+        }
+        if (task->state != SIM_TASK_READY) {
+            continue;
+        }
+        if (best == NULL || task->priority > best->priority
+            || (task->priority == best->priority && task->lastRunUs < best->lastRunUs)) {
+            best = task;
+        }
+    }
+    return best;
+}
+
+static void reapTasks(void) {
+    for (struct SimTask **pos = &tasks; *pos != NULL; ) {
+        struct SimTask *task = *pos;
+        if (task->state == SIM_TASK_DELETED && task != currentTask) {
+            *pos = task->next;
+            free(task->stack);
+            free(task);
+        } else {
+            pos = &task->next;
+        }
+    }
+}
+
+static uint64_t nextWakeUs(void) {
+    uint64_t next = events != NULL ? events->atUs : SIM_FOREVER;
+
+    for (struct SimTask *task = tasks; task != NULL; task = task->next) {
+        if (task->state == SIM_TASK_BLOCKED && task->wakeUs < next) {
+            next = task->wakeUs;
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Runs tasks and events until done returns true
+ *
+ * @param limitUs Virtual time to give up at
+ *
+ * @return false if the time limit was hit or nothing is left that could make progress
+ */
+bool simRun(bool (*done)(void), uint64_t limitUs) {
+    while (!done()) {
+        // radio events due now come first, like an interrupt preempting the tasks
+        if (events != NULL && events->atUs <= nowUs) {
+            fireEvent();
+            continue;
+        }
+
+        struct SimTask *task = pickTask();
+        if (task != NULL) {
+            currentTask = task;
+            int previous = simSetCurrentNode(task->node);
+            swapcontext(&schedulerCtx, &task->ctx);
+            simSetCurrentNode(previous);
+            task->lastRunUs = nowUs;
+            currentTask = NULL;
+            reapTasks();
+            continue;
+        }
+
+        uint64_t next = nextWakeUs();
+        if (next == SIM_FOREVER || next > limitUs) {
+            return false;
+        }
+        nowUs = next;
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+//*****************************************************************************
+//
+// Slave node of the simulator: the Cordio calls of the AMDTP server, mapped
+// onto the virtual link, and what the firmware's radio task does at start up.
+// The Makefile links one copy of this node per slave.
+//
+//*****************************************************************************
+#include <string.h>
+
+#include "sim.h"
+#include "att_api.h"
+#include "amdtps_api.h"
+#include "svc_amdtp.h"
+#include "distributed_protocol.h"
+#include "matrix_mult.h"
+#include "distributed_sum.h"
+
+static const DpKernel *appKernels[] = { &matrixMultKernel, &distributedSumKernel, &matrixMultTiledKernel };
+static DpKernel timedKernels[sizeof(appKernels) / sizeof(appKernels[0])];
+static AmdtpsCfg_t amdtpsCfg;
+static SimNode *self;
+
+// --------------------------------------------------------------------------------------------
+// Cordio
+
+void AttsHandleValueNtf(dmConnId_t connId, uint16_t handle, uint16_t valueLen, uint8_t *pValue) {
+    simLinkSend(self->id, connId, handle, pValue, valueLen);
+}
+
+uint16_t AttGetMtu(dmConnId_t connId) {
+    return simLinkMtu();
+}
+
+// --------------------------------------------------------------------------------------------
+// Node
+
+/**
+ * @brief Runs the application kernel, then holds the worker for the time the task takes on this node
+ */
+static void executeTimedTask(Task *task) {
+    for (size_t i = 0; i < sizeof(appKernels) / sizeof(appKernels[0]); i++) {
+        if (appKernels[i]->id == task->kernelId) {
+            uint64_t start = simNowUs();
+
+            appKernels[i]->executeTask(task);
+            simBusy(simTaskUs(self, task->dataLength));
+            self->busyUs += simNowUs() - start;     // Delays inside the kernel count as busy too
+            self->tasksExecuted++;
+            return;
+        }
+    }
+}
+
+static void slaveInit(SimNode *node) {
+    self = node;
+    amdtps_init(SIM_HANDLER_ID, &amdtpsCfg, DpRecvCb, NULL);
+    initializeDistributedProtocol();
+
+    for (size_t i = 0; i < sizeof(appKernels) / sizeof(appKernels[0]); i++) {
+        timedKernels[i] = *appKernels[i];
+        timedKernels[i].executeTask = executeTimedTask;
+        DpRegisterKernel(&timedKernels[i]);
+    }
+}
+
+static void slaveAttach(dmConnId_t connId, uint16_t mtu) {
+    amdtps_start(connId, SIM_AMDTP_TIMER_IND, 0);
+}
+
+static void slaveDetach(dmConnId_t connId) {
+    dmEvt_t evt = { .hdr = { .param = connId, .event = DM_CONN_CLOSE_IND } };
+    amdtps_proc_msg(&evt.hdr);
+}
+
+static void slaveReceive(dmConnId_t connId, uint16_t handle, uint8_t *buf, uint16_t len) {
+    amdtps_write_cback(connId, handle, 0, 0, len, buf, NULL);
+}
+
+static void slaveSent(dmConnId_t connId, uint16_t handle) {
+    attEvt_t evt = { .hdr = { .param = connId, .event = ATTS_HANDLE_VALUE_CNF, .status = ATT_SUCCESS },
+                     .handle = handle };
+    amdtps_proc_msg(&evt.hdr);
+}
+
+SIM_EXPORT SimNode simSlaveNode = {
+    .speed = 1.0,
+    .init = slaveInit,
+    .attach = slaveAttach,
+    .detach = slaveDetach,
+    .receive = slaveReceive,
+    .sent = slaveSent,
+    .procMsg = amdtps_proc_msg,
+};